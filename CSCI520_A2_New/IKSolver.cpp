@@ -2,6 +2,7 @@
 // Created by zhiyixu on 3/14/13.
 //
 
+#include <string.h>
 #include "IKSolver.h"
 #include "armadillo"
 
@@ -12,9 +13,10 @@ extern Skeleton *pSkeleton_NoDof;
 
 // Calculate joint degrees
 // from bone idx_start_bone to idx_end_bone, the desired position of idx_end_bone tip is goalPos
-// return the solution to returnSolution, start the iteration from refPosture
+// return the solution to returnSolution, start the iteration from refFrame
 // Reference: Computer Animation Algorithms & Techniques 3rd Rick Parent
-void IKSolver::Solve(int idx_start_bone, int idx_end_bone, vector goalPos, Posture *returnSolution, Skeleton *skeleton, Posture *refPosture)
+void IKSolver::Solve(int idx_start_bone, int idx_end_bone, vector goalPos, double *returnSolution, SkeletonPose *pose, const double *refFrame,
+		IKJacobian jacobian)
 {
 	// degree difference when evaluating derivative
 	const double delta = 0.01;
@@ -28,6 +30,15 @@ void IKSolver::Solve(int idx_start_bone, int idx_end_bone, vector goalPos, Postu
 	freedomValue input[100];
 	int idx_input = 0;
 
+	// only the chain DOFs change, so the bones above the start bone are transformed once;
+	// if the bones do not form a chain, the reference frame is returned unchanged
+	const PostureLayout *layout = pose->GetSkeleton()->getPostureLayout();
+	int frameSize = layout->frameSize;
+	if (pose->SetChain(idx_start_bone, idx_end_bone, refFrame) < 0) {
+		memmove(returnSolution, refFrame, sizeof(double) * frameSize);
+		return;
+	}
+
 	// Traverse from start bone to end to find all freedom degree
 	Bone *ptr;
 	ptr = pSkeleton_NoDof->getBone(pSkeleton_NoDof->getRoot(), idx_start_bone);
@@ -52,14 +63,27 @@ void IKSolver::Solve(int idx_start_bone, int idx_end_bone, vector goalPos, Postu
 	while(ptr != NULL);
 	input[idx_input].boneId = -1;
 
+	// packed frame offset of every freedom degree
+	int dofOffset[100];
+	int dofBones[100], dofAxes[100];
+	for (int i = 0; i < idx_input; i++) {
+		dofOffset[i] = layout->rotationOffset[input[i].boneId] + input[i].x_y_z - 1;
+		dofBones[i] = input[i].boneId;
+		dofAxes[i] = input[i].x_y_z - 1;
+	}
+
 	// iteratively improve the solution
 	// V = J * theta
-	Posture iter = *refPosture;
-	Posture bestSolution;
+	double *iter = new double[frameSize];
+	double *bestSolution = new double[frameSize];
+	double *currentPosture = new double[frameSize];
+	memcpy(iter, refFrame, sizeof(double) * frameSize);
+	memcpy(bestSolution, refFrame, sizeof(double) * frameSize);
 	double bestDistance = 1e4;
 	mat J = mat(3, idx_input);
 	mat V = mat(3, 1);
 	mat theta = mat(idx_input, 1);
+	double *analytic = new double[3 * idx_input + 1];
 
 	// run the euler iteration
 	int times = 0;
@@ -67,15 +91,16 @@ void IKSolver::Solve(int idx_start_bone, int idx_end_bone, vector goalPos, Postu
 		// prevent iterating too many times. Mostly it is caused by unreachable position.
 		if (times > maxIterTimes)
 		{
-			iter = bestSolution;
+			memcpy(iter, bestSolution, sizeof(double) * frameSize);
 			// printf("Not Found\n");
 			break;
 		}
 		times++;
-		Posture currentPosture = iter;
-		skeleton->setPosture(currentPosture);
-		skeleton->computeBoneTipPos();
-		vector originalTipPosition = skeleton->getBoneTipPosition(idx_end_bone);
+		vector originalTipPosition;
+		if (jacobian == ANALYTIC_JACOBIAN)
+			originalTipPosition = pose->ComputeChainJacobian(iter, idx_input, dofBones, dofAxes, analytic);
+		else
+			originalTipPosition = pose->ComputeChainTipPos(iter);
 		vector diff = goalPos - originalTipPosition;
 		// Success
 		if (diff.length() < acceptedError)
@@ -87,7 +112,7 @@ void IKSolver::Solve(int idx_start_bone, int idx_end_bone, vector goalPos, Postu
 		if( bestDistance > diff.length() )
 		{
 			bestDistance = diff.length();
-			bestSolution = iter;
+			memcpy(bestSolution, iter, sizeof(double) * frameSize);
 		}
 
 		V(0, 0) = diff.p[0];
@@ -95,21 +120,23 @@ void IKSolver::Solve(int idx_start_bone, int idx_end_bone, vector goalPos, Postu
 		V(2, 0) = diff.p[2];
 
 		// Calculate the Jacobie Matrix
-		for (int i = 0; i < idx_input; i++) {
-			currentPosture = iter;
-			if (input[i].x_y_z == 1)
-				currentPosture.bone_rotation[input[i].boneId].p[0] += delta;
-			if (input[i].x_y_z == 2)
-				currentPosture.bone_rotation[input[i].boneId].p[1] += delta;
-			if (input[i].x_y_z == 3)
-				currentPosture.bone_rotation[input[i].boneId].p[2] += delta;
-			skeleton->setPosture(currentPosture);
-			skeleton->computeBoneTipPos();
-			vector newPosition = skeleton->getBoneTipPosition(idx_end_bone);
-			vector diffV = newPosition - originalTipPosition;
-			J(0, i) = diffV.p[0] / delta;
-			J(1, i) = diffV.p[1] / delta;
-			J(2, i) = diffV.p[2] / delta;
+		if (jacobian == ANALYTIC_JACOBIAN) {
+			for (int i = 0; i < idx_input; i++) {
+				J(0, i) = analytic[i];
+				J(1, i) = analytic[idx_input + i];
+				J(2, i) = analytic[2 * idx_input + i];
+			}
+		}
+		else {
+			for (int i = 0; i < idx_input; i++) {
+				memcpy(currentPosture, iter, sizeof(double) * frameSize);
+				currentPosture[dofOffset[i]] += delta;
+				vector newPosition = pose->ComputeChainTipPos(currentPosture);
+				vector diffV = newPosition - originalTipPosition;
+				J(0, i) = diffV.p[0] / delta;
+				J(1, i) = diffV.p[1] / delta;
+				J(2, i) = diffV.p[2] / delta;
+			}
 		}
 
 		// pseudoinverse
@@ -117,10 +144,14 @@ void IKSolver::Solve(int idx_start_bone, int idx_end_bone, vector goalPos, Postu
 
 		// use Euler Method to update theta
 		for (int i = 0; i < idx_input; i++) {
-			iter.bone_rotation[input[i].boneId].p[input[i].x_y_z-1] += theta(i, 0) * eulerStep;
+			iter[dofOffset[i]] += theta(i, 0) * eulerStep;
 		}
 	}
 
 
-	*returnSolution = iter;
+	memcpy(returnSolution, iter, sizeof(double) * frameSize);
+	delete[] iter;
+	delete[] bestSolution;
+	delete[] currentPosture;
+	delete[] analytic;
 }
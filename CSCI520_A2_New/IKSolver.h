@@ -12,6 +12,7 @@
 #include <iostream>
 #include "vector.h"
 #include "skeleton.h"
+#include "skeletonpose.h"
 #include "posture.h"
 
 struct freedomValue
@@ -23,9 +24,19 @@ struct freedomValue
 	double value;
 };
 
+// how IKSolver::Solve computes the Jacobian of the end effector position:
+// ANALYTIC_JACOBIAN from the joint axes and the effector position in one chain FK pass,
+// FINITE_DIFFERENCE_JACOBIAN with one chain FK pass per DOF, each rotation changed by 0.01 degrees
+enum IKJacobian {
+	ANALYTIC_JACOBIAN = 0, FINITE_DIFFERENCE_JACOBIAN
+};
+
 class IKSolver {
 	public:
-	static void Solve(int idx_start_bone,int idx_end_bone,vector goalPos,Posture * returnSolution,Skeleton * skeleton,Posture * refPosture);
+	// returnSolution and refFrame are packed frames (see Skeleton::getPostureLayout); they may alias
+	// pose is the caller's workspace (one per thread) for the skeleton with all rotational DOFs
+	static void Solve(int idx_start_bone,int idx_end_bone,vector goalPos,double * returnSolution,SkeletonPose * pose,const double * refFrame,
+			IKJacobian jacobian = ANALYTIC_JACOBIAN);
 
 };
 
@@ -0,0 +1,356 @@
+/*
+ amcstream.cpp
+
+ See amcstream.h.
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amcstream.h"
+
+const char * ParseAMCFrame(const char * p, const char * end, Skeleton * pSkeleton,
+		const Bone * bones, double scale, double * frame, int frameNumber) {
+	const PostureLayout * layout = pSkeleton->getPostureLayout();
+	char str[2048];
+
+	while (1) {
+		p = SkipWhitespace(p, end);
+
+		// a line with just a number starts the next frame
+		if ((p == end) || ((*p >= '0') && (*p <= '9')))
+			return p;
+
+		//read bone name and find the bone index corresponding to it
+		const char * token = p;
+		p = SkipToken(p, end);
+		int bone_idx = pSkeleton->name2idx(token, p - token);
+
+		size_t length = p - token;
+		if (length >= sizeof(str))
+			length = sizeof(str) - 1;
+		memcpy(str, token, length);
+		str[length] = 0;
+
+		if (bone_idx < 0) {
+			printf("Error: unknown bone '%s' in AMC frame %d.\n", str, frameNumber);
+			return NULL;
+		}
+
+		//rotation angles for this bone are already (0, 0, 0)
+		double * rotation = frame + layout->rotationOffset[bone_idx];
+		double * translation = frame + layout->translationOffset[bone_idx];
+
+		for (int x = 0; x < bones[bone_idx].dof; x++) {
+			double tmp;
+			p = SkipWhitespace(p, end);
+			const char * next = ParseDouble(p, end, &tmp);
+			if (next == p) {
+				printf("Error: bad value for bone '%s' in AMC frame %d.\n", str, frameNumber);
+				return NULL;
+			}
+			p = next;
+
+			switch (bones[bone_idx].dofo[x]) {
+			case 0:
+				printf("FATAL ERROR in bone %d not found %d\n", bone_idx, x);
+				x = bones[bone_idx].dof;
+				break;
+			case 1:
+				rotation[0] = tmp;
+				break;
+			case 2:
+				rotation[1] = tmp;
+				break;
+			case 3:
+				rotation[2] = tmp;
+				break;
+			case 4:
+				translation[0] = tmp * scale;
+				break;
+			case 5:
+				translation[1] = tmp * scale;
+				break;
+			case 6:
+				translation[2] = tmp * scale;
+				break;
+			case 7:
+				frame[layout->lengthOffset[bone_idx]] = tmp; // * scale;
+				break;
+			}
+		}
+
+		// read joint angles, including root orientation
+		// (the root translation is stored in place of the root position)
+	}
+}
+
+void AppendAMCHeader(OutputBuffer & os, int forceAllJointsBe3DOF) {
+	os.Append(":FULLY-SPECIFIED\n");
+	if (forceAllJointsBe3DOF)
+		os.Append(":FORCE-ALL-JOINTS-BE-3DOF\n");
+	os.Append(":DEGREES\n");
+}
+
+void AppendAMCFrame(OutputBuffer & os, Skeleton * pSkeleton, const double * frame,
+		int frameNumber, double scale) {
+	Bone * bone = pSkeleton->getRoot();
+	int numbones = pSkeleton->numBonesInSkel(bone[0]);
+
+	int root = Skeleton::getRootIndex();
+	const PostureLayout * layout = pSkeleton->getPostureLayout();
+	const double * rootPos = frame + PostureLayout::getRootPosOffset();
+	const double * rootRotation = frame + layout->rotationOffset[root];
+	os.AppendInt(frameNumber);
+	os.Append("\nroot ", 6);
+	os.AppendDouble(rootPos[0] / scale);
+	os.AppendChar(' ');
+	os.AppendDouble(rootPos[1] / scale);
+	os.AppendChar(' ');
+	os.AppendDouble(rootPos[2] / scale);
+	os.AppendChar(' ');
+	os.AppendDouble(rootRotation[0]);
+	os.AppendChar(' ');
+	os.AppendDouble(rootRotation[1]);
+	os.AppendChar(' ');
+	os.AppendDouble(rootRotation[2]);
+
+	for (int j = 2; j < numbones; j++) {
+		//output bone name
+		if (bone[j].dof != 0) {
+			const double * rotation = frame + layout->rotationOffset[j];
+			os.AppendChar('\n');
+			os.Append(pSkeleton->idx2name(j));
+
+			//output bone rotation angles
+			for (int d = 0; d < bone[j].dof; d++) {
+				// traverse all DOFs
+
+				// is this DOF rx ?
+				if (bone[j].dofo[d] == 1) {
+					// if enabled, output the DOF
+					if (bone[j].dofrx == 1) {
+						os.AppendChar(' ');
+						os.AppendDouble(rotation[0]);
+					}
+				}
+
+				// is this DOF ry ?
+				if (bone[j].dofo[d] == 2) {
+					// if enabled, output the DOF
+					if (bone[j].dofry == 1) {
+						os.AppendChar(' ');
+						os.AppendDouble(rotation[1]);
+					}
+				}
+
+				// is this DOF rz ?
+				if (bone[j].dofo[d] == 3) {
+					// if enabled, output the DOF
+					if (bone[j].dofrz == 1) {
+						os.AppendChar(' ');
+						os.AppendDouble(rotation[2]);
+					}
+				}
+			}
+		}
+	}
+	os.AppendChar('\n');
+}
+
+AMCReader::AMCReader(Skeleton * pSkeleton, double scale) {
+	m_pSkeleton = pSkeleton;
+	m_Scale = scale;
+	m_pFile = NULL;
+	m_Capacity = 1 << 20;
+	m_pBuffer = (char *) malloc(m_Capacity);
+	m_Begin = m_End = 0;
+	m_EndOfFile = 1;
+	m_NumFramesRead = 0;
+}
+
+AMCReader::~AMCReader() {
+	Close();
+	free(m_pBuffer);
+}
+
+int AMCReader::Open(const char * filename) {
+	Close();
+
+	if (strcmp(filename, "-") == 0)
+		m_pFile = stdin;
+	else
+		m_pFile = fopen(filename, "rb");
+	if (m_pFile == NULL) {
+		printf("Error in AMCReader::Open: cannot open '%s'.\n", filename);
+		return -1;
+	}
+	m_Begin = m_End = 0;
+	m_EndOfFile = 0;
+	m_NumFramesRead = 0;
+
+	// process the header (add rotational DOFs to skeleton if requested)
+	while (1) {
+		const char * begin = m_pBuffer + m_Begin;
+		const char * end = m_pBuffer + m_End;
+		const char * lineEnd = (const char *) memchr(begin, '\n', end - begin);
+		if ((lineEnd == NULL) && !m_EndOfFile) {
+			Refill();
+			continue;
+		}
+		if (begin == end) {
+			printf("Error in AMCReader::Open: no :DEGREES line in '%s'.\n", filename);
+			Close();
+			return -1;
+		}
+		lineEnd = (lineEnd == NULL) ? end : lineEnd + 1;
+		m_Begin = lineEnd - m_pBuffer;
+
+		// comment line
+		const char * p = SkipWhitespace(begin, lineEnd);
+		if ((p == lineEnd) || (*p == '#'))
+			continue;
+
+		const char * token = p;
+		p = SkipToken(p, lineEnd);
+		size_t length = p - token;
+
+		if ((length == 25) && (strncmp(token, ":FORCE-ALL-JOINTS-BE-3DOF", length) == 0))
+			m_pSkeleton->enableAllRotationalDOFs();
+
+		if ((length == 8) && (strncmp(token, ":DEGREES", length) == 0))
+			break;
+	}
+
+	memcpy(m_Bones, m_pSkeleton->getRoot(), sizeof(m_Bones));
+	return 0;
+}
+
+void AMCReader::Close() {
+	if ((m_pFile != NULL) && (m_pFile != stdin))
+		fclose(m_pFile);
+	m_pFile = NULL;
+	m_Begin = m_End = 0;
+	m_EndOfFile = 1;
+}
+
+size_t AMCReader::Refill() {
+	if (m_EndOfFile)
+		return 0;
+
+	memmove(m_pBuffer, m_pBuffer + m_Begin, m_End - m_Begin);
+	m_End -= m_Begin;
+	m_Begin = 0;
+
+	// a single frame larger than the buffer
+	if (m_End == m_Capacity) {
+		m_Capacity *= 2;
+		m_pBuffer = (char *) realloc(m_pBuffer, m_Capacity);
+	}
+
+	size_t count = fread(m_pBuffer + m_End, 1, m_Capacity - m_End, m_pFile);
+	m_End += count;
+	if (count == 0)
+		m_EndOfFile = 1;
+	return count;
+}
+
+size_t AMCReader::FindFrameEnd() {
+	size_t scan = m_Begin;
+	while (1) {
+		const char * end = m_pBuffer + m_End;
+		const char * p = m_pBuffer + scan;
+
+		// the next frame starts at the first line that begins with a digit
+		while ((p = (const char *) memchr(p, '\n', end - p)) != NULL) {
+			const char * q = SkipWhitespace(p, end);
+			if (q == end)
+				break;
+			if ((*q >= '0') && (*q <= '9'))
+				return q - m_pBuffer;
+			p = q;
+		}
+		if (m_EndOfFile)
+			return m_End;
+
+		// continue from the undecided line break after reading more
+		scan = ((p == NULL) ? m_End : (size_t) (p - m_pBuffer)) - m_Begin;
+		Refill();
+	}
+}
+
+int AMCReader::ReadFrame(double * frame) {
+	while (1) {
+		const char * p = SkipWhitespace(m_pBuffer + m_Begin, m_pBuffer + m_End);
+		m_Begin = p - m_pBuffer;
+		if (m_Begin < m_End)
+			break;
+		if (Refill() == 0)
+			return 0;
+	}
+
+	// a line with just a number starts a new frame
+	char c = m_pBuffer[m_Begin];
+	if ((c < '0') || (c > '9')) {
+		printf("Error in AMCReader::ReadFrame: bone data before the first frame number.\n");
+		return -1;
+	}
+
+	size_t frameEnd = FindFrameEnd();
+	const char * end = m_pBuffer + frameEnd;
+
+	int frame_num;
+	const char * p = ParseInt(m_pBuffer + m_Begin, end, &frame_num);
+
+	memset(frame, 0, sizeof(double) * m_pSkeleton->getPostureLayout()->frameSize);
+	p = ParseAMCFrame(p, end, m_pSkeleton, m_Bones, m_Scale, frame, m_NumFramesRead + 1);
+	if (p == NULL)
+		return -1;
+
+	m_Begin = frameEnd;
+	m_NumFramesRead++;
+	return 1;
+}
+
+int AMCReader::ReadFrames(double * frames, int numFrames) {
+	int frameSize = m_pSkeleton->getPostureLayout()->frameSize;
+	for (int f = 0; f < numFrames; f++) {
+		int code = ReadFrame(frames + (size_t) f * frameSize);
+		if (code < 0)
+			return -1;
+		if (code == 0)
+			return f;
+	}
+	return numFrames;
+}
+
+AMCWriter::AMCWriter(Skeleton * pSkeleton, double scale, int forceAllJointsBe3DOF) {
+	m_pSkeleton = pSkeleton;
+	m_Scale = scale;
+	m_ForceAllJointsBe3DOF = forceAllJointsBe3DOF;
+	m_NumFramesWritten = 0;
+}
+
+AMCWriter::~AMCWriter() {
+	Close();
+}
+
+int AMCWriter::Open(const char * filename) {
+	if (m_Output.Open(filename) != 0) {
+		printf("Error in AMCWriter::Open: cannot open '%s'.\n", filename);
+		return -1;
+	}
+	m_NumFramesWritten = 0;
+	AppendAMCHeader(m_Output, m_ForceAllJointsBe3DOF);
+	return 0;
+}
+
+int AMCWriter::Close() {
+	return m_Output.Close();
+}
+
+void AMCWriter::WriteFrame(const double * frame) {
+	m_NumFramesWritten++;
+	AppendAMCFrame(m_Output, m_pSkeleton, frame, m_NumFramesWritten, m_Scale);
+}
@@ -0,0 +1,127 @@
+/*
+ amcstream.h
+
+ Frame-at-a-time access to AMC files, for recordings too long to hold in a Motion:
+ 1. AMCReader: reads packed frames (see PostureLayout) one at a time, or a few at a
+    time, from an AMC file or from standard input
+ 2. AMCWriter: writes packed frames one at a time to an AMC file or to standard output
+ 3. FrameWriter: what AMCWriter and BinaryMotionWriter (motion.h) have in common, for
+    code that produces frames for either kind of file
+
+ Both keep only a fixed-size text buffer, so memory use does not grow with the
+ length of the recording. The file name "-" selects standard input / output.
+
+ The frame parser and formatter are shared with Motion::readAMCfile and
+ Motion::writeAMCfile, so both paths produce identical frames and text.
+
+ */
+
+#ifndef _AMCSTREAM_H
+#define _AMCSTREAM_H
+
+#include <stdio.h>
+#include "skeleton.h"
+#include "fileio.h"
+
+class AMCReader {
+public:
+	// translations are multiplied by scale, as in Motion(amc_filename, scale, pSkeleton)
+	AMCReader(Skeleton * pSkeleton, double scale);
+	~AMCReader();
+
+	// open the file and read the header; returns 0 on success, -1 on failure
+	// (a :FORCE-ALL-JOINTS-BE-3DOF header enables all rotational DOFs of the skeleton)
+	int Open(const char * filename);
+	void Close();
+
+	// read the next frame into frame (getPostureLayout()->frameSize values)
+	// returns 1 if a frame was read, 0 at the end of the file, -1 on error
+	int ReadFrame(double * frame);
+	// read up to numFrames consecutive frames; returns the number read, or -1 on error
+	int ReadFrames(double * frames, int numFrames);
+
+	int GetNumFramesRead() const {
+		return m_NumFramesRead;
+	}
+	Skeleton * GetSkeleton() const {
+		return m_pSkeleton;
+	}
+
+protected:
+	Skeleton * m_pSkeleton;
+	double m_Scale;
+	// DOF order of every bone when the header was read; frames keep this order even
+	// if the skeleton's DOFs are changed later (e.g. by enableAllRotationalDOFs)
+	Bone m_Bones[MAX_BONES_IN_ASF_FILE];
+
+	FILE * m_pFile;
+	char * m_pBuffer;
+	size_t m_Capacity;
+	size_t m_Begin; // first unparsed character
+	size_t m_End; // end of the valid data
+	int m_EndOfFile;
+	int m_NumFramesRead;
+
+	// keep the unparsed data and read more after it (growing the buffer if it is full)
+	// returns the number of bytes read
+	size_t Refill();
+	// position of the frame number that follows the frame starting at m_Begin,
+	// reading more data as needed; m_End if the frame is the last one
+	size_t FindFrameEnd();
+};
+
+// A motion file that is written one packed frame at a time
+class FrameWriter {
+public:
+	virtual ~FrameWriter() {
+	}
+
+	// append one frame (getPostureLayout()->frameSize values)
+	virtual void WriteFrame(const double * frame) = 0;
+	// returns 0 on success, -1 if any write failed
+	virtual int Close() = 0;
+
+	int GetNumFramesWritten() const {
+		return m_NumFramesWritten;
+	}
+
+protected:
+	int m_NumFramesWritten;
+};
+
+class AMCWriter : public FrameWriter {
+public:
+	// see Motion::writeAMCfile for scale and forceAllJointsBe3DOF
+	AMCWriter(Skeleton * pSkeleton, double scale, int forceAllJointsBe3DOF = 0);
+	~AMCWriter();
+
+	// open the file and write the header; returns 0 on success, -1 on failure
+	int Open(const char * filename);
+	// returns 0 on success, -1 if any write failed
+	int Close();
+
+	// append one frame (numbered consecutively from 1)
+	void WriteFrame(const double * frame);
+
+protected:
+	Skeleton * m_pSkeleton;
+	double m_Scale;
+	int m_ForceAllJointsBe3DOF;
+	OutputBuffer m_Output;
+};
+
+// Parse the bone lines of one frame, up to the next frame number or end.
+// bones gives the DOF order of each bone; values are stored into the packed frame
+// (which the caller has zeroed). frameNumber is only used in error messages.
+// Returns the position of the next frame number (or end), or NULL on error.
+const char * ParseAMCFrame(const char * p, const char * end, Skeleton * pSkeleton,
+		const Bone * bones, double scale, double * frame, int frameNumber);
+
+// Write the AMC header lines.
+void AppendAMCHeader(OutputBuffer & os, int forceAllJointsBe3DOF);
+
+// Write one frame: its number and one line per bone with enabled DOFs.
+void AppendAMCFrame(OutputBuffer & os, Skeleton * pSkeleton, const double * frame,
+		int frameNumber, double scale);
+
+#endif
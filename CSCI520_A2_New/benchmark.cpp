@@ -0,0 +1,1485 @@
+/*
+ benchmark.cpp
+
+ Timing harness for the motion I/O and interpolation code paths.
+ Not part of the interpolate target; build it from all sources except
+ interpolate.cpp and main.cpp, e.g.
+
+   c++ -O2 -ffp-contract=off benchmark.cpp fileio.cpp motion.cpp skeleton.cpp ... -o benchmark
+
+ (the kernel sources turn off contraction into fused multiply-adds themselves; the
+ flag keeps the reference formulas of the benchmark rounded the same way)
+
+ Usage: benchmark parse <skeleton.asf> <motion.amc> [repetitions]
+   compares the previous two-pass iostream AMC parser with Motion's reader,
+   then times Motion's reader with 1, 2, 4, ... threads (up to the hardware
+   thread count, at least 8) and checks that all of them give identical frames
+        benchmark write <skeleton.asf> <motion.amc> <scratch.amc> [repetitions]
+   compares the previous ofstream AMC writer with Motion::writeAMCfile
+   and checks that the written file reads back to identical frames, and that
+   FormatDouble switches notation at the documented exponents
+        benchmark binary <skeleton.asf> <motion.amc> <scratch.amcb> [repetitions]
+   compares loading the AMC file with loading it as a binary motion file
+   (double and float) and checks that the double file reads back exactly
+        benchmark slerp [quaternions] [repetitions]
+   times slerp of random quaternion pairs (as for all bones of many frames) with
+   the C library formula of Interpolator::Slerp and with every SlerpArrays kernel
+   the processor supports, reports the largest difference from the formula and
+   checks that all kernels give identical results
+        benchmark convert [rotations] [repetitions]
+   times the conversions between XYZ Euler angles and quaternions through rotation
+   matrices (as Interpolator did) and in closed form, and every QuaternionArraysToEuler
+   kernel; checks that they agree with the matrix path
+        benchmark sample <skeleton.asf> <motion.amc> [N] [repetitions]
+   for every interpolation type and angle representation, compares Interpolate (every
+   (N+1)-th frame a keyframe) with creating a MotionEvaluator and sampling it at as many
+   fractional times, and checks that the evaluator gives the interpolated frames
+        benchmark edit <skeleton.asf> <motion.amc> [N] [edits]
+   for every interpolation type and angle representation, changes keyframes one at a
+   time in an InterpolationSession, compares the time per Update with interpolating the
+   whole motion, and checks that the session gives the motion Interpolate gives
+        benchmark keyframes <skeleton.asf> <motion.amc> [max angle] [max position]
+   for every interpolation type and angle representation, times KeyframeSelector for
+   both error measures, checks that the selected keyframes are within the budget and
+   compares the error with as many uniformly spaced keyframes
+        benchmark squad <skeleton.asf> <motion.amc> [N] [repetitions]
+   compares Bezier, SQUAD and Catmull-Rom quaternion interpolation, with every (N+1)-th
+   frame a keyframe and with keyframes alternately N/2 and 3N/2 frames apart: the time
+   of Interpolate, the largest and mean bone rotation error, and how much the angular
+   velocity of the bones jumps at the keyframes
+        benchmark fk <skeleton.asf> <motion.amc> [repetitions]
+   times the bone tip positions of every frame with the recursive traversal of 4x4
+   matrices (as Skeleton::computeBoneTipPos did) and with computeBoneTipPos, and checks
+   that they give the same positions
+        benchmark tracks <skeleton.asf> <motion.amc> [repetitions]
+   times BoneTracks for the whole motion with every SIMD kernel the processor supports
+   and with 1, 2, 4, ... threads, compared with posing the skeleton frame by frame;
+   checks the positions and orientations against computeBoneTipPos, and that all
+   kernels and thread counts give identical tracks
+        benchmark chain <skeleton.asf> <motion.amc> [repetitions]
+   for the chains of Interpolator::SolveIK, times the end effector positions of a
+   finite difference Jacobian (every frame, and every rotation of the chain changed in
+   turn, as IKSolver::Solve does) with Skeleton::setPosture and computeBoneTipPos and with
+   SkeletonPose::SetChain and ComputeChainTipPos, and checks that they give the same
+   positions
+        benchmark ik <skeleton.asf> <motion.amc> [N] [repetitions]
+   times Interpolate with the IK solver (Bezier quaternion interpolation, every (N+1)-th
+   frame a keyframe) with 1, 2, 4, ... threads (up to the hardware thread count, at
+   least 8), each of them posing its own SkeletonPose
+   of the shared skeleton, and checks that all thread counts give the same motion
+        benchmark jacobian <skeleton.asf> <motion.amc> [N] [repetitions]
+   for the chains of Interpolator::SolveIK at every frame, times the end effector
+   Jacobian from finite differences (0.01 degrees, as IKSolver::Solve) and with
+   SkeletonPose::ComputeChainJacobian, and checks that they agree (also with central
+   differences, to O(delta^2)); then compares
+   Interpolate with the IK solver (Bezier quaternion interpolation) with both: its
+   time, and how far the hands and feet end up from where they are in the input
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <chrono>
+#include <math.h>
+#include <float.h>
+
+#include "skeleton.h"
+#include "motion.h"
+#include "types.h"
+#include "fileio.h"
+#include "parallel.h"
+#include "quaternionarrays.h"
+#include "transform.h"
+#include "interpolator.h"
+#include "motionevaluator.h"
+#include "interpolationsession.h"
+#include "keyframeselector.h"
+#include "bonetracks.h"
+#include "skeletonpose.h"
+
+// defined by interpolate.cpp in the interpolate target; IKSolver reads it
+Skeleton *pSkeleton_NoDof = NULL;
+
+static double Now() {
+	return std::chrono::duration<double>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// bone index -> name by scanning the bone list, as Skeleton::idx2name used to
+static char * LinearIdx2Name(Skeleton * pSkeleton, int idx) {
+	int i = 0;
+	while (pSkeleton->m_pBoneList[i].idx != idx && i++ < pSkeleton->NUM_BONES_IN_ASF_FILE)
+		;
+	return pSkeleton->m_pBoneList[i].name;
+}
+
+// The AMC parser as it was before the single-pass reader: count lines,
+// then extract tokens with ifstream >> and look bone names up linearly.
+static Motion * ReadAMCWithIostream(char * name, double scale, Skeleton * pSkeleton) {
+	Bone * bone = pSkeleton->getRoot();
+
+	std::ifstream file(name, std::ios::in);
+	if (file.fail())
+		return NULL;
+
+	int n = 0;
+	char str[2048];
+	while (!file.eof()) {
+		file.getline(str, 2048);
+		if (file.eof())
+			break;
+		if (strcmp(str, "") != 0)
+			n++;
+	}
+	file.close();
+
+	int numbones = pSkeleton->numBonesInSkel(bone[0]);
+	int movbones = pSkeleton->movBonesInSkel(bone[0]);
+	n = (n - 3) / ((movbones) + 1);
+
+	Motion * pMotion = new Motion(n, pSkeleton);
+	const PostureLayout * layout = pSkeleton->getPostureLayout();
+
+	file.open(name);
+	while (1) {
+		file >> str;
+		if (strcmp(str, ":DEGREES") == 0)
+			break;
+	}
+
+	for (int i = 0; i < n; i++) {
+		int frame_num;
+		file >> frame_num;
+		double * frame = pMotion->GetFrame(i);
+
+		for (int j = 0; j < movbones; j++) {
+			file >> str;
+			int bone_idx;
+			for (bone_idx = 0; bone_idx < numbones; bone_idx++)
+				if (strcmp(str, LinearIdx2Name(pSkeleton, bone_idx)) == 0)
+					break;
+
+			for (int x = 0; x < bone[bone_idx].dof; x++) {
+				double tmp;
+				file >> tmp;
+				int dofo = bone[bone_idx].dofo[x];
+				if ((dofo >= 1) && (dofo <= 3))
+					frame[layout->rotationOffset[bone_idx] + dofo - 1] = tmp;
+				else if ((dofo >= 4) && (dofo <= 6))
+					frame[layout->translationOffset[bone_idx] + dofo - 4] = tmp * scale;
+				else if (dofo == 7)
+					frame[layout->lengthOffset[bone_idx]] = tmp;
+			}
+		}
+	}
+	return pMotion;
+}
+
+// The AMC writer as it was before buffered output: ofstream, std::endl on every
+// line and default (6 significant digit) double formatting.
+static int WriteAMCWithIostream(Motion * pMotion, char * filename, double scale) {
+	Skeleton * pSkeleton = pMotion->GetSkeleton();
+	Bone * bone = pSkeleton->getRoot();
+	const PostureLayout * layout = pSkeleton->getPostureLayout();
+
+	std::ofstream os(filename);
+	if (os.fail())
+		return -1;
+
+	os << ":FULLY-SPECIFIED" << std::endl;
+	os << ":DEGREES" << std::endl;
+
+	int numbones = pSkeleton->numBonesInSkel(bone[0]);
+	for (int f = 0; f < pMotion->GetNumFrames(); f++) {
+		const double * frame = pMotion->GetFrame(f);
+		const double * rootRotation = frame + layout->rotationOffset[0];
+		os << f + 1 << std::endl;
+		os << "root " << frame[0] / scale << " " << frame[1] / scale << " "
+				<< frame[2] / scale << " " << rootRotation[0] << " "
+				<< rootRotation[1] << " " << rootRotation[2];
+
+		for (int j = 2; j < numbones; j++) {
+			if (bone[j].dof != 0) {
+				const double * rotation = frame + layout->rotationOffset[j];
+				os << std::endl << LinearIdx2Name(pSkeleton, j);
+				for (int d = 0; d < bone[j].dof; d++) {
+					int dofo = bone[j].dofo[d];
+					if ((dofo == 1) && bone[j].dofrx)
+						os << " " << rotation[0];
+					if ((dofo == 2) && bone[j].dofry)
+						os << " " << rotation[1];
+					if ((dofo == 3) && bone[j].dofrz)
+						os << " " << rotation[2];
+				}
+			}
+		}
+		os << std::endl;
+	}
+	os.close();
+	return 0;
+}
+
+static int CompareMotions(Motion * pA, Motion * pB) {
+	if (pA->GetNumFrames() != pB->GetNumFrames()) {
+		printf("frame counts differ: %d vs %d\n", pA->GetNumFrames(), pB->GetNumFrames());
+		return 1;
+	}
+	int size = pA->GetFrameSize();
+	for (int f = 0; f < pA->GetNumFrames(); f++)
+		if (memcmp(pA->GetFrame(f), pB->GetFrame(f), sizeof(double) * size) != 0) {
+			printf("frame %d differs\n", f);
+			return 1;
+		}
+	return 0;
+}
+
+static int BenchmarkParse(char * asfFile, char * amcFile, int repetitions) {
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+
+	double reference = 1e30, current = 1e30;
+	Motion * pReference = NULL;
+	Motion * pCurrent = NULL;
+	for (int r = 0; r < repetitions; r++) {
+		delete pReference;
+		delete pCurrent;
+
+		double start = Now();
+		pReference = ReadAMCWithIostream(amcFile, MOCAP_SCALE, &skeleton);
+		double middle = Now();
+		pCurrent = new Motion(amcFile, MOCAP_SCALE, &skeleton);
+		double stop = Now();
+
+		if (middle - start < reference)
+			reference = middle - start;
+		if (stop - middle < current)
+			current = stop - middle;
+	}
+
+	FILE * file = fopen(amcFile, "rb");
+	fseek(file, 0, SEEK_END);
+	double megabytes = ftell(file) / 1048576.0;
+	fclose(file);
+
+	printf("iostream parser: %8.3f s  %8.1f MB/s\n", reference, megabytes / reference);
+	printf("Motion reader:   %8.3f s  %8.1f MB/s  (%.1fx)\n", current, megabytes / current, reference / current);
+	int code = CompareMotions(pReference, pCurrent);
+	printf("results %s\n", code ? "DIFFER" : "identical");
+
+	// thread scaling of the chunked parser
+	int maxThreads = GetNumThreads();
+	if (maxThreads < 8)
+		maxThreads = 8;
+	double singleThreaded = 0;
+	for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+		SetNumThreads(numThreads);
+		double best = 1e30;
+		for (int r = 0; r < repetitions; r++) {
+			double start = Now();
+			Motion threaded(amcFile, MOCAP_SCALE, &skeleton);
+			double stop = Now();
+			if (stop - start < best)
+				best = stop - start;
+			if ((r == 0) && CompareMotions(pReference, &threaded)) {
+				printf("%d threads: results DIFFER\n", numThreads);
+				code = 1;
+			}
+		}
+		if (numThreads == 1)
+			singleThreaded = best;
+		printf("%3d threads:     %8.3f s  %8.1f MB/s  (%.1fx)\n", numThreads, best,
+				megabytes / best, singleThreaded / best);
+	}
+	SetNumThreads(0);
+
+	delete pReference;
+	delete pCurrent;
+	return code;
+}
+
+static int BenchmarkWrite(char * asfFile, char * amcFile, char * scratchFile, int repetitions) {
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+	Motion motion(amcFile, MOCAP_SCALE, &skeleton);
+
+	double reference = 1e30, current = 1e30;
+	for (int r = 0; r < repetitions; r++) {
+		double start = Now();
+		WriteAMCWithIostream(&motion, scratchFile, MOCAP_SCALE);
+		double middle = Now();
+		motion.writeAMCfile(scratchFile, MOCAP_SCALE);
+		double stop = Now();
+
+		if (middle - start < reference)
+			reference = middle - start;
+		if (stop - middle < current)
+			current = stop - middle;
+	}
+
+	printf("ofstream writer: %8.3f s\n", reference);
+	printf("Motion writer:   %8.3f s  (%.1fx)\n", current, reference / current);
+
+	Motion written(scratchFile, MOCAP_SCALE, &skeleton);
+	int code = CompareMotions(&motion, &written);
+	printf("round trip %s\n", code ? "DIFFERS" : "exact");
+
+	// plain notation for exponents -5 to 14, scientific notation outside
+	const double values[5] = { 1e-5, 9.5e-6, 1e14, 999999999999999.0, 1e15 };
+	const char * expected[5] = { "0.00001", "9.5e-06", "100000000000000", "999999999999999", "1e+15" };
+	for (int i = 0; i < 5; i++) {
+		char buffer[32];
+		char * end = FormatDouble(buffer, values[i]);
+		*end = 0;
+		double parsed = 0;
+		int readBack = (ParseDouble(buffer, end, &parsed) == end) && (parsed == values[i]);
+		if ((strcmp(buffer, expected[i]) != 0) || !readBack) {
+			printf("FormatDouble(%.17g) gives \"%s\" (expected \"%s\")%s\n", values[i], buffer, expected[i],
+					readBack ? "" : ", which does not read back");
+			code = 1;
+		}
+	}
+	return code;
+}
+
+static int BenchmarkBinary(char * asfFile, char * amcFile, char * scratchFile, int repetitions) {
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+	Motion motion(amcFile, MOCAP_SCALE, &skeleton);
+
+	const char * labels[3] = { "AMC reader:          ", "binary reader:       ", "binary float reader: " };
+	double best[3] = { 1e30, 1e30, 1e30 };
+	int code = 0;
+	for (int mode = 0; mode < 3; mode++) {
+		if (mode > 0)
+			motion.writeBinaryFile(scratchFile, MOCAP_SCALE, mode == 2);
+		char * file = (mode == 0) ? amcFile : scratchFile;
+		for (int r = 0; r < repetitions; r++) {
+			double start = Now();
+			Motion loaded(file, MOCAP_SCALE, &skeleton);
+			// touch every frame so that lazily mapped pages are counted
+			double sum = 0;
+			for (int f = 0; f < loaded.GetNumFrames(); f++)
+				sum += loaded.GetFrame(f)[0];
+			double stop = Now();
+			if (stop - start < best[mode])
+				best[mode] = stop - start;
+			if ((mode == 1) && (r == 0))
+				code = CompareMotions(&motion, &loaded) || (sum != sum);
+		}
+	}
+
+	for (int mode = 0; mode < 3; mode++)
+		printf("%s %8.4f s  (%.1fx)\n", labels[mode], best[mode], best[0] / best[mode]);
+	printf("binary round trip %s\n", code ? "DIFFERS" : "exact");
+	return code;
+}
+
+// Interpolator::Slerp, on structure of arrays
+static void SlerpWithLibm(int count, const QuaternionArrays & start, const QuaternionArrays & end,
+		double t, const QuaternionArrays & result) {
+	for (int i = 0; i < count; i++) {
+		double a[4] = { start.s[i], start.x[i], start.y[i], start.z[i] };
+		double b[4] = { end.s[i], end.x[i], end.y[i], end.z[i] };
+		double cosTheta = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+		if (cosTheta < 0.0) {
+			cosTheta = -1 * cosTheta;
+			for (int c = 0; c < 4; c++)
+				b[c] = -1. * b[c];
+		}
+		double wa = 1 - t, wb = t;
+		if (cosTheta <= 0.9995) {
+			double theta = acos(cosTheta);
+			wa = sin((1 - t) * theta) / sin(theta);
+			wb = sin(t * theta) / sin(theta);
+		}
+		double r[4], norm2 = 0;
+		for (int c = 0; c < 4; c++) {
+			r[c] = wa * a[c] + wb * b[c];
+			norm2 += r[c] * r[c];
+		}
+		double invNorm = 1.0 / sqrt(norm2);
+		result.s[i] = r[0] * invNorm;
+		result.x[i] = r[1] * invNorm;
+		result.y[i] = r[2] * invNorm;
+		result.z[i] = r[3] * invNorm;
+	}
+}
+
+static QuaternionArrays AllocateQuaternionArrays(int count) {
+	double * values = new double[(size_t) 4 * count];
+	QuaternionArrays arrays = { values, values + count, values + 2 * count, values + 3 * count };
+	return arrays;
+}
+
+static int BenchmarkSlerp(int count, int repetitions) {
+	QuaternionArrays start = AllocateQuaternionArrays(count);
+	QuaternionArrays end = AllocateQuaternionArrays(count);
+	QuaternionArrays expected = AllocateQuaternionArrays(count);
+	QuaternionArrays scalar = AllocateQuaternionArrays(count);
+	QuaternionArrays result = AllocateQuaternionArrays(count);
+
+	// random unit quaternions; every third pair is nearly parallel, as between
+	// the keyframes of a smooth motion
+	srand(1);
+	for (int i = 0; i < count; i++) {
+		double a[4], b[4], na = 0, nb = 0;
+		for (int c = 0; c < 4; c++) {
+			a[c] = rand() / (double) RAND_MAX - 0.5;
+			if (i % 3 == 0)
+				b[c] = a[c] + 0.01 * (rand() / (double) RAND_MAX - 0.5);
+			else
+				b[c] = rand() / (double) RAND_MAX - 0.5;
+			na += a[c] * a[c];
+			nb += b[c] * b[c];
+		}
+		na = sqrt(na);
+		nb = sqrt(nb);
+		start.s[i] = a[0] / na;
+		start.x[i] = a[1] / na;
+		start.y[i] = a[2] / na;
+		start.z[i] = a[3] / na;
+		end.s[i] = b[0] / nb;
+		end.x[i] = b[1] / nb;
+		end.y[i] = b[2] / nb;
+		end.z[i] = b[3] / nb;
+	}
+
+	// t = 1/16, ..., 15/16; the results of the last step are compared
+	const int numSteps = 16;
+	double reference = 1e30;
+	for (int r = 0; r < repetitions; r++) {
+		double begin = Now();
+		for (int step = 1; step < numSteps; step++)
+			SlerpWithLibm(count, start, end, 1.0 * step / numSteps, expected);
+		double stop = Now();
+		if (stop - begin < reference)
+			reference = stop - begin;
+	}
+	printf("C library slerp: %8.4f s\n", reference);
+
+	int code = 0;
+	SimdKernel selected = GetSimdKernel();
+	for (int k = SIMD_SCALAR; k <= SIMD_AVX512; k++) {
+		SimdKernel kernel = (SimdKernel) k;
+		if (SetSimdKernel(kernel) != 0)
+			continue;
+		QuaternionArrays output = (kernel == SIMD_SCALAR) ? scalar : result;
+		double best = 1e30;
+		for (int r = 0; r < repetitions; r++) {
+			double begin = Now();
+			for (int step = 1; step < numSteps; step++)
+				SlerpArrays(count, start, end, 1.0 * step / numSteps, output);
+			double stop = Now();
+			if (stop - begin < best)
+				best = stop - begin;
+		}
+
+		double maxDifference = 0;
+		int identical = 1;
+		double * computed[4] = { output.s, output.x, output.y, output.z };
+		double * formula[4] = { expected.s, expected.x, expected.y, expected.z };
+		double * first[4] = { scalar.s, scalar.x, scalar.y, scalar.z };
+		for (int c = 0; c < 4; c++)
+			for (int i = 0; i < count; i++) {
+				if (fabs(computed[c][i] - formula[c][i]) > maxDifference)
+					maxDifference = fabs(computed[c][i] - formula[c][i]);
+				if (computed[c][i] != first[c][i])
+					identical = 0;
+			}
+		if (!identical)
+			code = 1;
+		printf("%-7s kernel:  %8.4f s  (%.1fx)  max difference %.2g  %s\n",
+				GetSimdKernelName(kernel), best, reference / best, maxDifference,
+				identical ? "same as scalar" : "DIFFERS from scalar");
+	}
+	SetSimdKernel(selected);
+
+	delete[] start.s;
+	delete[] end.s;
+	delete[] expected.s;
+	delete[] scalar.s;
+	delete[] result.s;
+	return code;
+}
+
+// Interpolator::Euler2Rotation followed by Matrix2Quaternion
+static void EulerToQuaternionWithMatrices(double angles[3], Quaternion<double> & q) {
+	double Rx[4][4], Ry[4][4], Rz[4][4], Rtemp[4][4], Rresult[4][4], R[9];
+	rotationZ(Rz, angles[2]);
+	rotationY(Ry, angles[1]);
+	rotationX(Rx, angles[0]);
+	matrix_mult(Rz, Ry, Rtemp);
+	matrix_mult(Rtemp, Rx, Rresult);
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			R[i * 3 + j] = Rresult[i][j];
+	q = q.Matrix2Quaternion(R);
+}
+
+// Quaternion2Matrix followed by Interpolator::Rotation2Euler
+static void QuaternionToEulerWithMatrices(Quaternion<double> & q, double angles[3]) {
+	double R[9];
+	q.Quaternion2Matrix(R);
+	double cy = sqrt(R[0] * R[0] + R[3] * R[3]);
+	if (cy > 16 * DBL_EPSILON) {
+		angles[0] = atan2(R[7], R[8]);
+		angles[1] = atan2(-R[6], cy);
+		angles[2] = atan2(R[3], R[0]);
+	} else {
+		angles[0] = atan2(-R[5], R[4]);
+		angles[1] = atan2(-R[6], cy);
+		angles[2] = 0;
+	}
+	for (int i = 0; i < 3; i++)
+		angles[i] *= 180 / M_PI;
+}
+
+static int BenchmarkConvert(int count, int repetitions) {
+	// random XYZ Euler angles in degrees; every tenth one at the gimbal lock
+	double * angles = new double[3 * (size_t) count];
+	srand(1);
+	for (int i = 0; i < 3 * count; i++)
+		angles[i] = 360.0 * rand() / RAND_MAX - 180.0;
+	for (int i = 0; i < count; i += 10)
+		angles[3 * i + 1] = (i % 20 == 0) ? 90.0 : -90.0;
+
+	Quaternion<double> * matrixQuaternions = new Quaternion<double>[count];
+	Quaternion<double> * closedQuaternions = new Quaternion<double>[count];
+	QuaternionArrays arrays = AllocateQuaternionArrays(count);
+	double * matrixAngles = new double[3 * (size_t) count];
+	double * closedAngles = new double[3 * (size_t) count];
+	double * batchAngles = new double[3 * (size_t) count];
+	double * scalarAngles = new double[3 * (size_t) count];
+
+	double best[4] = { 1e30, 1e30, 1e30, 1e30 };
+	for (int r = 0; r < repetitions; r++) {
+		double t0 = Now();
+		for (int i = 0; i < count; i++)
+			EulerToQuaternionWithMatrices(angles + 3 * i, matrixQuaternions[i]);
+		double t1 = Now();
+		for (int i = 0; i < count; i++)
+			EulerToQuaternion(angles + 3 * i, closedQuaternions[i]);
+		double t2 = Now();
+		for (int i = 0; i < count; i++)
+			QuaternionToEulerWithMatrices(matrixQuaternions[i], matrixAngles + 3 * i);
+		double t3 = Now();
+		for (int i = 0; i < count; i++)
+			QuaternionToEuler(matrixQuaternions[i], closedAngles + 3 * i);
+		double t4 = Now();
+		double times[4] = { t1 - t0, t2 - t1, t3 - t2, t4 - t3 };
+		for (int k = 0; k < 4; k++)
+			if (times[k] < best[k])
+				best[k] = times[k];
+	}
+
+	// the closed form gives the same rotation (q and -q are the same rotation)
+	double maxQuaternionDifference = 0;
+	for (int i = 0; i < count; i++) {
+		Quaternion<double> d = matrixQuaternions[i] - closedQuaternions[i];
+		Quaternion<double> e = matrixQuaternions[i] + closedQuaternions[i];
+		double difference = sqrt((d.Norm2() < e.Norm2()) ? d.Norm2() : e.Norm2());
+		if (difference > maxQuaternionDifference)
+			maxQuaternionDifference = difference;
+	}
+	EulerToQuaternionArrays(count, angles, arrays);
+	int batchSame = 1;
+	for (int i = 0; i < count; i++)
+		if ((arrays.s[i] != closedQuaternions[i].Gets()) || (arrays.x[i] != closedQuaternions[i].Getx())
+				|| (arrays.y[i] != closedQuaternions[i].Gety()) || (arrays.z[i] != closedQuaternions[i].Getz()))
+			batchSame = 0;
+	int closedSame = (memcmp(matrixAngles, closedAngles, sizeof(double) * 3 * count) == 0);
+
+	printf("Euler to quaternion, matrices:     %8.4f s\n", best[0]);
+	printf("Euler to quaternion, closed form:  %8.4f s  (%.1fx)  max difference %.2g  batch %s\n",
+			best[1], best[0] / best[1], maxQuaternionDifference, batchSame ? "same" : "DIFFERS");
+	printf("quaternion to Euler, matrices:     %8.4f s\n", best[2]);
+	printf("quaternion to Euler, closed form:  %8.4f s  (%.1fx)  %s\n", best[3], best[2] / best[3],
+			closedSame ? "same angles" : "angles DIFFER");
+
+	// the batch kernels, from the quaternions of the matrix path
+	for (int i = 0; i < count; i++) {
+		arrays.s[i] = matrixQuaternions[i].Gets();
+		arrays.x[i] = matrixQuaternions[i].Getx();
+		arrays.y[i] = matrixQuaternions[i].Gety();
+		arrays.z[i] = matrixQuaternions[i].Getz();
+	}
+	int code = !closedSame || !batchSame || (maxQuaternionDifference > 1e-12);
+	SimdKernel selected = GetSimdKernel();
+	for (int k = SIMD_SCALAR; k <= SIMD_AVX512; k++) {
+		SimdKernel kernel = (SimdKernel) k;
+		if (SetSimdKernel(kernel) != 0)
+			continue;
+		double * output = (kernel == SIMD_SCALAR) ? scalarAngles : batchAngles;
+		double time = 1e30;
+		for (int r = 0; r < repetitions; r++) {
+			double start = Now();
+			QuaternionArraysToEuler(count, arrays, output);
+			double stop = Now();
+			if (stop - start < time)
+				time = stop - start;
+		}
+
+		double maxDifference = 0;
+		for (int i = 0; i < 3 * count; i++)
+			if (fabs(output[i] - matrixAngles[i]) > maxDifference)
+				maxDifference = fabs(output[i] - matrixAngles[i]);
+		int identical = (memcmp(output, scalarAngles, sizeof(double) * 3 * count) == 0);
+		if (!identical || (maxDifference > 1e-9))
+			code = 1;
+		printf("quaternion to Euler, %-7s batch: %8.4f s  (%.1fx)  max difference %.2g degrees  %s\n",
+				GetSimdKernelName(kernel), time, best[2] / time, maxDifference,
+				identical ? "same as scalar" : "DIFFERS from scalar");
+	}
+	SetSimdKernel(selected);
+
+	delete[] angles;
+	delete[] matrixQuaternions;
+	delete[] closedQuaternions;
+	delete[] arrays.s;
+	delete[] matrixAngles;
+	delete[] closedAngles;
+	delete[] batchAngles;
+	delete[] scalarAngles;
+	return code;
+}
+
+// interpolation types and angle representations of the interpolation benchmarks
+struct InterpolationMode {
+	const char * name;
+	InterpolationType interpolationType;
+	AngleRepresentation angleRepresentation;
+};
+static const InterpolationMode modes[] = {
+	{ "linear Euler:", LINEAR, EULER },
+	{ "Bezier Euler:", BEZIER, EULER },
+	{ "Catmull-Rom Euler:", CATMULL_ROM, EULER },
+	{ "linear quaternion:", LINEAR, QUATERNION },
+	{ "Bezier quaternion:", BEZIER, QUATERNION },
+	{ "SQUAD quaternion:", SQUAD, QUATERNION },
+	{ "Catmull-Rom quaternion:", CATMULL_ROM, QUATERNION }
+};
+static const int numModes = sizeof(modes) / sizeof(modes[0]);
+
+static int BenchmarkSample(char * asfFile, char * amcFile, int N, int repetitions) {
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+	Motion motion(amcFile, MOCAP_SCALE, &skeleton);
+	int numFrames = motion.GetNumFrames();
+	int frameSize = motion.GetFrameSize();
+	double * frame = new double[frameSize];
+
+	int code = 0;
+	for (int mode = 0; mode < numModes; mode++) {
+		Interpolator interpolator;
+		interpolator.SetInterpolationType(modes[mode].interpolationType);
+		interpolator.SetAngleRepresentation(modes[mode].angleRepresentation);
+		interpolator.SetIKSolverOnOFF(false);
+		interpolator.SetTimeUniformKeyframe(N, numFrames);
+
+		double interpolate = 1e30, create = 1e30, sample = 1e30;
+		Motion * pOutput = NULL;
+		MotionEvaluator * pEvaluator = NULL;
+		double sum = 0;
+		for (int r = 0; r < repetitions; r++) {
+			delete pOutput;
+			delete pEvaluator;
+			double start = Now();
+			interpolator.Interpolate(&motion, &pOutput, N);
+			double middle = Now();
+			pEvaluator = interpolator.CreateEvaluator(&motion);
+			double stop = Now();
+
+			// as many samples as frames, at fractional times (e.g. a display rate that
+			// is not a multiple of the motion frame rate)
+			double step = (pEvaluator->GetEndTime() - pEvaluator->GetStartTime()) / numFrames;
+			double samplingStart = Now();
+			for (int i = 0; i < numFrames; i++) {
+				pEvaluator->Evaluate(pEvaluator->GetStartTime() + (i + 0.37) * step, frame);
+				sum += frame[0];
+			}
+			double samplingStop = Now();
+
+			if (middle - start < interpolate)
+				interpolate = middle - start;
+			if (stop - middle < create)
+				create = stop - middle;
+			if (samplingStop - samplingStart < sample)
+				sample = samplingStop - samplingStart;
+		}
+
+		// at the frames, the evaluator gives the frames of Interpolate
+		int numDifferent = 0;
+		double maxDifference = 0;
+		for (int f = (int) pEvaluator->GetStartTime(); f <= (int) pEvaluator->GetEndTime(); f++) {
+			pEvaluator->Evaluate(f, frame);
+			if (memcmp(frame, pOutput->GetFrame(f), sizeof(double) * frameSize) != 0)
+				numDifferent++;
+			for (int i = 0; i < frameSize; i++)
+				if (fabs(frame[i] - pOutput->GetFrame(f)[i]) > maxDifference)
+					maxDifference = fabs(frame[i] - pOutput->GetFrame(f)[i]);
+		}
+		if ((numDifferent > 0) || (sum != sum))
+			code = 1;
+
+		printf("%-23s Interpolate %8.4f s  evaluator %8.4f s + %8.4f s for %d samples (%.2f us/sample)  %s\n",
+				modes[mode].name, interpolate, create, sample, numFrames, 1e6 * sample / numFrames,
+				(numDifferent == 0) ? "same frames" : "frames DIFFER");
+		if (numDifferent > 0)
+			printf("  %d frames differ, max difference %.3g\n", numDifferent, maxDifference);
+		delete pOutput;
+		delete pEvaluator;
+	}
+
+	delete[] frame;
+	return code;
+}
+
+static int BenchmarkEdit(char * asfFile, char * amcFile, int N, int numEdits) {
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+	Motion motion(amcFile, MOCAP_SCALE, &skeleton);
+	int frameSize = motion.GetFrameSize();
+	double * frame = new double[frameSize];
+
+	int code = 0;
+	for (int mode = 0; mode < numModes; mode++) {
+		Interpolator interpolator;
+		interpolator.SetInterpolationType(modes[mode].interpolationType);
+		interpolator.SetAngleRepresentation(modes[mode].angleRepresentation);
+		interpolator.SetIKSolverOnOFF(false);
+		interpolator.SetTimeUniformKeyframe(N, motion.GetNumFrames());
+		InterpolationSession session(&interpolator, &motion);
+
+		// move numEdits keyframes, spread over the motion, one Update per edit (as an
+		// editor does while a keyframe is dragged)
+		int numKeyframes = session.GetNumKeyframes();
+		double update = 0;
+		int numSegments = 0;
+		for (int i = 0; i < numEdits; i++) {
+			int keyFrameID = 1 + (int) ((double) i * (numKeyframes - 1) / (numEdits > 1 ? numEdits - 1 : 1));
+			memcpy(frame, motion.GetFrame(session.GetKeyframePos(keyFrameID)), sizeof(double) * frameSize);
+			for (int j = 0; j < frameSize; j++)
+				frame[j] += (j < 3) ? 0.1 : 5.0 * ((i + j) % 3 - 1);
+			double start = Now();
+			session.SetKeyframe(keyFrameID, frame);
+			numSegments += session.Update();
+			update += Now() - start;
+		}
+
+		// the session gives the motion that Interpolate gives for the edited keyframes
+		double start = Now();
+		Motion * pOutput = NULL;
+		interpolator.Interpolate(&motion, &pOutput, N);
+		double interpolate = Now() - start;
+		int differ = CompareMotions(pOutput, session.GetOutputMotion());
+		if (differ)
+			code = 1;
+		delete pOutput;
+
+		printf("%-23s Interpolate %8.4f s  Update %8.5f s per edit (%.1f segments)  %s\n", modes[mode].name,
+				interpolate, update / numEdits, (double) numSegments / numEdits,
+				differ ? "motions DIFFER" : "same motion");
+	}
+
+	delete[] frame;
+	return code;
+}
+
+static int BenchmarkKeyframes(char * asfFile, char * amcFile, double maxAngle, double maxPosition) {
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+	Motion motion(amcFile, MOCAP_SCALE, &skeleton);
+	int numFrames = motion.GetNumFrames();
+
+	const char * errorNames[2] = { "angle   ", "position" };
+	double maxErrors[2] = { maxAngle, maxPosition };
+	int code = 0;
+	for (int mode = 0; mode < numModes; mode++)
+		for (int errorType = 0; errorType < 2; errorType++) {
+			Interpolator interpolator;
+			interpolator.SetInterpolationType(modes[mode].interpolationType);
+			interpolator.SetAngleRepresentation(modes[mode].angleRepresentation);
+			interpolator.SetIKSolverOnOFF(false);
+			KeyframeSelector selector(&interpolator, &motion, (KeyframeError) errorType);
+
+			double start = Now();
+			int numKeyframes = selector.Select(maxErrors[errorType]);
+			double select = Now() - start;
+			if (numKeyframes < 0)
+				return 1;
+			double error = selector.ComputeError();
+			int over = (error > maxErrors[errorType]);
+			if (over)
+				code = 1;
+
+			// uniform keyframes, about as many
+			int N = (numFrames - 1) / (numKeyframes > 1 ? numKeyframes - 1 : 1) - 1;
+			if (N < 0)
+				N = 0;
+			interpolator.SetTimeUniformKeyframe(N, numFrames);
+			double uniformError = selector.ComputeError();
+
+			printf("%-23s %s %8.4f s  %5d keyframes (1 in %5.1f frames)  error %7.4f %s  uniform N=%d error %7.4f\n",
+					modes[mode].name, errorNames[errorType], select, numKeyframes, (double) numFrames / numKeyframes,
+					error, over ? "OVER BUDGET" : "ok", N, uniformError);
+		}
+	return code;
+}
+
+// rotation angle (in degrees) between two unit quaternions
+static double QuaternionAngle(Quaternion<double> p, Quaternion<double> q) {
+	double dot = p.Gets() * q.Gets() + p.Getx() * q.Getx() + p.Gety() * q.Gety() + p.Getz() * q.Getz();
+	if (dot < 0)
+		q = -1. * q;
+	return 360. / M_PI * atan2((p - q).Norm(), (p + q).Norm());
+}
+
+static int BenchmarkSquad(char * asfFile, char * amcFile, int N, int repetitions) {
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+	Motion motion(amcFile, MOCAP_SCALE, &skeleton);
+	int numFrames = motion.GetNumFrames();
+	int numActiveBones = skeleton.getNumActiveBones();
+	const int * activeBones = skeleton.getActiveBones();
+	const PostureLayout * layout = skeleton.getPostureLayout();
+	if (N < 2)
+		N = 2;
+
+	// the rotations of every frame of a motion, converted once
+	Quaternion<double> * input = new Quaternion<double>[(size_t) numFrames * numActiveBones];
+	Quaternion<double> * output = new Quaternion<double>[(size_t) numFrames * numActiveBones];
+	for (int f = 0; f < numFrames; f++)
+		for (int i = 0; i < numActiveBones; i++)
+			EulerToQuaternion(motion.GetFrame(f) + layout->rotationOffset[activeBones[i]],
+					input[(size_t) f * numActiveBones + i]);
+	char * isKeyframe = new char[numFrames];
+
+	const InterpolationMode cubicModes[3] = {
+		{ "Bezier quaternion:", BEZIER, QUATERNION },
+		{ "SQUAD quaternion:", SQUAD, QUATERNION },
+		{ "Catmull-Rom quaternion:", CATMULL_ROM, QUATERNION }
+	};
+	for (int spacing = 0; spacing < 2; spacing++) {
+		printf("%s keyframes:\n", (spacing == 0) ? "uniform" : "non-uniform");
+		for (int mode = 0; mode < 3; mode++) {
+			Interpolator interpolator;
+			interpolator.SetInterpolationType(cubicModes[mode].interpolationType);
+			interpolator.SetAngleRepresentation(cubicModes[mode].angleRepresentation);
+			interpolator.SetIKSolverOnOFF(false);
+			memset(isKeyframe, 0, numFrames);
+			int numKeyframes = 0;
+			for (int f = 0; f < numFrames; f += (spacing == 0) ? N + 1 : ((numKeyframes % 2 == 0) ? N / 2 : 3 * N / 2)) {
+				interpolator.AddNextKeyframePos(f);
+				isKeyframe[f] = 1;
+				numKeyframes++;
+			}
+
+			double interpolate = 1e30;
+			Motion * pOutput = NULL;
+			for (int r = 0; r < repetitions; r++) {
+				delete pOutput;
+				double start = Now();
+				interpolator.Interpolate(&motion, &pOutput, N);
+				if (Now() - start < interpolate)
+					interpolate = Now() - start;
+			}
+			for (int f = 0; f < numFrames; f++)
+				for (int i = 0; i < numActiveBones; i++)
+					EulerToQuaternion(pOutput->GetFrame(f) + layout->rotationOffset[activeBones[i]],
+							output[(size_t) f * numActiveBones + i]);
+			delete pOutput;
+
+			// error of the frames between keyframes, and the change of the rotation from
+			// one frame to the next (the angular velocity) across the keyframes
+			double maxError = 0, sumError = 0, maxJump = 0, sumJump = 0;
+			int numErrors = 0, numJumps = 0;
+			for (int f = 1; f < numFrames - 1; f++)
+				for (int i = 0; i < numActiveBones; i++) {
+					size_t index = (size_t) f * numActiveBones + i;
+					if (!isKeyframe[f]) {
+						double error = QuaternionAngle(output[index], input[index]);
+						sumError += error;
+						numErrors++;
+						if (error > maxError)
+							maxError = error;
+						continue;
+					}
+					Quaternion<double> previous = output[index - numActiveBones];
+					Quaternion<double> current = output[index];
+					Quaternion<double> next = output[index + numActiveBones];
+					double jump = QuaternionAngle(previous.conj() * current, current.conj() * next);
+					sumJump += jump;
+					numJumps++;
+					if (jump > maxJump)
+						maxJump = jump;
+				}
+
+			printf("  %-23s Interpolate %8.4f s (%.2f us/frame)  error max %7.3f mean %6.3f  velocity jump max %7.3f mean %6.3f\n",
+					cubicModes[mode].name, interpolate, 1e6 * interpolate / numFrames, maxError,
+					sumError / (numErrors > 0 ? numErrors : 1), maxJump, sumJump / (numJumps > 0 ? numJumps : 1));
+		}
+	}
+
+	delete[] input;
+	delete[] output;
+	delete[] isKeyframe;
+	return 0;
+}
+
+// Skeleton::ProcessBone and Traverse as they were before the flattened hierarchy
+static void ProcessBoneWithMatrices(Bone * ptr, double transToWorld[4][4], double TransferMatForChild[4][4],
+		vector * tips) {
+	double temp[4][4];
+	matrix_transpose(ptr->rot_parent_current, temp);
+	matrix_mult(transToWorld, temp, TransferMatForChild);
+	if (ptr->doftz) {
+		translate(temp, 0, 0, double(ptr->tz));
+		matrix_multS(TransferMatForChild, temp);
+	}
+	if (ptr->dofty) {
+		translate(temp, 0, double(ptr->ty), 0);
+		matrix_multS(TransferMatForChild, temp);
+	}
+	if (ptr->doftx) {
+		translate(temp, double(ptr->tx), 0, 0);
+		matrix_multS(TransferMatForChild, temp);
+	}
+	if (ptr->dofrz) {
+		rotationZ(temp, double(ptr->rz));
+		matrix_multS(TransferMatForChild, temp);
+	}
+	if (ptr->dofry) {
+		rotationY(temp, double(ptr->ry));
+		matrix_multS(TransferMatForChild, temp);
+	}
+	if (ptr->dofrx) {
+		rotationX(temp, double(ptr->rx));
+		matrix_multS(TransferMatForChild, temp);
+	}
+	translate(temp, ptr->dir[0] * ptr->length, ptr->dir[1] * ptr->length, ptr->dir[2] * ptr->length);
+	matrix_multS(TransferMatForChild, temp);
+
+	double tip[3];
+	matrix_transform_affine(TransferMatForChild, 0, 0, 0, tip);
+	tips[ptr->idx] = vector(tip[0], tip[1], tip[2]);
+}
+
+static void TraverseWithMatrices(Bone * ptr, double transToWorld[4][4], vector * tips) {
+	if (ptr != 0) {
+		double transToWorldForChild[4][4];
+		ProcessBoneWithMatrices(ptr, transToWorld, transToWorldForChild, tips);
+		TraverseWithMatrices(ptr->child, transToWorldForChild, tips);
+		TraverseWithMatrices(ptr->sibling, transToWorld, tips);
+	}
+}
+
+static int BenchmarkFK(char * asfFile, char * amcFile, int repetitions) {
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+	Motion motion(amcFile, MOCAP_SCALE, &skeleton);
+	int numFrames = motion.GetNumFrames();
+	int numBones = skeleton.NUM_BONES_IN_ASF_FILE;
+	vector * reference = new vector[(size_t) numFrames * numBones];
+	vector * current = new vector[(size_t) numFrames * numBones];
+	double identity[4][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } };
+
+	double matrices = 1e30, flattened = 1e30, pose = 1e30;
+	for (int r = 0; r < repetitions; r++) {
+		double start = Now();
+		for (int f = 0; f < numFrames; f++)
+			skeleton.setPosture(motion.GetFrame(f));
+		double t0 = Now();
+		for (int f = 0; f < numFrames; f++) {
+			skeleton.setPosture(motion.GetFrame(f));
+			TraverseWithMatrices(skeleton.getRoot(), identity, reference + (size_t) f * numBones);
+		}
+		double t1 = Now();
+		for (int f = 0; f < numFrames; f++) {
+			skeleton.setPosture(motion.GetFrame(f));
+			skeleton.computeBoneTipPos();
+			for (int bone = 0; bone < numBones; bone++)
+				current[(size_t) f * numBones + bone] = skeleton.getBoneTipPosition(bone);
+		}
+		double t2 = Now();
+		if (t0 - start < pose)
+			pose = t0 - start;
+		if (t1 - t0 < matrices)
+			matrices = t1 - t0;
+		if (t2 - t1 < flattened)
+			flattened = t2 - t1;
+	}
+
+	// compared with ==, so that 0 and -0 are the same
+	int numDifferent = 0;
+	for (size_t i = 0; i < (size_t) numFrames * numBones; i++)
+		for (int k = 0; k < 3; k++)
+			if (reference[i][k] != current[i][k]) {
+				numDifferent++;
+				break;
+			}
+
+	// setPosture is part of both loops
+	matrices -= pose;
+	flattened -= pose;
+	printf("setPosture:                  %8.4f s  (%.3f us/frame)\n", pose, 1e6 * pose / numFrames);
+	printf("recursive, 4x4 matrices:     %8.4f s  (%.3f us/frame)\n", matrices, 1e6 * matrices / numFrames);
+	printf("computeBoneTipPos:           %8.4f s  (%.3f us/frame)  (%.1fx)  %s\n", flattened,
+			1e6 * flattened / numFrames, matrices / flattened, (numDifferent == 0) ? "same tips" : "tips DIFFER");
+	if (numDifferent > 0)
+		printf("  %d bone tips differ\n", numDifferent);
+
+	delete[] reference;
+	delete[] current;
+	return numDifferent > 0;
+}
+
+static int BenchmarkTracks(char * asfFile, char * amcFile, int repetitions) {
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+	Motion motion(amcFile, MOCAP_SCALE, &skeleton);
+	int numFrames = motion.GetNumFrames();
+	int numBones = skeleton.NUM_BONES_IN_ASF_FILE;
+	size_t numValues = (size_t) 7 * numBones * numFrames;
+
+	// frame by frame: positions and the rotation part of the bone transforms
+	double * expected = new double[numValues];
+	double perFrame = 1e30;
+	for (int r = 0; r < repetitions; r++) {
+		double start = Now();
+		for (int f = 0; f < numFrames; f++) {
+			skeleton.setPosture(motion.GetFrame(f));
+			skeleton.computeBoneTipPos();
+			for (int bone = 0; bone < numBones; bone++)
+				for (int c = 0; c < 3; c++)
+					expected[(size_t) (7 * bone + c) * numFrames + f] = skeleton.getBoneTipPosition(bone)[c];
+		}
+		double stop = Now();
+		if (stop - start < perFrame)
+			perFrame = stop - start;
+	}
+	double (*rotations)[9] = new double[(size_t) numFrames * numBones][9];
+	for (int f = 0; f < numFrames; f++) {
+		skeleton.setPosture(motion.GetFrame(f));
+		skeleton.computeBoneTipPos();
+		for (int position = 0; position < skeleton.m_NumFKBones; position++)
+			for (int row = 0; row < 3; row++)
+				for (int col = 0; col < 3; col++)
+					rotations[(size_t) f * numBones + skeleton.m_FKOrder[position]][3 * row + col] =
+							skeleton.m_FKTransform[position][row][col];
+	}
+	printf("setPosture + computeBoneTipPos:  %8.4f s  (%.3f us/frame)\n", perFrame, 1e6 * perFrame / numFrames);
+
+	BoneTracks tracks(&skeleton);
+	double * reference = new double[numValues];
+	int code = 0;
+	SimdKernel selected = GetSimdKernel();
+	int maxThreads = GetNumThreads();
+	for (int k = SIMD_SCALAR; k <= SIMD_AVX512; k++) {
+		SimdKernel kernel = (SimdKernel) k;
+		if (SetSimdKernel(kernel) != 0)
+			continue;
+		double singleThreaded = 0;
+		for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+			double best = 1e30;
+			for (int r = 0; r < repetitions; r++) {
+				double start = Now();
+				tracks.Compute(&motion, 0, numFrames, numThreads);
+				double stop = Now();
+				if (stop - start < best)
+					best = stop - start;
+			}
+			if (numThreads == 1)
+				singleThreaded = best;
+
+			// positions against computeBoneTipPos, orientations against its rotations
+			double maxPosition = 0, maxRotation = 0;
+			for (int bone = 0; bone < numBones; bone++)
+				for (int f = 0; f < numFrames; f++) {
+					vector position = tracks.GetPosition(bone, f);
+					for (int c = 0; c < 3; c++) {
+						double difference = fabs(position[c] - expected[(size_t) (7 * bone + c) * numFrames + f]);
+						if (difference > maxPosition)
+							maxPosition = difference;
+					}
+					double R[9];
+					tracks.GetOrientation(bone, f).Quaternion2Matrix(R);
+					for (int c = 0; c < 9; c++)
+						if (fabs(R[c] - rotations[(size_t) f * numBones + bone][c]) > maxRotation)
+							maxRotation = fabs(R[c] - rotations[(size_t) f * numBones + bone][c]);
+				}
+
+			int identical = 1;
+			for (int bone = 0; bone < numBones; bone++)
+				for (int c = 0; c < 7; c++) {
+					const double * track = (c < 3) ? tracks.GetPositions(bone, c) : NULL;
+					if (c >= 3) {
+						QuaternionArrays orientations = tracks.GetOrientations(bone);
+						const double * components[4] = { orientations.s, orientations.x, orientations.y, orientations.z };
+						track = components[c - 3];
+					}
+					double * saved = reference + (size_t) (7 * bone + c) * numFrames;
+					if ((kernel == SIMD_SCALAR) && (numThreads == 1))
+						memcpy(saved, track, sizeof(double) * numFrames);
+					else if (memcmp(saved, track, sizeof(double) * numFrames) != 0)
+						identical = 0;
+				}
+			if (!identical || (maxPosition > 1e-9) || (maxRotation > 1e-12))
+				code = 1;
+			printf("BoneTracks, %-7s %2d threads: %8.4f s  (%.3f us/frame)  (%.1fx, %.1fx)  max difference %.2g position %.2g rotation  %s\n",
+					GetSimdKernelName(kernel), numThreads, best, 1e6 * best / numFrames, perFrame / best,
+					singleThreaded / best, maxPosition, maxRotation, identical ? "same as scalar" : "DIFFERS from scalar");
+		}
+	}
+	SetSimdKernel(selected);
+
+	delete[] expected;
+	delete[] rotations;
+	delete[] reference;
+	return code;
+}
+
+static int BenchmarkChain(char * asfFile, char * amcFile, int repetitions) {
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+	Motion motion(amcFile, MOCAP_SCALE, &skeleton);
+	skeleton.enableAllRotationalDOFs();
+	int numFrames = motion.GetNumFrames();
+	int frameSize = motion.GetFrameSize();
+	const PostureLayout * layout = skeleton.getPostureLayout();
+	double * posture = new double[frameSize];
+	SkeletonPose pose(&skeleton);
+
+	// the chains of Interpolator::SolveIK: start bone, end bone
+	const int chains[4][2] = { { 18, 22 }, { 2, 5 }, { 7, 10 }, { 25, 29 } };
+	int code = 0;
+	for (int c = 0; c < 4; c++) {
+		int startBone = chains[c][0], endBone = chains[c][1];
+		if ((endBone >= skeleton.NUM_BONES_IN_ASF_FILE) || (pose.SetChain(startBone, endBone, motion.GetFrame(0)) != 0))
+			continue;
+
+		// the rotations of the chain, from the end bone up
+		int dofOffset[3 * MAX_BONES_IN_ASF_FILE];
+		int numDofs = 0, numChainBones = 0;
+		for (int position = skeleton.m_FKPosition[endBone]; position >= 0; position = skeleton.m_FKParent[position]) {
+			int offset = layout->rotationOffset[skeleton.m_FKOrder[position]];
+			for (int k = 0; (offset >= 0) && (k < 3); k++)
+				dofOffset[numDofs++] = offset + k;
+			numChainBones++;
+			if (skeleton.m_FKOrder[position] == startBone)
+				break;
+		}
+		int numTips = numFrames * (numDofs + 1);
+		vector * reference = new vector[numTips];
+		vector * current = new vector[numTips];
+
+		double whole = 1e30, chain = 1e30;
+		for (int r = 0; r < repetitions; r++) {
+			double start = Now();
+			for (int f = 0; f < numFrames; f++) {
+				memcpy(posture, motion.GetFrame(f), sizeof(double) * frameSize);
+				for (int i = 0; i <= numDofs; i++) {
+					if (i > 0)
+						posture[dofOffset[i - 1]] += 0.01;
+					skeleton.setPosture(posture);
+					skeleton.computeBoneTipPos();
+					reference[f * (numDofs + 1) + i] = skeleton.getBoneTipPosition(endBone);
+					if (i > 0)
+						posture[dofOffset[i - 1]] = motion.GetFrame(f)[dofOffset[i - 1]];
+				}
+			}
+			double t0 = Now();
+			for (int f = 0; f < numFrames; f++) {
+				memcpy(posture, motion.GetFrame(f), sizeof(double) * frameSize);
+				pose.SetChain(startBone, endBone, posture);
+				for (int i = 0; i <= numDofs; i++) {
+					if (i > 0)
+						posture[dofOffset[i - 1]] += 0.01;
+					current[f * (numDofs + 1) + i] = pose.ComputeChainTipPos(posture);
+					if (i > 0)
+						posture[dofOffset[i - 1]] = motion.GetFrame(f)[dofOffset[i - 1]];
+				}
+			}
+			double t1 = Now();
+			if (t0 - start < whole)
+				whole = t0 - start;
+			if (t1 - t0 < chain)
+				chain = t1 - t0;
+		}
+
+		// compared with ==, so that 0 and -0 are the same
+		int numDifferent = 0;
+		for (int i = 0; i < numTips; i++)
+			if ((reference[i][0] != current[i][0]) || (reference[i][1] != current[i][1]) || (reference[i][2] != current[i][2]))
+				numDifferent++;
+		if (numDifferent > 0)
+			code = 1;
+
+		printf("%s -> %s (%d bones, %d rotations):\n", skeleton.idx2name(startBone), skeleton.idx2name(endBone),
+				numChainBones, numDofs);
+		printf("  setPosture + computeBoneTipPos:  %8.4f s  (%.3f us/tip)\n", whole, 1e6 * whole / numTips);
+		printf("  ComputeChainTipPos:              %8.4f s  (%.3f us/tip)  (%.1fx)  %s\n", chain,
+				1e6 * chain / numTips, whole / chain, (numDifferent == 0) ? "same tips" : "tips DIFFER");
+		if (numDifferent > 0)
+			printf("  %d tips differ\n", numDifferent);
+
+		delete[] reference;
+		delete[] current;
+	}
+
+	delete[] posture;
+	return code;
+}
+
+static int BenchmarkIK(char * asfFile, char * amcFile, int N, int repetitions) {
+	// IKSolver reads the DOFs of the skeleton as read, and poses the one with all
+	// rotational DOFs (as interpolate does)
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+	Motion motion(amcFile, MOCAP_SCALE, &skeleton);
+	skeleton.enableAllRotationalDOFs();
+	pSkeleton_NoDof = new Skeleton(asfFile, MOCAP_SCALE);
+
+	Interpolator interpolator;
+	interpolator.SetInterpolationType(BEZIER);
+	interpolator.SetAngleRepresentation(QUATERNION);
+	interpolator.SetIKSolverOnOFF(true);
+	interpolator.SetTimeUniformKeyframe(N, motion.GetNumFrames());
+
+	int code = 0;
+	Motion * pReference = NULL;
+	double singleThreaded = 0;
+	int maxThreads = GetNumThreads();
+	if (maxThreads < 8)
+		maxThreads = 8;
+	for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+		SetNumThreads(numThreads);
+		double best = 1e30;
+		Motion * pOutput = NULL;
+		for (int r = 0; r < repetitions; r++) {
+			delete pOutput;
+			double start = Now();
+			interpolator.Interpolate(&motion, &pOutput, N);
+			double stop = Now();
+			if (stop - start < best)
+				best = stop - start;
+		}
+
+		int differ = 0;
+		if (pReference == NULL) {
+			pReference = pOutput;
+			singleThreaded = best;
+		}
+		else {
+			differ = CompareMotions(pReference, pOutput);
+			delete pOutput;
+		}
+		if (differ)
+			code = 1;
+		printf("Interpolate with IK, %2d threads: %8.4f s  (%.1fx)  %s\n", numThreads, best,
+				singleThreaded / best, differ ? "motion DIFFERS" : "same motion");
+	}
+	SetNumThreads(0);
+
+	delete pReference;
+	delete pSkeleton_NoDof;
+	pSkeleton_NoDof = NULL;
+	return code;
+}
+
+// largest and mean distance of the hands and feet of the frames of pOutput from where
+// they are in pInput (the targets of Interpolator::SolveIK)
+static void EffectorError(Motion * pInput, Motion * pOutput, SkeletonPose * pose, double & maxError,
+		double & meanError) {
+	const int effectors[4] = { 22, 5, 10, 29 };
+	maxError = meanError = 0;
+	for (int f = 0; f < pInput->GetNumFrames(); f++) {
+		vector targets[4];
+		pose->ComputeBoneTipPos(pInput->GetFrame(f));
+		for (int i = 0; i < 4; i++)
+			targets[i] = pose->GetBoneTipPosition(effectors[i]);
+		pose->ComputeBoneTipPos(pOutput->GetFrame(f));
+		for (int i = 0; i < 4; i++) {
+			double error = (pose->GetBoneTipPosition(effectors[i]) - targets[i]).length();
+			if (error > maxError)
+				maxError = error;
+			meanError += error;
+		}
+	}
+	meanError /= 4.0 * pInput->GetNumFrames();
+}
+
+static int BenchmarkJacobian(char * asfFile, char * amcFile, int N, int repetitions) {
+	Skeleton skeleton(asfFile, MOCAP_SCALE);
+	Motion motion(amcFile, MOCAP_SCALE, &skeleton);
+	skeleton.enableAllRotationalDOFs();
+	pSkeleton_NoDof = new Skeleton(asfFile, MOCAP_SCALE);
+	int numFrames = motion.GetNumFrames();
+	int frameSize = motion.GetFrameSize();
+	const PostureLayout * layout = skeleton.getPostureLayout();
+	double * posture = new double[frameSize];
+	SkeletonPose pose(&skeleton);
+	const double delta = 0.01;
+
+	// the chains of Interpolator::SolveIK: start bone, end bone
+	const int chains[4][2] = { { 18, 22 }, { 2, 5 }, { 7, 10 }, { 25, 29 } };
+	int code = 0;
+	for (int c = 0; c < 4; c++) {
+		int startBone = chains[c][0], endBone = chains[c][1];
+		if ((endBone >= skeleton.NUM_BONES_IN_ASF_FILE) || (pose.SetChain(startBone, endBone, motion.GetFrame(0)) != 0))
+			continue;
+
+		// the rotations of the chain, from the end bone up
+		int dofOffset[3 * MAX_BONES_IN_ASF_FILE], dofBones[3 * MAX_BONES_IN_ASF_FILE], dofAxes[3 * MAX_BONES_IN_ASF_FILE];
+		int numDofs = 0;
+		for (int position = skeleton.m_FKPosition[endBone]; position >= 0; position = skeleton.m_FKParent[position]) {
+			int bone = skeleton.m_FKOrder[position];
+			for (int k = 0; (layout->rotationOffset[bone] >= 0) && (k < 3); k++) {
+				dofOffset[numDofs] = layout->rotationOffset[bone] + k;
+				dofBones[numDofs] = bone;
+				dofAxes[numDofs] = k;
+				numDofs++;
+			}
+			if (bone == startBone)
+				break;
+		}
+		size_t size = (size_t) 3 * numDofs;
+		double * differences = new double[numFrames * size];
+		double * analytic = new double[numFrames * size];
+
+		double finite = 1e30, closed = 1e30;
+		for (int r = 0; r < repetitions; r++) {
+			double start = Now();
+			for (int f = 0; f < numFrames; f++) {
+				memcpy(posture, motion.GetFrame(f), sizeof(double) * frameSize);
+				pose.SetChain(startBone, endBone, posture);
+				vector tip = pose.ComputeChainTipPos(posture);
+				double * J = differences + f * size;
+				for (int i = 0; i < numDofs; i++) {
+					posture[dofOffset[i]] += delta;
+					vector difference = pose.ComputeChainTipPos(posture) - tip;
+					posture[dofOffset[i]] = motion.GetFrame(f)[dofOffset[i]];
+					for (int row = 0; row < 3; row++)
+						J[row * numDofs + i] = difference.p[row] / delta;
+				}
+			}
+			double t0 = Now();
+			for (int f = 0; f < numFrames; f++) {
+				pose.SetChain(startBone, endBone, motion.GetFrame(f));
+				pose.ComputeChainJacobian(motion.GetFrame(f), numDofs, dofBones, dofAxes, analytic + f * size);
+			}
+			double t1 = Now();
+			if (t0 - start < finite)
+				finite = t0 - start;
+			if (t1 - t0 < closed)
+				closed = t1 - t0;
+		}
+
+		// the forward differences are off by O(delta), central differences by O(delta^2)
+		// (relative to the largest entry of J)
+		double maxDifference = 0, maxCentral = 0, maxEntry = 0;
+		for (int f = 0; f < numFrames; f++) {
+			memcpy(posture, motion.GetFrame(f), sizeof(double) * frameSize);
+			pose.SetChain(startBone, endBone, posture);
+			for (int i = 0; i < numDofs; i++) {
+				posture[dofOffset[i]] += delta;
+				vector after = pose.ComputeChainTipPos(posture);
+				posture[dofOffset[i]] = motion.GetFrame(f)[dofOffset[i]] - delta;
+				vector before = pose.ComputeChainTipPos(posture);
+				posture[dofOffset[i]] = motion.GetFrame(f)[dofOffset[i]];
+				for (int row = 0; row < 3; row++) {
+					size_t index = f * size + row * numDofs + i;
+					double central = (after.p[row] - before.p[row]) / (2 * delta);
+					if (fabs(analytic[index] - central) > maxCentral)
+						maxCentral = fabs(analytic[index] - central);
+					if (fabs(analytic[index] - differences[index]) > maxDifference)
+						maxDifference = fabs(analytic[index] - differences[index]);
+					if (fabs(analytic[index]) > maxEntry)
+						maxEntry = fabs(analytic[index]);
+				}
+			}
+		}
+		if (!(maxDifference <= 1e-3 * maxEntry) || !(maxCentral <= 1e-6 * maxEntry))
+			code = 1;
+
+		printf("%s -> %s (%d rotations):\n", skeleton.idx2name(startBone), skeleton.idx2name(endBone), numDofs);
+		printf("  finite differences:    %8.4f s  (%.3f us/Jacobian)\n", finite, 1e6 * finite / numFrames);
+		printf("  ComputeChainJacobian:  %8.4f s  (%.3f us/Jacobian)  (%.1fx)\n", closed, 1e6 * closed / numFrames,
+				finite / closed);
+		printf("  max difference (relative): %.2g from finite, %.2g from central differences\n",
+				maxDifference / maxEntry, maxCentral / maxEntry);
+
+		delete[] differences;
+		delete[] analytic;
+	}
+
+	// the IK solver with both Jacobians
+	const IKJacobian jacobians[2] = { FINITE_DIFFERENCE_JACOBIAN, ANALYTIC_JACOBIAN };
+	const char * names[2] = { "finite differences", "analytic" };
+	double times[2];
+	for (int j = 0; j < 2; j++) {
+		Interpolator interpolator;
+		interpolator.SetInterpolationType(BEZIER);
+		interpolator.SetAngleRepresentation(QUATERNION);
+		interpolator.SetIKSolverOnOFF(true);
+		interpolator.SetIKJacobian(jacobians[j]);
+		interpolator.SetTimeUniformKeyframe(N, numFrames);
+		times[j] = 1e30;
+		Motion * pOutput = NULL;
+		for (int r = 0; r < repetitions; r++) {
+			delete pOutput;
+			double start = Now();
+			interpolator.Interpolate(&motion, &pOutput, N);
+			double stop = Now();
+			if (stop - start < times[j])
+				times[j] = stop - start;
+		}
+		double maxError, meanError;
+		EffectorError(&motion, pOutput, &pose, maxError, meanError);
+		printf("Interpolate with IK, %-18s %8.4f s  (%.1fx)  hands and feet off by %.4f max, %.4f mean\n",
+				names[j], times[j], times[0] / times[j], maxError, meanError);
+		delete pOutput;
+	}
+
+	delete[] posture;
+	delete pSkeleton_NoDof;
+	pSkeleton_NoDof = NULL;
+	return code;
+}
+
+int main(int argc, char **argv)
+{
+	if ((argc >= 4) && (strcmp(argv[1], "parse") == 0))
+		return BenchmarkParse(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 3);
+	if ((argc >= 5) && (strcmp(argv[1], "write") == 0))
+		return BenchmarkWrite(argv[2], argv[3], argv[4], (argc > 5) ? atoi(argv[5]) : 3);
+	if ((argc >= 5) && (strcmp(argv[1], "binary") == 0))
+		return BenchmarkBinary(argv[2], argv[3], argv[4], (argc > 5) ? atoi(argv[5]) : 3);
+	if ((argc >= 4) && (strcmp(argv[1], "sample") == 0))
+		return BenchmarkSample(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 20, (argc > 5) ? atoi(argv[5]) : 3);
+	if ((argc >= 4) && (strcmp(argv[1], "edit") == 0))
+		return BenchmarkEdit(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 20, (argc > 5) ? atoi(argv[5]) : 10);
+	if ((argc >= 4) && (strcmp(argv[1], "keyframes") == 0))
+		return BenchmarkKeyframes(argv[2], argv[3], (argc > 4) ? atof(argv[4]) : 2.0, (argc > 5) ? atof(argv[5]) : 0.5);
+	if ((argc >= 4) && (strcmp(argv[1], "squad") == 0))
+		return BenchmarkSquad(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 20, (argc > 5) ? atoi(argv[5]) : 5);
+	if ((argc >= 4) && (strcmp(argv[1], "fk") == 0))
+		return BenchmarkFK(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 3);
+	if ((argc >= 4) && (strcmp(argv[1], "tracks") == 0))
+		return BenchmarkTracks(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 3);
+	if ((argc >= 4) && (strcmp(argv[1], "chain") == 0))
+		return BenchmarkChain(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 3);
+	if ((argc >= 4) && (strcmp(argv[1], "ik") == 0))
+		return BenchmarkIK(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 20, (argc > 5) ? atoi(argv[5]) : 3);
+	if ((argc >= 4) && (strcmp(argv[1], "jacobian") == 0))
+		return BenchmarkJacobian(argv[2], argv[3], (argc > 4) ? atoi(argv[4]) : 20, (argc > 5) ? atoi(argv[5]) : 3);
+	if ((argc >= 2) && (strcmp(argv[1], "convert") == 0))
+		return BenchmarkConvert((argc > 2) ? atoi(argv[2]) : 100000, (argc > 3) ? atoi(argv[3]) : 3);
+	if ((argc >= 2) && (strcmp(argv[1], "slerp") == 0))
+		return BenchmarkSlerp((argc > 2) ? atoi(argv[2]) : 100000, (argc > 3) ? atoi(argv[3]) : 3);
+
+	printf("Usage: %s parse <skeleton.asf> <motion.amc> [repetitions]\n", argv[0]);
+	printf("       %s write <skeleton.asf> <motion.amc> <scratch.amc> [repetitions]\n", argv[0]);
+	printf("       %s binary <skeleton.asf> <motion.amc> <scratch.amcb> [repetitions]\n", argv[0]);
+	printf("       %s slerp [quaternions] [repetitions]\n", argv[0]);
+	printf("       %s convert [rotations] [repetitions]\n", argv[0]);
+	printf("       %s sample <skeleton.asf> <motion.amc> [N] [repetitions]\n", argv[0]);
+	printf("       %s edit <skeleton.asf> <motion.amc> [N] [edits]\n", argv[0]);
+	printf("       %s keyframes <skeleton.asf> <motion.amc> [max angle] [max position]\n", argv[0]);
+	printf("       %s squad <skeleton.asf> <motion.amc> [N] [repetitions]\n", argv[0]);
+	printf("       %s fk <skeleton.asf> <motion.amc> [repetitions]\n", argv[0]);
+	printf("       %s tracks <skeleton.asf> <motion.amc> [repetitions]\n", argv[0]);
+	printf("       %s chain <skeleton.asf> <motion.amc> [repetitions]\n", argv[0]);
+	printf("       %s ik <skeleton.asf> <motion.amc> [N] [repetitions]\n", argv[0]);
+	printf("       %s jacobian <skeleton.asf> <motion.amc> [N] [repetitions]\n", argv[0]);
+	return -1;
+}
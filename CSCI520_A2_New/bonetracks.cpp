@@ -0,0 +1,146 @@
+/*
+ bonetracks.cpp
+
+ See bonetracks.h.
+
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "bonetracks.h"
+#include "parallel.h"
+#include "types.h"
+
+// the kernels must round every multiplication and addition (see bonetrackskernel.h)
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#define KERNEL_BODY "bonetrackskernel.h"
+#include "simdkernels.h"
+
+// frames per task of Compute
+#define TRACKS_BLOCK_SIZE 256
+
+BoneTracks::BoneTracks(const Skeleton * pSkeleton)
+{
+	m_pSkeleton = pSkeleton;
+	m_NumBones = pSkeleton->NUM_BONES_IN_ASF_FILE;
+	m_StartFrame = 0;
+	m_NumFrames = 0;
+	m_pTracks = NULL;
+	m_NumAllocatedFrames = 0;
+}
+
+BoneTracks::~BoneTracks()
+{
+	delete[] m_pTracks;
+}
+
+struct BoneTracks::TracksJob {
+	const Skeleton * skeleton;
+	Motion * pMotion;
+	int startFrame;
+	int numFrames;
+	int numTrackFrames;
+	double * tracks;
+};
+
+void BoneTracks::ComputeBlock(int index, void * data)
+{
+	TracksJob * job = (TracksJob *) data;
+	const Skeleton * skeleton = job->skeleton;
+	int numBones = skeleton->NUM_BONES_IN_ASF_FILE;
+	int first = index * TRACKS_BLOCK_SIZE;
+	int count = (job->numFrames - first < TRACKS_BLOCK_SIZE) ? job->numFrames - first : TRACKS_BLOCK_SIZE;
+	const double * frames = job->pMotion->GetFrame(job->startFrame + first);
+	int frameSize = job->pMotion->GetFrameSize();
+
+	// the tracks of the block are computed into a buffer that stays in the cache, and
+	// then copied to the tracks; scratch holds the transforms of the bones of the frames
+	// in the lanes (up to 8)
+	double * block = new double[(size_t) 7 * TRACKS_BLOCK_SIZE * numBones + 12 * 8 * skeleton->m_NumFKBones];
+	double * scratch = block + (size_t) 7 * TRACKS_BLOCK_SIZE * numBones;
+	switch (GetSimdKernel()) {
+#ifdef HAVE_SIMD_AVX
+	case SIMD_AVX512:
+		ComputeTracksAVX512(skeleton, frames, frameSize, count, TRACKS_BLOCK_SIZE, block, scratch);
+		break;
+	case SIMD_AVX2:
+		ComputeTracksAVX2(skeleton, frames, frameSize, count, TRACKS_BLOCK_SIZE, block, scratch);
+		break;
+#endif
+#ifdef HAVE_SIMD_SSE2
+	case SIMD_SSE2:
+		ComputeTracksSSE2(skeleton, frames, frameSize, count, TRACKS_BLOCK_SIZE, block, scratch);
+		break;
+#endif
+	default:
+		ComputeTracksScalar(skeleton, frames, frameSize, count, TRACKS_BLOCK_SIZE, block, scratch);
+		break;
+	}
+
+	for (int position = 0; position < skeleton->m_NumFKBones; position++) {
+		int bone = skeleton->m_FKOrder[position];
+		for (int c = 0; c < 7; c++)
+			memcpy(job->tracks + (size_t) job->numTrackFrames * (7 * bone + c) + first,
+					block + (size_t) TRACKS_BLOCK_SIZE * (7 * bone + c), sizeof(double) * count);
+	}
+	delete[] block;
+}
+
+int BoneTracks::Compute(Motion * pMotion, int startFrame, int numFrames, int numThreads)
+{
+	if ((startFrame < 0) || (numFrames < 0) || (startFrame + numFrames > pMotion->GetNumFrames())) {
+		printf("Error: frames %d to %d are not in the motion (%d frames).\n", startFrame,
+				startFrame + numFrames - 1, pMotion->GetNumFrames());
+		return -1;
+	}
+
+	if (numFrames > m_NumAllocatedFrames) {
+		delete[] m_pTracks;
+		m_NumAllocatedFrames = numFrames;
+		m_pTracks = new double[(size_t) 7 * m_NumBones * m_NumAllocatedFrames];
+		// (bones that are not in the hierarchy keep these)
+		memset(m_pTracks, 0, sizeof(double) * 7 * m_NumBones * m_NumAllocatedFrames);
+	}
+	m_StartFrame = startFrame;
+	m_NumFrames = numFrames;
+
+	TracksJob job;
+	job.skeleton = m_pSkeleton;
+	job.pMotion = pMotion;
+	job.startFrame = startFrame;
+	job.numFrames = numFrames;
+	job.numTrackFrames = m_NumAllocatedFrames;
+	job.tracks = m_pTracks;
+	ParallelFor((numFrames + TRACKS_BLOCK_SIZE - 1) / TRACKS_BLOCK_SIZE, ComputeBlock, &job, numThreads);
+	return 0;
+}
+
+QuaternionArrays BoneTracks::GetOrientations(int bone) const
+{
+	double * track = m_pTracks + (size_t) m_NumAllocatedFrames * 7 * bone;
+	QuaternionArrays orientations;
+	orientations.s = track + (size_t) 3 * m_NumAllocatedFrames;
+	orientations.x = track + (size_t) 4 * m_NumAllocatedFrames;
+	orientations.y = track + (size_t) 5 * m_NumAllocatedFrames;
+	orientations.z = track + (size_t) 6 * m_NumAllocatedFrames;
+	return orientations;
+}
+
+vector BoneTracks::GetPosition(int bone, int frame) const
+{
+	int i = frame - m_StartFrame;
+	return vector(GetPositions(bone, 0)[i], GetPositions(bone, 1)[i], GetPositions(bone, 2)[i]);
+}
+
+Quaternion<double> BoneTracks::GetOrientation(int bone, int frame) const
+{
+	int i = frame - m_StartFrame;
+	QuaternionArrays orientations = GetOrientations(bone);
+	return Quaternion<double>(orientations.s[i], orientations.x[i], orientations.y[i], orientations.z[i]);
+}
@@ -0,0 +1,71 @@
+/*
+ bonetracks.h
+
+ Global tip position and orientation of every bone at every frame of a range of a
+ motion: the bone tips of Skeleton::computeBoneTipPos, and the rotation from the bone
+ coordinate system to the world, for analyses that need whole joint trajectories
+ (errors, foot contacts, export) rather than one posed skeleton at a time.
+
+ The tracks are stored as structure of arrays: one array over the frames for each
+ bone and coordinate. The frames are posed in the lanes of the SIMD registers, with
+ the kernel selected for SlerpArrays (see quaternionarrays.h), in blocks of frames
+ on several threads (see parallel.h). sin and cos are evaluated with polynomials, so
+ the positions agree with computeBoneTipPos to within a few units in the last place;
+ all kernels and thread counts give identical tracks.
+
+ The skeleton is only read, so several BoneTracks may be computed at once. Frame
+ ranges can be computed one after another into the same BoneTracks, for motions too
+ long to keep all of their tracks in memory.
+
+ */
+
+#ifndef _BONETRACKS_H
+#define _BONETRACKS_H
+
+#include "motion.h"
+#include "vector.h"
+#include "quaternionarrays.h"
+
+class BoneTracks {
+public:
+	BoneTracks(const Skeleton * pSkeleton);
+	~BoneTracks();
+
+	// Compute the tracks of numFrames frames of pMotion (a motion of the skeleton) from
+	// startFrame on, on up to numThreads threads (0: GetNumThreads()). Returns 0, or -1
+	// (and keeps the previous tracks) if the frames are not in the motion.
+	int Compute(Motion * pMotion, int startFrame, int numFrames, int numThreads = 0);
+
+	int GetStartFrame() const {
+		return m_StartFrame;
+	}
+	int GetNumFrames() const {
+		return m_NumFrames;
+	}
+
+	// tracks of a bone (by bone index), GetNumFrames() values each, for frames
+	// GetStartFrame(), GetStartFrame() + 1, ...: coordinate 0, 1, 2 of the tip position,
+	// and the orientation as unit quaternions with s >= 0
+	const double * GetPositions(int bone, int coordinate) const {
+		return m_pTracks + (size_t) m_NumAllocatedFrames * (7 * bone + coordinate);
+	}
+	QuaternionArrays GetOrientations(int bone) const;
+
+	// the same at one frame (of the motion, not of the range)
+	vector GetPosition(int bone, int frame) const;
+	Quaternion<double> GetOrientation(int bone, int frame) const;
+
+protected:
+	const Skeleton * m_pSkeleton;
+	int m_NumBones;
+	int m_StartFrame;
+	int m_NumFrames;
+	// 7 tracks per bone (x, y, z, s, qx, qy, qz) of m_NumAllocatedFrames values
+	double * m_pTracks;
+	int m_NumAllocatedFrames;
+
+	struct TracksJob;
+	static void ComputeBlock(int index, void * data);
+};
+
+#endif
@@ -0,0 +1,232 @@
+/*
+ bonetrackskernel.h
+
+ Body of the BoneTracks kernel, included by bonetracks.cpp once per instruction set
+ through simdkernels.h (so there is no include guard), which defines the vector
+ macros (VDOUBLE, VADD, ...) used here.
+
+ Every lane does the same sequence of IEEE operations (no fused multiply-add),
+ so all instruction sets give identical results.
+
+ */
+
+// round to the nearest integer (ties to even), for |a| < 2^51
+static KERNEL_INLINE KERNEL_TARGET VDOUBLE KERNEL_NAME(Round)(VDOUBLE a) {
+	return VSUB(VADD(a, VSET1(6755399441055744.0)), VSET1(6755399441055744.0));
+}
+
+// sine and cosine of angle a in degrees
+static KERNEL_INLINE KERNEL_TARGET void KERNEL_NAME(SinCos)(VDOUBLE a, VDOUBLE & sine,
+		VDOUBLE & cosine) {
+	// a = 90 n + r, with -45 <= r <= 45 degrees
+	VDOUBLE n = KERNEL_NAME(Round)(VMUL(a, VSET1(1.0 / 90.0)));
+	VDOUBLE x = VMUL(VSUB(a, VMUL(VSET1(90.0), n)), VSET1(3.1415926535897932 / 180.0));
+
+	// Taylor series up to x^17 and x^16 (the first omitted terms are below 1e-17 at pi/4),
+	// with the even and odd powers of x^2 evaluated as two independent chains
+	VDOUBLE x2 = VMUL(x, x);
+	VDOUBLE x4 = VMUL(x2, x2);
+	VDOUBLE even = VSET1(-7.6471637318198164e-13);
+	even = VADD(VMUL(even, x4), VSET1(-2.5052108385441720e-08));
+	even = VADD(VMUL(even, x4), VSET1(-1.9841269841269841e-04));
+	even = VADD(VMUL(even, x4), VSET1(-1.6666666666666666e-01));
+	VDOUBLE odd = VSET1(2.8114572543455206e-15);
+	odd = VADD(VMUL(odd, x4), VSET1(1.6059043836821613e-10));
+	odd = VADD(VMUL(odd, x4), VSET1(2.7557319223985893e-06));
+	odd = VADD(VMUL(odd, x4), VSET1(8.3333333333333333e-03));
+	VDOUBLE s = VADD(x, VMUL(VMUL(x, x2), VADD(even, VMUL(odd, x2))));
+	even = VSET1(-1.1470745597729725e-11);
+	even = VADD(VMUL(even, x4), VSET1(-2.7557319223985891e-07));
+	even = VADD(VMUL(even, x4), VSET1(-1.3888888888888889e-03));
+	even = VADD(VMUL(even, x4), VSET1(-0.5));
+	odd = VSET1(4.7794773323873853e-14);
+	odd = VADD(VMUL(odd, x4), VSET1(2.0876756987868100e-09));
+	odd = VADD(VMUL(odd, x4), VSET1(2.4801587301587302e-05));
+	odd = VADD(VMUL(odd, x4), VSET1(4.1666666666666664e-02));
+	VDOUBLE c = VADD(VSET1(1.0), VMUL(x2, VADD(even, VMUL(odd, x2))));
+
+	// quadrant k = n mod 4 (0, ..., 3); odd quadrants swap sine and cosine, the sine is
+	// negative in quadrants 2 and 3 and the cosine in quadrants 1 and 2. All of these
+	// are 0 or 1, so the products below select and negate exactly, without branches.
+	VDOUBLE k = VSUB(n, VMUL(VSET1(4.0), KERNEL_NAME(Round)(VSUB(VMUL(n, VSET1(0.25)), VSET1(0.375)))));
+	VDOUBLE negativeSine = KERNEL_NAME(Round)(VSUB(VMUL(k, VSET1(0.5)), VSET1(0.25)));
+	VDOUBLE swap = VSUB(k, VMUL(VSET1(2.0), negativeSine));
+	// quadrants 1 and 2: swap xor negativeSine
+	VDOUBLE negativeCosine = VSUB(VADD(swap, negativeSine), VMUL(VSET1(2.0), VMUL(swap, negativeSine)));
+	VDOUBLE keep = VSUB(VSET1(1.0), swap);
+	sine = VMUL(VADD(VMUL(s, keep), VMUL(c, swap)), VSUB(VSET1(1.0), VMUL(VSET1(2.0), negativeSine)));
+	cosine = VMUL(VADD(VMUL(c, keep), VMUL(s, swap)), VSUB(VSET1(1.0), VMUL(VSET1(2.0), negativeCosine)));
+}
+
+// value at offset of the frames of the lanes
+static KERNEL_INLINE KERNEL_TARGET VDOUBLE KERNEL_NAME(Gather)(const double * frames[VLANES],
+		int offset) {
+	double values[VLANES];
+	for (int lane = 0; lane < VLANES; lane++)
+		values[lane] = frames[lane][offset];
+	return VLOAD(values);
+}
+
+// m = m * translation by (x, y, z), as in Skeleton::computeBoneTipPos
+static KERNEL_INLINE KERNEL_TARGET void KERNEL_NAME(Translate)(VDOUBLE m[3][4], VDOUBLE x,
+		VDOUBLE y, VDOUBLE z) {
+	for (int row = 0; row < 3; row++)
+		m[row][3] = VADD(VADD(VADD(VMUL(m[row][0], x), VMUL(m[row][1], y)), VMUL(m[row][2], z)), m[row][3]);
+}
+
+// m = m * rotation around axis X, Y or Z by the angle with sine s and cosine c, as in
+// Skeleton::computeBoneTipPos
+static KERNEL_INLINE KERNEL_TARGET void KERNEL_NAME(RotateX)(VDOUBLE m[3][4], VDOUBLE s, VDOUBLE c) {
+	VDOUBLE minusS = VMUL(VSET1(-1.0), s);
+	for (int row = 0; row < 3; row++) {
+		VDOUBLE y = m[row][1], z = m[row][2];
+		m[row][1] = VADD(VMUL(y, c), VMUL(z, s));
+		m[row][2] = VADD(VMUL(y, minusS), VMUL(z, c));
+	}
+}
+
+static KERNEL_INLINE KERNEL_TARGET void KERNEL_NAME(RotateY)(VDOUBLE m[3][4], VDOUBLE s, VDOUBLE c) {
+	VDOUBLE minusS = VMUL(VSET1(-1.0), s);
+	for (int row = 0; row < 3; row++) {
+		VDOUBLE x = m[row][0], z = m[row][2];
+		m[row][0] = VADD(VMUL(x, c), VMUL(z, minusS));
+		m[row][2] = VADD(VMUL(x, s), VMUL(z, c));
+	}
+}
+
+static KERNEL_INLINE KERNEL_TARGET void KERNEL_NAME(RotateZ)(VDOUBLE m[3][4], VDOUBLE s, VDOUBLE c) {
+	VDOUBLE minusS = VMUL(VSET1(-1.0), s);
+	for (int row = 0; row < 3; row++) {
+		VDOUBLE x = m[row][0], y = m[row][1];
+		m[row][0] = VADD(VMUL(x, c), VMUL(y, s));
+		m[row][1] = VADD(VMUL(x, minusS), VMUL(y, c));
+	}
+}
+
+// unit quaternion with s >= 0 of the rotation matrix m, from its largest of 4 s^2,
+// 4 x^2, 4 y^2, 4 z^2 (Shepperd's method, with blends instead of branches)
+static KERNEL_INLINE KERNEL_TARGET void KERNEL_NAME(MatrixToQuaternion)(VDOUBLE m[3][4],
+		VDOUBLE q[4]) {
+	VDOUBLE one = VSET1(1.0);
+	VDOUBLE t[4];
+	t[0] = VADD(VADD(VADD(one, m[0][0]), m[1][1]), m[2][2]);
+	t[1] = VSUB(VSUB(VADD(one, m[0][0]), m[1][1]), m[2][2]);
+	t[2] = VSUB(VADD(VSUB(one, m[0][0]), m[1][1]), m[2][2]);
+	t[3] = VADD(VSUB(VSUB(one, m[0][0]), m[1][1]), m[2][2]);
+	VDOUBLE sx = VSUB(m[2][1], m[1][2]), sy = VSUB(m[0][2], m[2][0]), sz = VSUB(m[1][0], m[0][1]);
+	VDOUBLE xy = VADD(m[0][1], m[1][0]), xz = VADD(m[0][2], m[2][0]), yz = VADD(m[1][2], m[2][1]);
+	// row k is 4 q_k q, for the component k with t[k] = 4 q_k^2
+	VDOUBLE rows[4][4] = { { t[0], sx, sy, sz }, { sx, t[1], xy, xz }, { sy, xy, t[2], yz }, { sz, xz, yz, t[3] } };
+
+	VDOUBLE largest = t[0];
+	for (int c = 0; c < 4; c++)
+		q[c] = rows[0][c];
+	for (int k = 1; k < 4; k++) {
+		VMASK larger = VGT(t[k], largest);
+		largest = VBLEND(larger, largest, t[k]);
+		for (int c = 0; c < 4; c++)
+			q[c] = VBLEND(larger, q[c], rows[k][c]);
+	}
+	VDOUBLE scale = VDIV(VSET1(0.5), VSQRT(largest));
+	scale = VBLEND(VLT(q[0], VSET1(0.0)), scale, VMUL(VSET1(-1.0), scale));
+	for (int c = 0; c < 4; c++)
+		q[c] = VMUL(q[c], scale);
+}
+
+// tracks of count frames (frames points to the first one), as in BoneTracks with
+// numTrackFrames values per track; scratch holds 12 VLANES doubles per bone
+static KERNEL_TARGET void KERNEL_NAME(ComputeTracks)(const Skeleton * skeleton, const double * frames,
+		int frameSize, int count, int numTrackFrames, double * tracks, double * scratch) {
+	const PostureLayout & layout = skeleton->m_PostureLayout;
+	int numFKBones = skeleton->m_NumFKBones;
+
+	for (int i = 0; i < count; i += VLANES) {
+		// the lanes past the last frame repeat it, and are not stored
+		const double * lanes[VLANES];
+		int numLanes = (count - i < VLANES) ? count - i : VLANES;
+		for (int lane = 0; lane < VLANES; lane++)
+			lanes[lane] = frames + (size_t) (i + ((lane < numLanes) ? lane : numLanes - 1)) * frameSize;
+
+		for (int position = 0; position < numFKBones; position++) {
+			int bone = skeleton->m_FKOrder[position];
+			int dofs = skeleton->m_FKDofs[position];
+			const double (*r)[3] = skeleton->m_FKRotation[position];
+			const double * offset = skeleton->m_FKOffset[position];
+			VDOUBLE m[3][4];
+
+			// parent transform times the rotation to the parent
+			int parent = skeleton->m_FKParent[position];
+			if (parent < 0) {
+				for (int row = 0; row < 3; row++) {
+					for (int col = 0; col < 3; col++)
+						m[row][col] = VSET1(r[row][col]);
+					m[row][3] = VSET1(0.0);
+				}
+			}
+			else {
+				const double * p = scratch + (size_t) 12 * VLANES * parent;
+				for (int row = 0; row < 3; row++) {
+					VDOUBLE p0 = VLOAD(p + (4 * row) * VLANES);
+					VDOUBLE p1 = VLOAD(p + (4 * row + 1) * VLANES);
+					VDOUBLE p2 = VLOAD(p + (4 * row + 2) * VLANES);
+					for (int col = 0; col < 3; col++)
+						m[row][col] = VADD(VADD(VMUL(p0, VSET1(r[0][col])), VMUL(p1, VSET1(r[1][col]))),
+								VMUL(p2, VSET1(r[2][col])));
+					m[row][3] = VLOAD(p + (4 * row + 3) * VLANES);
+				}
+			}
+
+			// translation DOFs (in the order of computeBoneTipPos)
+			int translation = layout.translationOffset[bone];
+			VDOUBLE zero = VSET1(0.0);
+			if ((dofs & Skeleton::FK_TZ) && (translation >= 0))
+				KERNEL_NAME(Translate)(m, zero, zero, KERNEL_NAME(Gather)(lanes, translation + 2));
+			if ((dofs & Skeleton::FK_TY) && (translation >= 0))
+				KERNEL_NAME(Translate)(m, zero, KERNEL_NAME(Gather)(lanes, translation + 1), zero);
+			if ((dofs & Skeleton::FK_TX) && (translation >= 0))
+				KERNEL_NAME(Translate)(m, KERNEL_NAME(Gather)(lanes, translation), zero, zero);
+
+			// rotation DOFs
+			int rotation = layout.rotationOffset[bone];
+			VDOUBLE s, c;
+			if ((dofs & Skeleton::FK_RZ) && (rotation >= 0)) {
+				KERNEL_NAME(SinCos)(KERNEL_NAME(Gather)(lanes, rotation + 2), s, c);
+				KERNEL_NAME(RotateZ)(m, s, c);
+			}
+			if ((dofs & Skeleton::FK_RY) && (rotation >= 0)) {
+				KERNEL_NAME(SinCos)(KERNEL_NAME(Gather)(lanes, rotation + 1), s, c);
+				KERNEL_NAME(RotateY)(m, s, c);
+			}
+			if ((dofs & Skeleton::FK_RX) && (rotation >= 0)) {
+				KERNEL_NAME(SinCos)(KERNEL_NAME(Gather)(lanes, rotation), s, c);
+				KERNEL_NAME(RotateX)(m, s, c);
+			}
+
+			// bone origin to tip
+			KERNEL_NAME(Translate)(m, VSET1(offset[0]), VSET1(offset[1]), VSET1(offset[2]));
+
+			double * transform = scratch + (size_t) 12 * VLANES * position;
+			for (int row = 0; row < 3; row++)
+				for (int col = 0; col < 4; col++)
+					VSTORE(transform + (4 * row + col) * VLANES, m[row][col]);
+
+			// position and orientation tracks of the bone
+			VDOUBLE values[7];
+			values[0] = m[0][3];
+			values[1] = m[1][3];
+			values[2] = m[2][3];
+			KERNEL_NAME(MatrixToQuaternion)(m, values + 3);
+			double * track = tracks + (size_t) 7 * numTrackFrames * bone + i;
+			for (int c = 0; c < 7; c++) {
+				if (numLanes == VLANES)
+					VSTORE(track + (size_t) c * numTrackFrames, values[c]);
+				else {
+					double stored[VLANES];
+					VSTORE(stored, values[c]);
+					for (int lane = 0; lane < numLanes; lane++)
+						track[(size_t) c * numTrackFrames + lane] = stored[lane];
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,41 @@
+/*
+ cubiccurves.cpp
+
+ See cubiccurves.h.
+
+ */
+#include "cubiccurves.h"
+
+// the curves must round every multiplication and addition (see cubiccurves.h)
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+void BezierToPowerForm(int count, const double * p0, const double * p1, const double * p2,
+		const double * p3, double * coefficients)
+{
+	double * c0 = coefficients;
+	double * c1 = c0 + count;
+	double * c2 = c1 + count;
+	double * c3 = c2 + count;
+	// (1-t)^3 p0 + 3t(1-t)^2 p1 + 3t^2(1-t) p2 + t^3 p3
+	for (int i = 0; i < count; i++) {
+		c0[i] = p0[i];
+		c1[i] = 3.0 * (p1[i] - p0[i]);
+		c2[i] = 3.0 * (p0[i] - 2.0 * p1[i] + p2[i]);
+		c3[i] = p3[i] - p0[i] + 3.0 * (p1[i] - p2[i]);
+	}
+}
+
+void EvaluatePowerForm(int count, const double * coefficients, double t, double * values)
+{
+	const double * c0 = coefficients;
+	const double * c1 = c0 + count;
+	const double * c2 = c1 + count;
+	const double * c3 = c2 + count;
+	for (int i = 0; i < count; i++)
+		values[i] = c0[i] + t * (c1[i] + t * (c2[i] + t * c3[i]));
+}
+
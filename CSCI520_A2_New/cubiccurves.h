@@ -0,0 +1,33 @@
+/*
+ cubiccurves.h
+
+ Cubic curves of many values at once (the root position and the Euler angles of all
+ bones of a segment), in power form:
+
+   value(t) = c0 + t * (c1 + t * (c2 + t * c3)), t on [0, 1]
+
+ A Bezier segment is converted once; each frame then takes 3 multiplications and 3
+ additions per value (Horner's rule), in one loop over contiguous arrays that the
+ compiler vectorizes, instead of the 6 Lerps (with their temporary vectors) of
+ De Casteljau's construction. The basis does not depend on the segment, so there is
+ nothing to tabulate per t.
+
+ Every multiplication and addition is rounded (no fused multiply-add), so the curves
+ are the same on every processor; Interpolator and MotionEvaluator evaluate them with
+ the same routine and give the same frames.
+
+ */
+
+#ifndef _CUBICCURVES_H
+#define _CUBICCURVES_H
+
+// coefficients of count curves: c0 of every curve, then c1, c2 and c3 (4 * count doubles)
+// of the Bezier curves from p0[i] to p3[i] with control points p1[i], p2[i]
+void BezierToPowerForm(int count, const double * p0, const double * p1, const double * p2,
+		const double * p3, double * coefficients);
+
+// values[i] = curve i at t
+void EvaluatePowerForm(int count, const double * coefficients, double t, double * values);
+
+#endif
+
@@ -0,0 +1,654 @@
+/*
+ fileio.cpp
+
+ See fileio.h.
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "fileio.h"
+
+MappedFile::MappedFile() {
+	m_pData = NULL;
+	m_Size = 0;
+	m_Mapped = 0;
+}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+int MappedFile::Open(const char * filename, int flags) {
+	Close();
+
+#ifndef WIN32
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+	m_Size = (size_t) st.st_size;
+
+	if (m_Size > 0) {
+		int protection = (flags & COPY_ON_WRITE) ? (PROT_READ | PROT_WRITE) : PROT_READ;
+		void * addr = mmap(NULL, m_Size, protection, MAP_PRIVATE, fd, 0);
+		if (addr != MAP_FAILED) {
+			if (flags & SEQUENTIAL)
+				madvise(addr, m_Size, MADV_SEQUENTIAL);
+			m_pData = (char *) addr;
+			m_Mapped = 1;
+			close(fd);
+			return 0;
+		}
+	}
+	close(fd);
+#endif
+
+	// no mmap: read the whole file into memory instead
+	FILE * file = fopen(filename, "rb");
+	if (file == NULL)
+		return -1;
+	fseek(file, 0, SEEK_END);
+	m_Size = (size_t) ftell(file);
+	fseek(file, 0, SEEK_SET);
+	m_pData = (char *) malloc(m_Size + 1);
+	if ((m_pData == NULL) || (fread(m_pData, 1, m_Size, file) != m_Size)) {
+		fclose(file);
+		Close();
+		return -1;
+	}
+	fclose(file);
+	m_Mapped = 0;
+	return 0;
+}
+
+void MappedFile::Close() {
+	if (m_pData != NULL) {
+#ifndef WIN32
+		if (m_Mapped)
+			munmap(m_pData, m_Size);
+		else
+#endif
+			free(m_pData);
+	}
+	m_pData = NULL;
+	m_Size = 0;
+	m_Mapped = 0;
+}
+
+static inline int IsWhitespace(char c) {
+	return (c == ' ') || (c == '\n') || (c == '\r') || (c == '\t') || (c == '\f') || (c == '\v');
+}
+
+const char * SkipWhitespace(const char * p, const char * end) {
+	while ((p < end) && IsWhitespace(*p))
+		p++;
+	return p;
+}
+
+const char * SkipToken(const char * p, const char * end) {
+	while ((p < end) && !IsWhitespace(*p))
+		p++;
+	return p;
+}
+
+const char * SkipLine(const char * p, const char * end) {
+	while ((p < end) && (*p != '\n'))
+		p++;
+	return (p < end) ? p + 1 : p;
+}
+
+// exactly representable powers of ten
+static const double powersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+		1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+		1e20, 1e21, 1e22 };
+
+const char * ParseDouble(const char * p, const char * end, double * value) {
+	const char * start = p;
+	int negative = 0;
+	if ((p < end) && ((*p == '-') || (*p == '+'))) {
+		negative = (*p == '-');
+		p++;
+	}
+
+	// accumulate up to 19 significant digits; count the rest in the exponent
+	unsigned long long mantissa = 0;
+	int numDigits = 0;
+	int exponent = 0;
+	int sawDigit = 0;
+	while ((p < end) && (*p >= '0') && (*p <= '9')) {
+		sawDigit = 1;
+		if (numDigits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa != 0)
+				numDigits++;
+		}
+		else
+			exponent++;
+		p++;
+	}
+	if ((p < end) && (*p == '.')) {
+		p++;
+		while ((p < end) && (*p >= '0') && (*p <= '9')) {
+			sawDigit = 1;
+			if (numDigits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0)
+					numDigits++;
+				exponent--;
+			}
+			p++;
+		}
+	}
+	if (!sawDigit)
+		return start;
+
+	if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+		const char * exponentStart = p;
+		p++;
+		int exponentNegative = 0;
+		if ((p < end) && ((*p == '-') || (*p == '+'))) {
+			exponentNegative = (*p == '-');
+			p++;
+		}
+		if ((p < end) && (*p >= '0') && (*p <= '9')) {
+			int e = 0;
+			while ((p < end) && (*p >= '0') && (*p <= '9')) {
+				if (e < 100000)
+					e = e * 10 + (*p - '0');
+				p++;
+			}
+			exponent += exponentNegative ? -e : e;
+		}
+		else
+			p = exponentStart; // not an exponent after all
+	}
+
+	// fast path: both the mantissa and the power of ten are exact doubles,
+	// so a single multiplication or division is correctly rounded
+	if ((mantissa < (1ULL << 53)) && (exponent >= -22) && (exponent <= 22)) {
+		double result = (double) mantissa;
+		if (exponent < 0)
+			result /= powersOf10[-exponent];
+		else
+			result *= powersOf10[exponent];
+		*value = negative ? -result : result;
+		return p;
+	}
+
+	// slow path: more than 15 significant digits or a large exponent
+	char buffer[128];
+	size_t length = p - start;
+	if (length >= sizeof(buffer))
+		length = sizeof(buffer) - 1;
+	memcpy(buffer, start, length);
+	buffer[length] = 0;
+	*value = strtod(buffer, NULL);
+	return p;
+}
+
+const char * ParseInt(const char * p, const char * end, int * value) {
+	const char * start = p;
+	int negative = 0;
+	if ((p < end) && ((*p == '-') || (*p == '+'))) {
+		negative = (*p == '-');
+		p++;
+	}
+	if ((p >= end) || (*p < '0') || (*p > '9'))
+		return start;
+
+	int result = 0;
+	while ((p < end) && (*p >= '0') && (*p <= '9')) {
+		result = result * 10 + (*p - '0');
+		p++;
+	}
+	*value = negative ? -result : result;
+	return p;
+}
+
+/*
+ Shortest round-trip double to decimal conversion (Grisu2).
+
+ Reference: Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+ Accurately with Integers", PLDI 2010.
+ The digits produced are the shortest (or very close to the shortest) that
+ convert back to exactly the same double.
+ */
+
+typedef unsigned long long uint64;
+
+// a floating point number f * 2^e with a 64-bit significand
+struct DiyFp {
+	uint64 f;
+	int e;
+
+	DiyFp(uint64 f_, int e_) :
+			f(f_), e(e_) {
+	}
+};
+
+static DiyFp Sub(DiyFp x, DiyFp y) {
+	return DiyFp(x.f - y.f, x.e);
+}
+
+// x * y, rounded to the upper 64 bits of the product
+static DiyFp Mul(DiyFp x, DiyFp y) {
+	uint64 xLow = x.f & 0xFFFFFFFFu, xHigh = x.f >> 32;
+	uint64 yLow = y.f & 0xFFFFFFFFu, yHigh = y.f >> 32;
+
+	uint64 p0 = xLow * yLow;
+	uint64 p1 = xLow * yHigh;
+	uint64 p2 = xHigh * yLow;
+	uint64 p3 = xHigh * yHigh;
+
+	uint64 q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+	q += 1u << 31; // round
+
+	return DiyFp(p3 + (p2 >> 32) + (p1 >> 32) + (q >> 32), x.e + y.e + 64);
+}
+
+static DiyFp Normalize(DiyFp x) {
+	while ((x.f >> 63) == 0) {
+		x.f <<= 1;
+		x.e--;
+	}
+	return x;
+}
+
+// the binary value v of a positive double, and the boundaries m- and m+ of
+// the interval of reals that round to v; m- and m+ share the exponent of m+
+static void ComputeBoundaries(double value, DiyFp * minus, DiyFp * v, DiyFp * plus) {
+	uint64 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint64 fraction = bits & ((1ULL << 52) - 1);
+	int exponent = (int) (bits >> 52);
+
+	DiyFp w = (exponent == 0) ? DiyFp(fraction, 1 - 1075) : DiyFp(fraction + (1ULL << 52), exponent - 1075);
+
+	// the lower boundary is closer if value is a power of two (but not the smallest normal)
+	int lowerBoundaryIsCloser = (fraction == 0) && (exponent > 1);
+
+	DiyFp mPlus = Normalize(DiyFp(2 * w.f + 1, w.e - 1));
+	DiyFp mMinus = lowerBoundaryIsCloser ? DiyFp(4 * w.f - 1, w.e - 2) : DiyFp(2 * w.f - 1, w.e - 1);
+	mMinus.f <<= mMinus.e - mPlus.e;
+	mMinus.e = mPlus.e;
+
+	*minus = mMinus;
+	*v = Normalize(w);
+	*plus = mPlus;
+}
+
+// normalized approximations of 10^k, k = -300, -292, ..., 324
+struct CachedPower {
+	uint64 f;
+	int e;
+	int k;
+};
+
+static const CachedPower cachedPowers[] = {
+	{ 0xAB70FE17C79AC6CAULL, -1060, -300 },
+	{ 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+	{ 0xBE5691EF416BD60CULL, -1007, -284 },
+	{ 0x8DD01FAD907FFC3CULL, -980, -276 },
+	{ 0xD3515C2831559A83ULL, -954, -268 },
+	{ 0x9D71AC8FADA6C9B5ULL, -927, -260 },
+	{ 0xEA9C227723EE8BCBULL, -901, -252 },
+	{ 0xAECC49914078536DULL, -874, -244 },
+	{ 0x823C12795DB6CE57ULL, -847, -236 },
+	{ 0xC21094364DFB5637ULL, -821, -228 },
+	{ 0x9096EA6F3848984FULL, -794, -220 },
+	{ 0xD77485CB25823AC7ULL, -768, -212 },
+	{ 0xA086CFCD97BF97F4ULL, -741, -204 },
+	{ 0xEF340A98172AACE5ULL, -715, -196 },
+	{ 0xB23867FB2A35B28EULL, -688, -188 },
+	{ 0x84C8D4DFD2C63F3BULL, -661, -180 },
+	{ 0xC5DD44271AD3CDBAULL, -635, -172 },
+	{ 0x936B9FCEBB25C996ULL, -608, -164 },
+	{ 0xDBAC6C247D62A584ULL, -582, -156 },
+	{ 0xA3AB66580D5FDAF6ULL, -555, -148 },
+	{ 0xF3E2F893DEC3F126ULL, -529, -140 },
+	{ 0xB5B5ADA8AAFF80B8ULL, -502, -132 },
+	{ 0x87625F056C7C4A8BULL, -475, -124 },
+	{ 0xC9BCFF6034C13053ULL, -449, -116 },
+	{ 0x964E858C91BA2655ULL, -422, -108 },
+	{ 0xDFF9772470297EBDULL, -396, -100 },
+	{ 0xA6DFBD9FB8E5B88FULL, -369, -92 },
+	{ 0xF8A95FCF88747D94ULL, -343, -84 },
+	{ 0xB94470938FA89BCFULL, -316, -76 },
+	{ 0x8A08F0F8BF0F156BULL, -289, -68 },
+	{ 0xCDB02555653131B6ULL, -263, -60 },
+	{ 0x993FE2C6D07B7FACULL, -236, -52 },
+	{ 0xE45C10C42A2B3B06ULL, -210, -44 },
+	{ 0xAA242499697392D3ULL, -183, -36 },
+	{ 0xFD87B5F28300CA0EULL, -157, -28 },
+	{ 0xBCE5086492111AEBULL, -130, -20 },
+	{ 0x8CBCCC096F5088CCULL, -103, -12 },
+	{ 0xD1B71758E219652CULL, -77, -4 },
+	{ 0x9C40000000000000ULL, -50, 4 },
+	{ 0xE8D4A51000000000ULL, -24, 12 },
+	{ 0xAD78EBC5AC620000ULL, 3, 20 },
+	{ 0x813F3978F8940984ULL, 30, 28 },
+	{ 0xC097CE7BC90715B3ULL, 56, 36 },
+	{ 0x8F7E32CE7BEA5C70ULL, 83, 44 },
+	{ 0xD5D238A4ABE98068ULL, 109, 52 },
+	{ 0x9F4F2726179A2245ULL, 136, 60 },
+	{ 0xED63A231D4C4FB27ULL, 162, 68 },
+	{ 0xB0DE65388CC8ADA8ULL, 189, 76 },
+	{ 0x83C7088E1AAB65DBULL, 216, 84 },
+	{ 0xC45D1DF942711D9AULL, 242, 92 },
+	{ 0x924D692CA61BE758ULL, 269, 100 },
+	{ 0xDA01EE641A708DEAULL, 295, 108 },
+	{ 0xA26DA3999AEF774AULL, 322, 116 },
+	{ 0xF209787BB47D6B85ULL, 348, 124 },
+	{ 0xB454E4A179DD1877ULL, 375, 132 },
+	{ 0x865B86925B9BC5C2ULL, 402, 140 },
+	{ 0xC83553C5C8965D3DULL, 428, 148 },
+	{ 0x952AB45CFA97A0B3ULL, 455, 156 },
+	{ 0xDE469FBD99A05FE3ULL, 481, 164 },
+	{ 0xA59BC234DB398C25ULL, 508, 172 },
+	{ 0xF6C69A72A3989F5CULL, 534, 180 },
+	{ 0xB7DCBF5354E9BECEULL, 561, 188 },
+	{ 0x88FCF317F22241E2ULL, 588, 196 },
+	{ 0xCC20CE9BD35C78A5ULL, 614, 204 },
+	{ 0x98165AF37B2153DFULL, 641, 212 },
+	{ 0xE2A0B5DC971F303AULL, 667, 220 },
+	{ 0xA8D9D1535CE3B396ULL, 694, 228 },
+	{ 0xFB9B7CD9A4A7443CULL, 720, 236 },
+	{ 0xBB764C4CA7A44410ULL, 747, 244 },
+	{ 0x8BAB8EEFB6409C1AULL, 774, 252 },
+	{ 0xD01FEF10A657842CULL, 800, 260 },
+	{ 0x9B10A4E5E9913129ULL, 827, 268 },
+	{ 0xE7109BFBA19C0C9DULL, 853, 276 },
+	{ 0xAC2820D9623BF429ULL, 880, 284 },
+	{ 0x80444B5E7AA7CF85ULL, 907, 292 },
+	{ 0xBF21E44003ACDD2DULL, 933, 300 },
+	{ 0x8E679C2F5E44FF8FULL, 960, 308 },
+	{ 0xD433179D9C8CB841ULL, 986, 316 },
+	{ 0x9E19DB92B4E31BA9ULL, 1013, 324 }
+};
+
+// the target range of binary exponents after scaling by a cached power
+static const int grisuAlpha = -60;
+static const int grisuGamma = -32;
+
+static CachedPower GetCachedPower(int e) {
+	// smallest k with alpha <= e + e_c + 64, where e_c is the binary exponent of 10^k;
+	// 78913 / 2^18 approximates log10(2)
+	int f = grisuAlpha - e - 1;
+	int k = (f * 78913) / (1 << 18) + (f > 0);
+	int index = (300 + k + 7) / 8;
+	return cachedPowers[index];
+}
+
+// number of decimal digits of n and the largest power of ten <= n
+static int FindLargestPow10(unsigned int n, unsigned int * pow10) {
+	static const unsigned int powers[] = { 1, 10, 100, 1000, 10000, 100000,
+			1000000, 10000000, 100000000, 1000000000 };
+	int digits = 10;
+	while ((digits > 1) && (n < powers[digits - 1]))
+		digits--;
+	*pow10 = powers[digits - 1];
+	return digits;
+}
+
+// move the last digit towards w while staying inside the rounding interval
+static void GrisuRound(char * buffer, int length, uint64 dist, uint64 delta, uint64 rest, uint64 tenK) {
+	while ((rest < dist) && (delta - rest >= tenK)
+			&& ((rest + tenK < dist) || (dist - rest > rest + tenK - dist))) {
+		buffer[length - 1]--;
+		rest += tenK;
+	}
+}
+
+// generate the digits of a number inside (mMinus, mPlus), as close to w as possible
+static void GrisuDigitGen(char * buffer, int * length, int * decimalExponent, DiyFp mMinus, DiyFp w, DiyFp mPlus) {
+	uint64 delta = Sub(mPlus, mMinus).f;
+	uint64 dist = Sub(mPlus, w).f;
+
+	DiyFp one(1ULL << -mPlus.e, mPlus.e);
+	unsigned int p1 = (unsigned int) (mPlus.f >> -one.e); // integral part
+	uint64 p2 = mPlus.f & (one.f - 1); // fractional part
+
+	unsigned int pow10;
+	int n = FindLargestPow10(p1, &pow10);
+	*length = 0;
+
+	while (n > 0) {
+		unsigned int d = p1 / pow10;
+		p1 %= pow10;
+		buffer[(*length)++] = (char) ('0' + d);
+		n--;
+
+		uint64 rest = ((uint64) p1 << -one.e) + p2;
+		if (rest <= delta) {
+			*decimalExponent += n;
+			GrisuRound(buffer, *length, dist, delta, rest, (uint64) pow10 << -one.e);
+			return;
+		}
+		pow10 /= 10;
+	}
+
+	int m = 0;
+	while (1) {
+		p2 *= 10;
+		buffer[(*length)++] = (char) ('0' + (p2 >> -one.e));
+		p2 &= one.f - 1;
+		m++;
+		delta *= 10;
+		dist *= 10;
+		if (p2 <= delta)
+			break;
+	}
+	*decimalExponent -= m;
+	GrisuRound(buffer, *length, dist, delta, p2, one.f);
+}
+
+// digits of a positive, finite value: value = digits * 10^decimalExponent
+static void Grisu2(char * buffer, int * length, int * decimalExponent, double value) {
+	DiyFp mMinus(0, 0), v(0, 0), mPlus(0, 0);
+	ComputeBoundaries(value, &mMinus, &v, &mPlus);
+
+	CachedPower cached = GetCachedPower(mPlus.e);
+	DiyFp c(cached.f, cached.e);
+
+	DiyFp w = Mul(v, c);
+	DiyFp wMinus = Mul(mMinus, c);
+	DiyFp wPlus = Mul(mPlus, c);
+
+	// shrink the interval by one ulp on each side to stay safely inside it
+	*decimalExponent = -cached.k;
+	GrisuDigitGen(buffer, length, decimalExponent, DiyFp(wMinus.f + 1, wMinus.e), w, DiyFp(wPlus.f - 1, wPlus.e));
+}
+
+char * FormatInt(char * buffer, int value) {
+	unsigned int n = (unsigned int) value;
+	if (value < 0) {
+		*buffer++ = '-';
+		n = 0u - n;
+	}
+	char digits[10];
+	int length = 0;
+	do {
+		digits[length++] = (char) ('0' + n % 10);
+		n /= 10;
+	} while (n > 0);
+	while (length > 0)
+		*buffer++ = digits[--length];
+	return buffer;
+}
+
+char * FormatDouble(char * buffer, double value) {
+	if (value != value) {
+		memcpy(buffer, "nan", 3);
+		return buffer + 3;
+	}
+
+	uint64 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	if (bits >> 63) {
+		*buffer++ = '-';
+		value = -value;
+	}
+
+	if (value == 0) {
+		*buffer++ = '0';
+		return buffer;
+	}
+	if (value > 1.7976931348623157e308) {
+		memcpy(buffer, "inf", 3);
+		return buffer + 3;
+	}
+
+	char digits[20];
+	int length, decimalExponent;
+	Grisu2(digits, &length, &decimalExponent, value);
+
+	// position of the decimal point relative to the first digit
+	int n = length + decimalExponent;
+
+	if ((length <= n) && (n <= 15)) {
+		// integer: digits followed by zeros
+		memcpy(buffer, digits, length);
+		memset(buffer + length, '0', n - length);
+		return buffer + n;
+	}
+
+	if ((0 < n) && (n <= 15)) {
+		// dig.its
+		memcpy(buffer, digits, n);
+		buffer[n] = '.';
+		memcpy(buffer + n + 1, digits + n, length - n);
+		return buffer + length + 1;
+	}
+
+	if ((-5 < n) && (n <= 0)) {
+		// 0.000digits
+		buffer[0] = '0';
+		buffer[1] = '.';
+		memset(buffer + 2, '0', -n);
+		memcpy(buffer + 2 - n, digits, length);
+		return buffer + 2 - n + length;
+	}
+
+	// d.igitse-XX
+	*buffer++ = digits[0];
+	if (length > 1) {
+		*buffer++ = '.';
+		memcpy(buffer, digits + 1, length - 1);
+		buffer += length - 1;
+	}
+	*buffer++ = 'e';
+	int exponent = n - 1;
+	if (exponent < 0) {
+		*buffer++ = '-';
+		exponent = -exponent;
+	}
+	else
+		*buffer++ = '+';
+	if (exponent < 10)
+		*buffer++ = '0';
+	return FormatInt(buffer, exponent);
+}
+
+OutputBuffer::OutputBuffer(size_t capacity) {
+	m_pFile = NULL;
+	m_Capacity = capacity;
+	m_pBuffer = (char *) malloc(m_Capacity);
+	m_Length = 0;
+	m_Error = 0;
+}
+
+OutputBuffer::~OutputBuffer() {
+	Close();
+	free(m_pBuffer);
+}
+
+// the original standard output, once ReserveStandardOutput has been called
+static FILE * reservedStandardOutput = NULL;
+
+FILE * ReserveStandardOutput() {
+	if (reservedStandardOutput != NULL)
+		return reservedStandardOutput;
+
+	fflush(stdout);
+#ifdef WIN32
+	int fd = _dup(1);
+	if (fd < 0)
+		return NULL;
+	_dup2(2, 1);
+	_setmode(fd, _O_BINARY);
+	reservedStandardOutput = _fdopen(fd, "wb");
+#else
+	int fd = dup(1);
+	if (fd < 0)
+		return NULL;
+	dup2(2, 1);
+	reservedStandardOutput = fdopen(fd, "wb");
+#endif
+	return reservedStandardOutput;
+}
+
+int OutputBuffer::Open(const char * filename) {
+	Close();
+	if (strcmp(filename, "-") == 0)
+		m_pFile = ReserveStandardOutput();
+	else
+		m_pFile = fopen(filename, "wb");
+	m_Error = 0;
+	return (m_pFile == NULL) ? -1 : 0;
+}
+
+int OutputBuffer::Close() {
+	if (m_pFile == NULL)
+		return 0;
+	Flush();
+	if (m_pFile == reservedStandardOutput) {
+		if (fflush(m_pFile) != 0)
+			m_Error = 1;
+	}
+	else if (fclose(m_pFile) != 0)
+		m_Error = 1;
+	m_pFile = NULL;
+	return m_Error ? -1 : 0;
+}
+
+void OutputBuffer::Append(const char * str, size_t length) {
+	if (m_Length + length > m_Capacity) {
+		Flush();
+		if (length > m_Capacity) {
+			if (fwrite(str, 1, length, m_pFile) != length)
+				m_Error = 1;
+			return;
+		}
+	}
+	memcpy(m_pBuffer + m_Length, str, length);
+	m_Length += length;
+}
+
+void OutputBuffer::Append(const char * str) {
+	Append(str, strlen(str));
+}
+
+void OutputBuffer::Flush() {
+	if ((m_pFile != NULL) && (m_Length > 0)) {
+		if (fwrite(m_pBuffer, 1, m_Length, m_pFile) != m_Length)
+			m_Error = 1;
+	}
+	m_Length = 0;
+}
@@ -0,0 +1,121 @@
+/*
+ fileio.h
+
+ Low-level helpers for fast motion file I/O:
+ 1. MappedFile: read-only view of a whole file (mmap where available)
+ 2. locale-free tokenizing and number parsing on memory buffers
+ 3. OutputBuffer: formats text into a large buffer and writes it out in big chunks
+
+ */
+
+#ifndef _FILEIO_H
+#define _FILEIO_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	enum {
+		SEQUENTIAL = 1, // the file will be read front to back once
+		COPY_ON_WRITE = 2 // the data may be modified in memory; the file is never changed
+	};
+
+	// map the whole file; returns 0 on success, -1 on failure
+	int Open(const char * filename, int flags = SEQUENTIAL);
+	void Close();
+
+	// writable only if opened with COPY_ON_WRITE
+	char * GetData() const {
+		return m_pData;
+	}
+	size_t GetSize() const {
+		return m_Size;
+	}
+
+protected:
+	char * m_pData;
+	size_t m_Size;
+	// 1 if m_pData was mmap'ed, 0 if it was read into a heap buffer
+	int m_Mapped;
+};
+
+// Skip spaces, tabs, CR and LF. Returns the new position (<= end).
+const char * SkipWhitespace(const char * p, const char * end);
+
+// Skip to the first whitespace character at or after p.
+const char * SkipToken(const char * p, const char * end);
+
+// Skip the rest of the current line, including the line break.
+const char * SkipLine(const char * p, const char * end);
+
+// Parse a decimal floating point number starting at p (no leading whitespace).
+// On success, stores the value and returns the position after the number;
+// on failure, returns p unchanged.
+// Numbers with at most 15 significant digits and small exponents (everything
+// written by Motion::writeAMCfile) are converted exactly without strtod.
+const char * ParseDouble(const char * p, const char * end, double * value);
+
+// Parse a (possibly signed) decimal integer; same conventions as ParseDouble.
+const char * ParseInt(const char * p, const char * end, int * value);
+
+// Write the shortest decimal representation of value that reads back to exactly
+// the same double (Grisu2). Plain notation is used for exponents from -5 to 14
+// (0.00001 to 999999999999999), scientific notation (1.5e-07, 1e+15) otherwise. At most 25 characters are written;
+// no terminating zero. Returns the position after the last character.
+char * FormatDouble(char * buffer, double value);
+
+// Write a decimal integer; returns the position after the last character.
+char * FormatInt(char * buffer, int value);
+
+// Keep standard output for data: from now on, text printed with printf goes to
+// standard error. Call before anything is printed. Returns the stream that writes
+// to the original standard output (NULL on failure); later calls return the same stream.
+FILE * ReserveStandardOutput();
+
+class OutputBuffer {
+public:
+	OutputBuffer(size_t capacity = 1 << 20);
+	~OutputBuffer();
+
+	// returns 0 on success, -1 on failure
+	// "-" writes to standard output (see ReserveStandardOutput)
+	int Open(const char * filename);
+	// flush and close; returns 0 on success, -1 if any write failed
+	int Close();
+
+	void Append(const char * str, size_t length);
+	void Append(const char * str);
+	void AppendChar(char c) {
+		Reserve(1);
+		m_pBuffer[m_Length++] = c;
+	}
+	void AppendInt(int value) {
+		Reserve(16);
+		m_Length = FormatInt(m_pBuffer + m_Length, value) - m_pBuffer;
+	}
+	void AppendDouble(double value) {
+		Reserve(32);
+		m_Length = FormatDouble(m_pBuffer + m_Length, value) - m_pBuffer;
+	}
+
+	// write out the buffered text
+	void Flush();
+
+protected:
+	FILE * m_pFile;
+	char * m_pBuffer;
+	size_t m_Capacity;
+	size_t m_Length;
+	int m_Error;
+
+	void Reserve(size_t length) {
+		if (m_Length + length > m_Capacity)
+			Flush();
+	}
+};
+
+#endif
@@ -12,30 +12,80 @@
 
 #include "interpolator.h"
 #include "motion.h"
+#include "parallel.h"
+#include "keyframeselector.h"
 #include </Users/zhiyixu/Downloads/armadillo-3.800.1/include/armadillo>
 
 Skeleton *pSkeleton_NoDof = NULL;    // skeleton as read from an ASF file (input)
 
 int main(int argc, char **argv)
 {
-	if (argc != 7) {
+	// options after the six positional arguments
+	bool streaming = false;
+	bool resampling = false;
+	double inputRate = 0, outputRate = 0;
+	bool selecting = false;
+	KeyframeError errorType = ANGLE_ERROR;
+	double maxError = 0;
+	bool badOption = false;
+	for (int i = 7; i < argc; i++) {
+		if (strcmp(argv[i], "-stream") == 0)
+			streaming = true;
+		else if ((strcmp(argv[i], "-threads") == 0) && (i + 1 < argc) && (atoi(argv[i + 1]) > 0))
+			SetNumThreads(atoi(argv[++i]));
+		else if ((strcmp(argv[i], "-rate") == 0) && (i + 2 < argc) && (atof(argv[i + 1]) > 0)
+				&& (atof(argv[i + 2]) > 0)) {
+			resampling = true;
+			inputRate = atof(argv[i + 1]);
+			outputRate = atof(argv[i + 2]);
+			i += 2;
+		}
+		else if ((strcmp(argv[i], "-select") == 0) && (i + 2 < argc) && (atof(argv[i + 2]) >= 0)
+				&& ((strcmp(argv[i + 1], "angle") == 0) || (strcmp(argv[i + 1], "position") == 0))) {
+			selecting = true;
+			errorType = (strcmp(argv[i + 1], "angle") == 0) ? ANGLE_ERROR : POSITION_ERROR;
+			maxError = atof(argv[i + 2]);
+			i += 2;
+		}
+		else
+			badOption = true;
+	}
+
+	if ((argc < 7) || badOption) {
 		printf("Interpolates motion capture data.");
 		printf(
-				"Usage: %s <input skeleton file> <input motion capture file> <interpolation type> <angle representation for interpolation> <N> <output motion capture file>\n",
+				"Usage: %s <input skeleton file> <input motion capture file> <interpolation type> <angle representation for interpolation> <N> <output motion capture file> [-stream] [-threads <T>] [-rate <I> <O>] [-select <angle|position> <E>]\n",
 				argv[0]);
 		printf("  interpolation method:\n");
 		printf("    l: linear\n");
 		printf("    b: Bezier\n");
-		printf("    lik: linear with IK (only works with quaternions)\n");
-		printf("    bik: Bezier with IK (only works with quaternions)\n");
+		printf("    s: SQUAD (only works with quaternions)\n");
+		printf("    c: Catmull-Rom (tangents scaled by the keyframe spacing)\n");
+		printf("    lik, bik, sik, cik: the same with IK (only works with quaternions)\n");
 		printf("  angle representation for interpolation:\n");
 		printf("    e: Euler angles\n");
 		printf("    q: quaternions\n");
 		printf("  N: number of skipped frames or a file contains the position of keyframes, the file name must ends with .txt\n");
+		printf("  input and output motions may be binary motion files; output names ending with .amcb are written as such\n");
+		printf("  -stream: read, interpolate and write the motion frame by frame, in constant memory (AMC files only)\n");
+		printf("    a motion file named - is standard input / output, which implies -stream\n");
+		printf("  -threads T: use T threads to load and interpolate the motion (default: all hardware threads)\n");
+		printf("    the output does not depend on T; with IK, the segments are also interpolated in parallel\n");
+		printf("  -rate I O: resample the motion from I to O frames per second (every input frame is a\n");
+		printf("    keyframe; N should be 0); the output is written as it is computed (no IK)\n");
+		printf("  -select angle E: choose as few keyframes as possible (instead of N) such that no bone\n");
+		printf("    orientation is off by more than E degrees\n");
+		printf("  -select position E: the same, for the bone tip positions (E in skeleton units)\n");
 		printf("Example: %s skeleton.asf motion.amc l e 5 outputMotion.amc\n",
 				argv[0]);
 		printf("Example: %s skeleton.asf motion.amc bik q keyFrame.txt outputMotion.amc\n",
 				argv[0]);
+		printf("Example: cat motion.amc | %s skeleton.asf - b q 5 - > outputMotion.amc\n",
+				argv[0]);
+		printf("Example: %s skeleton.asf motion.amc b q 0 outputMotion.amcb -rate 120 30\n",
+				argv[0]);
+		printf("Example: %s skeleton.asf motion.amc b q 0 outputMotion.amc -select angle 2\n",
+				argv[0]);
 		return -1;
 	}
 
@@ -46,10 +96,29 @@ int main(int argc, char **argv)
 	char *NString = argv[5];
 	char *outputMotionCaptureFile = argv[6];
 	bool enableIKSolver = false;
+	if ((strcmp(inputMotionCaptureFile, "-") == 0) || (strcmp(outputMotionCaptureFile, "-") == 0))
+		streaming = true;
+	// resampling reads the whole input motion, and always writes the output as it goes
+	if (resampling) {
+		if (strcmp(inputMotionCaptureFile, "-") == 0) {
+			printf("Error: -rate needs an input motion file.\n");
+			exit(1);
+		}
+		streaming = false;
+	}
+	// keyframe selection compares the interpolated motion with the whole input motion
+	if (selecting && (streaming || resampling)) {
+		printf("Error: -select cannot be combined with -stream, standard input / output or -rate.\n");
+		exit(1);
+	}
+	// progress messages go to standard error when the motion goes to standard output
+	if (strcmp(outputMotionCaptureFile, "-") == 0)
+		ReserveStandardOutput();
 
 	Skeleton *pSkeleton = NULL;    // skeleton as read from an ASF file (input)
 
 	Motion *pInputMotion = NULL; // motion as read from an AMC file (input)
+	AMCReader *pInputReader = NULL; // motion read frame by frame (input, streaming)
 
 	printf("Loading skeleton from %s...\n", inputSkeletonFile);
 	try {
@@ -63,39 +132,48 @@ int main(int argc, char **argv)
 	// load a copy of original skeleton to store degree of freedom info for IK Solver
 	pSkeleton_NoDof = new Skeleton(inputSkeletonFile, MOCAP_SCALE);
 
-	printf("Loading input motion from %s...\n", inputMotionCaptureFile);
-	try {
-		pInputMotion = new Motion(inputMotionCaptureFile, MOCAP_SCALE,
-				pSkeleton);
-	} catch (int exceptionCode) {
-		printf("Error: failed to load motion from %s. Code: %d\n",
-				inputMotionCaptureFile, exceptionCode);
-		exit(1);
+	if (streaming) {
+		printf("Streaming input motion from %s...\n", inputMotionCaptureFile);
+		pInputReader = new AMCReader(pSkeleton, MOCAP_SCALE);
+		if (pInputReader->Open(inputMotionCaptureFile) != 0) {
+			printf("Error: failed to open motion %s.\n", inputMotionCaptureFile);
+			exit(1);
+		}
+	}
+	else {
+		printf("Loading input motion from %s...\n", inputMotionCaptureFile);
+		try {
+			pInputMotion = new Motion(inputMotionCaptureFile, MOCAP_SCALE,
+					pSkeleton);
+		} catch (int exceptionCode) {
+			printf("Error: failed to load motion from %s. Code: %d\n",
+					inputMotionCaptureFile, exceptionCode);
+			exit(1);
+		}
 	}
 
 	pSkeleton->enableAllRotationalDOFs();
 
 	InterpolationType interpolationType;
 
-	if (strcmp(interpolationTypeString, "lik") == 0) {
-		enableIKSolver = true;
-		interpolationType = LINEAR;
-	}
-	else if (strcmp(interpolationTypeString, "bik") == 0) {
-		enableIKSolver = true;
-		interpolationType = BEZIER;
-	}
-	else if (interpolationTypeString[0] == 'l')
+	if (interpolationTypeString[0] == 'l')
 		interpolationType = LINEAR;
 	else if (interpolationTypeString[0] == 'b')
 		interpolationType = BEZIER;
+	else if (interpolationTypeString[0] == 's')
+		interpolationType = SQUAD;
+	else if (interpolationTypeString[0] == 'c')
+		interpolationType = CATMULL_ROM;
 	else {
 		printf("Error: unknown interpolation type: %s\n",
 				interpolationTypeString);
 		exit(1);
 	}
-	printf("Interpolation type is: %s\n",
-			(interpolationType == LINEAR) ? "LINEAR" : "BEZIER");
+	// lik, bik, sik, cik
+	if (strcmp(interpolationTypeString + 1, "ik") == 0)
+		enableIKSolver = true;
+	const char * interpolationTypeNames[4] = { "LINEAR", "BEZIER", "SQUAD", "CATMULL_ROM" };
+	printf("Interpolation type is: %s\n", interpolationTypeNames[interpolationType]);
 
 
 	AngleRepresentation angleRepresentation;
@@ -110,10 +188,18 @@ int main(int argc, char **argv)
 				angleRepresentationString);
 		exit(1);
 	}
+	if ((interpolationType == SQUAD) && (angleRepresentation == EULER)) {
+		printf("Error: SQUAD only interpolates quaternions.\n");
+		exit(1);
+	}
 	printf("Angle representation for interpolation is: %s\n",
 			(angleRepresentation == EULER) ? "EULER" : "QUATERNION");
 	printf("IK Solver is: %s\n",
 			enableIKSolver ? "ON" : "OFF");
+	if (resampling && enableIKSolver) {
+		printf("Error: -rate does not support IK.\n");
+		exit(1);
+	}
 
 	Interpolator interpolator;
 	interpolator.SetInterpolationType(interpolationType);
@@ -134,7 +220,8 @@ int main(int argc, char **argv)
 		if (strcmp(NString, "0") == 0) {
 			// no interpolation
 			printf("N=%d\n", N);
-			interpolator.SetTimeUniformKeyframe(N, pInputMotion->GetNumFrames());
+			if (!streaming)
+				interpolator.SetTimeUniformKeyframe(N, pInputMotion->GetNumFrames());
 		}
 		else {
 			// read key frame position from a file
@@ -153,7 +240,69 @@ int main(int argc, char **argv)
 	else {
 		// time uniform interpolation
 		printf("N=%d\n", N);
-		interpolator.SetTimeUniformKeyframe(N, pInputMotion->GetNumFrames());
+		if (!streaming)
+			interpolator.SetTimeUniformKeyframe(N, pInputMotion->GetNumFrames());
+	}
+
+	if (selecting) {
+		printf("Selecting keyframes with a maximum %s error of %g...\n",
+				(errorType == ANGLE_ERROR) ? "angle" : "position", maxError);
+		KeyframeSelector selector(&interpolator, pInputMotion, errorType);
+		int numKeyframes = selector.Select(maxError);
+		if (numKeyframes < 0)
+			exit(1);
+		printf("Selected %d keyframes of %d frames.\n", numKeyframes, pInputMotion->GetNumFrames());
+	}
+
+	size_t outputLength = strlen(outputMotionCaptureFile);
+	bool binaryOutput = (outputLength > 5) && (strcmp(outputMotionCaptureFile + outputLength - 5, ".amcb") == 0);
+	int forceAllJointsBe3DOF = 1;
+
+	if (resampling) {
+		FrameWriter * pWriter;
+		int code;
+		if (binaryOutput) {
+			BinaryMotionWriter * pBinaryWriter = new BinaryMotionWriter(pSkeleton, MOCAP_SCALE);
+			code = pBinaryWriter->Open(outputMotionCaptureFile, Interpolator::GetNumResampledFrames(
+					pInputMotion->GetNumFrames(), inputRate, outputRate));
+			pWriter = pBinaryWriter;
+		}
+		else {
+			AMCWriter * pAMCWriter = new AMCWriter(pSkeleton, MOCAP_SCALE, forceAllJointsBe3DOF);
+			code = pAMCWriter->Open(outputMotionCaptureFile);
+			pWriter = pAMCWriter;
+		}
+		if (code != 0)
+			exit(1);
+		printf("Resampling %s from %g to %g frames per second into %s...\n", inputMotionCaptureFile,
+				inputRate, outputRate, outputMotionCaptureFile);
+		int numFrames = interpolator.Resample(pInputMotion, inputRate, outputRate, pWriter);
+		if ((pWriter->Close() != 0) || (numFrames < 0)) {
+			printf("Error: resampling failed.\n");
+			exit(1);
+		}
+		printf("Resampling completed. Write %d samples to '%s'\n", numFrames, outputMotionCaptureFile);
+		delete pWriter;
+		return 0;
+	}
+
+	if (streaming) {
+		if (binaryOutput) {
+			printf("Error: binary motion files cannot be streamed.\n");
+			exit(1);
+		}
+		AMCWriter writer(pSkeleton, MOCAP_SCALE, forceAllJointsBe3DOF);
+		if (writer.Open(outputMotionCaptureFile) != 0)
+			exit(1);
+		printf("Interpolating %s into %s...\n", inputMotionCaptureFile, outputMotionCaptureFile);
+		int numFrames = interpolator.InterpolateStream(pInputReader, &writer, N);
+		if ((writer.Close() != 0) || (numFrames < 0)) {
+			printf("Error: streaming interpolation failed.\n");
+			exit(1);
+		}
+		printf("Interpolation completed. Write %d samples to '%s'\n", numFrames, outputMotionCaptureFile);
+		delete pInputReader;
+		return 0;
 	}
 
 	printf("Interpolating...\n");
@@ -167,9 +316,11 @@ int main(int argc, char **argv)
 
 	printf("Writing output motion capture file to %s...\n",
 			outputMotionCaptureFile);
-	int forceAllJointsBe3DOF = 1;
-	pOutputMotion->writeAMCfile(outputMotionCaptureFile, 0.06,
-			forceAllJointsBe3DOF);
+	if (binaryOutput)
+		pOutputMotion->writeBinaryFile(outputMotionCaptureFile, 0.06);
+	else
+		pOutputMotion->writeAMCfile(outputMotionCaptureFile, 0.06,
+				forceAllJointsBe3DOF);
 
 	return 0;
 }
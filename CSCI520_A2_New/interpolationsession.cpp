@@ -0,0 +1,135 @@
+/*
+ interpolationsession.cpp
+
+ See interpolationsession.h.
+
+ */
+#include <stdio.h>
+#include <string.h>
+#include "interpolationsession.h"
+#include "parallel.h"
+
+InterpolationSession::InterpolationSession(Interpolator * pInterpolator, Motion * pInputMotion)
+{
+	m_pInterpolator = pInterpolator;
+	m_pInputMotion = pInputMotion;
+	pInterpolator->Interpolate(pInputMotion, &m_pOutputMotion, 0);
+
+	// the track of Interpolate, kept for the segments that are interpolated again
+	int numKeyframes = pInterpolator->num_keyFrames;
+	int numRotations = pInterpolator->m_NumRotations;
+	m_Track = NULL;
+	if (pInterpolator->m_AngleRepresentation == QUATERNION) {
+		m_Track = new Quaternion<double>[(size_t) numKeyframes * numRotations];
+		for (int keyFrameID = 1; keyFrameID <= numKeyframes; keyFrameID++)
+			pInterpolator->KeyframeQuaternions(pInputMotion->GetFrame(pInterpolator->keyFramePos[keyFrameID]),
+					m_Track + (size_t) (keyFrameID - 1) * numRotations);
+	}
+
+	m_NumChanged = 0;
+	m_Changed = new int[numKeyframes + 1];
+	m_IsChanged = new char[numKeyframes + 1];
+	memset(m_IsChanged, 0, numKeyframes + 1);
+	m_Segments = new int[numKeyframes + 1];
+	m_IsSegment = new char[numKeyframes + 1];
+	memset(m_IsSegment, 0, numKeyframes + 1);
+}
+
+InterpolationSession::~InterpolationSession()
+{
+	delete m_pOutputMotion;
+	delete[] m_Track;
+	delete[] m_Changed;
+	delete[] m_IsChanged;
+	delete[] m_Segments;
+	delete[] m_IsSegment;
+}
+
+void InterpolationSession::SetKeyframe(int keyFrameID, const double * frame)
+{
+	if ((keyFrameID < 1) || (keyFrameID > m_pInterpolator->num_keyFrames)) {
+		printf("Error: there is no keyframe %d.\n", keyFrameID);
+		return;
+	}
+	m_pInputMotion->SetFrame(m_pInterpolator->keyFramePos[keyFrameID], frame);
+	KeyframeChanged(keyFrameID);
+}
+
+void InterpolationSession::KeyframeChanged(int keyFrameID)
+{
+	if ((keyFrameID < 1) || (keyFrameID > m_pInterpolator->num_keyFrames)) {
+		printf("Error: there is no keyframe %d.\n", keyFrameID);
+		return;
+	}
+	if (!m_IsChanged[keyFrameID]) {
+		m_IsChanged[keyFrameID] = 1;
+		m_Changed[m_NumChanged++] = keyFrameID;
+	}
+}
+
+// Segments of InterpolationSession::Update, one per task
+struct InterpolationSession::SessionJob {
+	Interpolator * interpolator;
+	Interpolator::SegmentKernel kernel;
+	Motion * pInputMotion;
+	Motion * pOutputMotion;
+	const Quaternion<double> * track;
+	const int * segments;
+};
+
+void InterpolationSession::InterpolateSegments(int index, void * data)
+{
+	SessionJob * job = (SessionJob *) data;
+	job->interpolator->InterpolateKeyframeSegment(job->kernel, job->segments[index],
+			job->pInputMotion, job->pOutputMotion, job->track);
+}
+
+int InterpolationSession::Update()
+{
+	Interpolator * interpolator = m_pInterpolator;
+	int numKeyframes = interpolator->num_keyFrames;
+	int numRotations = interpolator->m_NumRotations;
+	int frameSize = m_pInputMotion->GetFrameSize();
+
+	// Segment n (from keyframe n to n + 1) depends on keyframes n and n + 1, and for
+	// the cubic types (all but LINEAR), also on n - 1 and n + 2. The quaternions of a
+	// keyframe only depend on the keyframe itself (see Interpolator::KeyframeQuaternions).
+	int before = (interpolator->m_InterpolationType != LINEAR) ? 2 : 1;
+	int after = (interpolator->m_InterpolationType != LINEAR) ? 1 : 0;
+	int numSegments = 0;
+	for (int i = 0; i < m_NumChanged; i++) {
+		int keyFrameID = m_Changed[i];
+		const double * keyframe = m_pInputMotion->GetFrame(interpolator->keyFramePos[keyFrameID]);
+		m_pOutputMotion->SetFrame(interpolator->keyFramePos[keyFrameID], keyframe);
+		if (m_Track != NULL)
+			interpolator->KeyframeQuaternions(keyframe, m_Track + (size_t) (keyFrameID - 1) * numRotations);
+
+		for (int segment = keyFrameID - before; segment <= keyFrameID + after; segment++)
+			if ((segment >= 1) && (segment < numKeyframes) && !m_IsSegment[segment]) {
+				m_IsSegment[segment] = 1;
+				m_Segments[numSegments++] = segment;
+			}
+		m_IsChanged[keyFrameID] = 0;
+	}
+	m_NumChanged = 0;
+
+	// the interpolated frames must start out zeroed
+	for (int i = 0; i < numSegments; i++) {
+		int segment = m_Segments[i];
+		int start = interpolator->keyFramePos[segment];
+		int end = interpolator->keyFramePos[segment + 1];
+		memset(m_pOutputMotion->GetFrame(start) + frameSize, 0,
+				sizeof(double) * (size_t) (end - start - 1) * frameSize);
+		m_IsSegment[segment] = 0;
+	}
+
+	SessionJob job;
+	job.interpolator = interpolator;
+	job.kernel = interpolator->GetSegmentKernel();
+	job.pInputMotion = m_pInputMotion;
+	job.pOutputMotion = m_pOutputMotion;
+	job.track = m_Track;
+	job.segments = m_Segments;
+	ParallelFor(numSegments, InterpolateSegments, &job, GetNumThreads());
+	return numSegments;
+}
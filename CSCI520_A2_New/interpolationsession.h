@@ -0,0 +1,76 @@
+/*
+ interpolationsession.h
+
+ Interpolated motion that is kept up to date while keyframes are edited.
+
+ The session interpolates the input motion once, as Interpolator::Interpolate does,
+ and keeps the output motion and the quaternion track of the keyframes. When keyframe
+ postures change, Update re-interpolates only the segments that depend on them:
+ the two segments next to a keyframe for linear interpolation, and two segments on
+ each side for Bezier, SQUAD and Catmull-Rom interpolation (the control points of a
+ segment depend on the keyframes before and after it). The output is the same as that of
+ Interpolate with the edited keyframes.
+
+ The keyframe positions, the interpolation settings and the frames between keyframes
+ (which give the IK targets) must not change during the session.
+
+ */
+
+#ifndef _INTERPOLATIONSESSION_H
+#define _INTERPOLATIONSESSION_H
+
+#include "motion.h"
+#include "interpolator.h"
+
+class InterpolationSession {
+public:
+	// interpolates pInputMotion with the keyframes and settings of pInterpolator, which
+	// must stay alive (and unchanged) during the session
+	InterpolationSession(Interpolator * pInterpolator, Motion * pInputMotion);
+	~InterpolationSession();
+
+	// interpolated motion, owned by the session; up to date after Update
+	Motion * GetOutputMotion() {
+		return m_pOutputMotion;
+	}
+
+	int GetNumKeyframes() {
+		return m_pInterpolator->num_keyFrames;
+	}
+	// frame index of keyframe keyFrameID (starting from 1, as in Interpolator)
+	int GetKeyframePos(int keyFrameID) {
+		return m_pInterpolator->keyFramePos[keyFrameID];
+	}
+
+	// replace the posture of keyframe keyFrameID in the input motion with frame
+	// (a packed frame, see PostureLayout); prints an error and leaves the input motion
+	// as it is if there is no keyframe keyFrameID
+	void SetKeyframe(int keyFrameID, const double * frame);
+	// the posture of keyframe keyFrameID was changed in the input motion directly
+	void KeyframeChanged(int keyFrameID);
+
+	// re-interpolate the segments that depend on the keyframes changed since the last
+	// Update; returns the number of segments interpolated
+	int Update();
+
+protected:
+	Interpolator * m_pInterpolator;
+	Motion * m_pInputMotion;
+	Motion * m_pOutputMotion;
+	// quaternion track (see Interpolator::Interpolate), NULL for EULER
+	Quaternion<double> * m_Track;
+
+	// keyframe IDs changed since the last Update, and a flag per keyframe ID
+	int m_NumChanged;
+	int * m_Changed;
+	char * m_IsChanged;
+	// segments (by start keyframe ID) to interpolate in Update, and a flag per segment
+	int * m_Segments;
+	char * m_IsSegment;
+	// ParallelFor task over the segments of a SessionJob (see interpolationsession.cpp)
+	struct SessionJob;
+	static void InterpolateSegments(int index, void * data);
+};
+
+#endif
+
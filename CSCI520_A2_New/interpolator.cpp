@@ -7,6 +7,10 @@
 #include "transform.h"
 #include "types.h"
 #include "IKSolver.h"
+#include "parallel.h"
+#include "quaternionarrays.h"
+#include "motionevaluator.h"
+#include "cubiccurves.h"
 
 Interpolator::Interpolator()
 {
@@ -16,49 +20,79 @@ Interpolator::Interpolator()
 	//set default angle representation to use for interpolation
 	m_AngleRepresentation = EULER;
 
+	m_IKJacobian = ANALYTIC_JACOBIAN;
+
+	keyFramePos = NULL;
+	keyFramePosCapacity = 0;
 	num_keyFrames = 0;
+	m_pSkeleton = NULL;
 }
 
 Interpolator::~Interpolator()
 {
+	delete[] keyFramePos;
 }
 
+// The rotations of a frame as structure of arrays, for SlerpArrays
+struct RotationQuaternions {
+	double s[MAX_BONES_IN_ASF_FILE];
+	double x[MAX_BONES_IN_ASF_FILE];
+	double y[MAX_BONES_IN_ASF_FILE];
+	double z[MAX_BONES_IN_ASF_FILE];
+
+	QuaternionArrays Arrays() {
+		QuaternionArrays arrays = { s, x, y, z };
+		return arrays;
+	}
+	void Set(int rotation, const Quaternion<double> & q) {
+		s[rotation] = q.Gets();
+		x[rotation] = q.Getx();
+		y[rotation] = q.Gety();
+		z[rotation] = q.Getz();
+	}
+	Quaternion<double> Get(int rotation) const {
+		return Quaternion<double>(s[rotation], x[rotation], y[rotation], z[rotation]);
+	}
+};
+
+// Segments of Interpolator::Interpolate, interpolated segmentsPerTask at a time
+struct Interpolator::SegmentJob {
+	Interpolator * interpolator;
+	Motion * pInputMotion;
+	Motion * pOutputMotion;
+	SegmentKernel kernel;
+	const Quaternion<double> * track;
+	int numSegments;
+	int segmentsPerTask;
+};
+
 //Create interpolated motion
 void Interpolator::Interpolate(Motion *pInputMotion, Motion **pOutputMotion,
 		int N)
 {
+	// every type needs a first and a last keyframe (and Bezier the ones next to them)
+	if ((num_keyFrames < 2) || ((m_InterpolationType == BEZIER) && (num_keyFrames <= 3)))
+		throw "Too less key frames to do the Interpolation";
+	if ((m_InterpolationType == SQUAD) && (m_AngleRepresentation == EULER))
+		throw "SQUAD only interpolates quaternions";
+
 	//Allocate new motion
 	*pOutputMotion = new Motion(pInputMotion->GetNumFrames(),
 			pInputMotion->GetSkeleton());
+	m_pSkeleton = pInputMotion->GetSkeleton();
 
-	//Perform the interpolation
-	if ((m_InterpolationType == LINEAR) && (m_AngleRepresentation == EULER))
-		LinearInterpolationEuler(pInputMotion, *pOutputMotion, N);
-	else if ((m_InterpolationType == LINEAR)
-			&& (m_AngleRepresentation == QUATERNION))
-		LinearInterpolationQuaternion(pInputMotion, *pOutputMotion, N);
-	else if ((m_InterpolationType == BEZIER)
-			&& (m_AngleRepresentation == EULER))
-		BezierInterpolationEuler(pInputMotion, *pOutputMotion, N);
-	else if ((m_InterpolationType == BEZIER)
-			&& (m_AngleRepresentation == QUATERNION))
-		BezierInterpolationQuaternion(pInputMotion, *pOutputMotion, N);
-	else {
-		printf("Error: unknown interpolation / angle representation type.\n");
-		exit(1);
-	}
+	int inputLength = pInputMotion->GetNumFrames(); // frames are indexed 0, ..., inputLength-1
 
-	// record for drawing graph
-	for(int frame = 1 ; frame <=  1000 ; frame ++)
-	{
-		 printf("%d %lf\n",frame,((*pOutputMotion)->GetPosture(frame))->bone_rotation[18][0]);
+	// quaternion track: the rotations of every keyframe, converted once
+	// (keyframe ID k is at track + (k - 1) * m_NumRotations)
+	FindRotations();
+	Quaternion<double> * track = NULL;
+	if (m_AngleRepresentation == QUATERNION) {
+		track = new Quaternion<double>[(size_t) num_keyFrames * m_NumRotations];
+		for (int keyFrameID = 1; keyFrameID <= num_keyFrames; keyFrameID++)
+			KeyframeQuaternions(pInputMotion->GetFrame(keyFramePos[keyFrameID]),
+					track + (size_t) (keyFrameID - 1) * m_NumRotations);
 	}
-}
-
-void Interpolator::LinearInterpolationEuler(Motion *pInputMotion,
-		Motion *pOutputMotion, int N)
-{
-	int inputLength = pInputMotion->GetNumFrames(); // frames are indexed 0, ..., inputLength-1
 
 	// keyframe ID  starts from 1
 	// frame number starts from 0
@@ -66,389 +100,744 @@ void Interpolator::LinearInterpolationEuler(Motion *pInputMotion,
 	// keyframe ID  1       2        3  ..
 	// in non time uniform situation, the interval is different
 	// To get KeyFrame Position, use keyFramePos array
-	for (int keyFrameID = 1; keyFrameID < num_keyFrames; keyFrameID++) {
-		int startKeyframe = keyFramePos[keyFrameID];
-		int endKeyframe = keyFramePos[keyFrameID + 1];
-
-		Posture *startPosture = pInputMotion->GetPosture(startKeyframe);
-		Posture *endPosture = pInputMotion->GetPosture(endKeyframe);
-
-		// copy start and end keyframe
-		pOutputMotion->SetPosture(startKeyframe, *startPosture);
-		pOutputMotion->SetPosture(endKeyframe, *endPosture);
-
-		// interpolate in between
-		for (int frame = 1; frame <= endKeyframe - startKeyframe - 1; frame++) {
-			Posture interpolatedPosture;
-			double t = 1.0 * frame / (endKeyframe - startKeyframe );
-
-			// interpolate root position
-			interpolatedPosture.root_pos = startPosture->root_pos * (1 - t)
-					+ endPosture->root_pos * t;
-
-			// interpolate bone rotations
-			for (int bone = 0; bone < MAX_BONES_IN_ASF_FILE; bone++)
-				interpolatedPosture.bone_rotation[bone] =
-						startPosture->bone_rotation[bone] * (1 - t)
-								+ endPosture->bone_rotation[bone] * t;
-
-			pOutputMotion->SetPosture(startKeyframe + frame,
-					interpolatedPosture);
-		}
+	// The segments only read the input motion and the skeleton and write disjoint output
+	// frames, so they are interpolated in parallel, a few consecutive segments per task
+	// (the IK solver poses a SkeletonPose of its own in every segment).
+	SegmentJob job;
+	job.interpolator = this;
+	job.pInputMotion = pInputMotion;
+	job.pOutputMotion = *pOutputMotion;
+	job.kernel = GetSegmentKernel();
+	job.track = track;
+	job.numSegments = num_keyFrames - 1;
+	int numThreads = GetNumThreads();
+	job.segmentsPerTask = job.numSegments / (8 * numThreads) + 1;
+	if (job.numSegments > 0) {
+		int numTasks = (job.numSegments + job.segmentsPerTask - 1) / job.segmentsPerTask;
+		ParallelFor(numTasks, InterpolateSegments, &job, numThreads);
 	}
+	delete[] track;
 
-	for (int frame = keyFramePos[num_keyFrames] + 1; frame < inputLength; frame++)
-		pOutputMotion->SetPosture(frame, *(pInputMotion->GetPosture(frame)));
+	for (int frame = keyFramePos[num_keyFrames]; frame < inputLength; frame++)
+		(*pOutputMotion)->SetFrame(frame, pInputMotion->GetFrame(frame));
 }
 
+MotionEvaluator * Interpolator::CreateEvaluator(Motion * pInputMotion)
+{
+	// (keyFramePos is not allocated before the first keyframe)
+	if (num_keyFrames < 1) {
+		printf("Error: too few keyframes to interpolate.\n");
+		throw 1;
+	}
+	return new MotionEvaluator(pInputMotion, keyFramePos + 1, num_keyFrames,
+			m_InterpolationType, m_AngleRepresentation);
+}
 
-void Interpolator::BezierInterpolationEuler(Motion *pInputMotion,
-		Motion *pOutputMotion, int N)
+// time of output frame j of Resample, in input frames
+static double ResampledTime(int frame, double inputRate, double outputRate)
 {
-	int inputLength = pInputMotion->GetNumFrames(); // frames are indexed 0, ..., inputLength-1
+	return frame * inputRate / outputRate;
+}
 
-	// keyframe ID  starts from 1
-	// frame number starts from 0
-	// frame number 0 ..... 21 ..... 62 ..
-	// keyframe ID  1       2        3  ..
-	// in non time uniform situation, the interval is different
-	// To get KeyFrame Position, use keyFramePos array
-	if (num_keyFrames <= 3)
-		throw "Too less key frames to do the Interpolation";
-	for (int keyFrameID = 1; keyFrameID < num_keyFrames; keyFrameID++) {
-		int startKeyframe = keyFramePos[keyFrameID];
-		int endKeyframe = keyFramePos[keyFrameID + 1];
-		// p_n,p_(n+1)
-		Posture *startPosture = pInputMotion->GetPosture(startKeyframe);
-		Posture *endPosture = pInputMotion->GetPosture(endKeyframe);
-
-		// copy start and end keyframe
-		pOutputMotion->SetPosture(startKeyframe, *startPosture);
-		pOutputMotion->SetPosture(endKeyframe, *endPosture);
-
-		// interpolate in between
-		for (int frame = 1; frame <= endKeyframe - startKeyframe - 1; frame++) {
-			Posture interpolatedPosture;
-			double t = 1.0 * frame / (endKeyframe - startKeyframe);
-
-			// interpolate root position
-			// a_n,b_(n+1)
-			vector a, b;
-			// p_(n-1),p_n,p_(n+1),p_(n+2)
-			vector p0, p1, p2, p3;
-			p1 = startPosture->root_pos;
-			p2 = endPosture->root_pos;
-
-			// a_n
-			// special case for a1
-			if (keyFrameID == 1) {
-				p3 = pInputMotion->GetPosture(keyFramePos[keyFrameID + 2])->root_pos;
-				a = Lerp(p1, Lerp(p3, p2, 2), 1.0 / 3);
-			}
-			else {
-				p0 = pInputMotion->GetPosture(keyFramePos[keyFrameID - 1])->root_pos;
-				// (a_n)_
-				vector a_ = Lerp(Lerp(p0, p1, 2), p2, 0.5);
-				a = Lerp(p1, a_, 1.0 / 3);
-			}
+int Interpolator::GetNumResampledFrames(int numInputFrames, double inputRate, double outputRate)
+{
+	if (numInputFrames < 1)
+		return 0;
+	int numFrames = (int) ((numInputFrames - 1) * outputRate / inputRate) + 1;
+	// the division above may round across an integer
+	while (ResampledTime(numFrames, inputRate, outputRate) <= numInputFrames - 1)
+		numFrames++;
+	while (ResampledTime(numFrames - 1, inputRate, outputRate) > numInputFrames - 1)
+		numFrames--;
+	return numFrames;
+}
 
-			// b_(n+1)
-			// special case for bn
-			if (keyFrameID == num_keyFrames - 1)
-				b = Lerp(p2, Lerp(p0, p1, 2), 1.0 / 3);
-			else {
-				p3 = pInputMotion->GetPosture(keyFramePos[keyFrameID + 2])->root_pos;
-				// (a_n+1)_
-				vector a_1 = Lerp(Lerp(p1, p2, 2), p3, 0.5);
-				b = Lerp(p2, a_1, -1.0 / 3);
-			}
-			interpolatedPosture.root_pos = DeCasteljauEuler(t, p1, a, b, p2);
-
-			// interpolate bone rotations
-			for (int bone = 0; bone < MAX_BONES_IN_ASF_FILE; bone++) {
-				// interpolate bone rotation
-				// a_n,b_(n+1)
-				vector a, b;
-				// p_(n-1),p_n,p_(n+1),p_(n+2)
-				vector p0, p1, p2, p3;
-				p1 = startPosture->bone_rotation[bone];
-				p2 = endPosture->bone_rotation[bone];
-
-				// a_n
-				// special case for a1
-				if (keyFrameID == 1) {
-					p3 = pInputMotion->GetPosture(keyFramePos[keyFrameID + 2])->bone_rotation[bone];
-					a = Lerp(p1, Lerp(p3, p2, 2), 1.0 / 3);
-				}
-				else {
-					p0 = pInputMotion->GetPosture(keyFramePos[keyFrameID - 1])->bone_rotation[bone];
-					// (a_n)_
-					vector a_ = Lerp(Lerp(p0, p1, 2), p2, 0.5);
-					a = Lerp(p1, a_, 1.0 / 3);
-				}
-
-				// b_(n+1)
-				// special case for bn
-				if (keyFrameID == num_keyFrames - 1)
-					b = Lerp(p2, Lerp(p0, p1, 2), 1.0 / 3);
-				else {
-					p3 = pInputMotion->GetPosture(keyFramePos[keyFrameID + 2])->bone_rotation[bone];
-					// (a_n+1)_
-					vector a_1 = Lerp(Lerp(p1, p2, 2), p3, 0.5);
-					b = Lerp(p2, a_1, -1.0 / 3);
-				}
-				interpolatedPosture.bone_rotation[bone] = DeCasteljauEuler(t, p1, a, b, p2);
+// Output frames of Resample, evaluated framesPerTask at a time
+struct ResampleJob {
+	const MotionEvaluator * evaluator;
+	double inputRate;
+	double outputRate;
+	int firstFrame; // output frame stored at frames
+	int numFrames;
+	int framesPerTask;
+	double * frames;
+};
+
+static void ResampleFrames(int index, void * data)
+{
+	ResampleJob * job = (ResampleJob *) data;
+	int frameSize = job->evaluator->GetFrameSize();
+	int first = index * job->framesPerTask;
+	int last = first + job->framesPerTask;
+	if (last > job->numFrames)
+		last = job->numFrames;
+	for (int i = first; i < last; i++)
+		job->evaluator->Evaluate(ResampledTime(job->firstFrame + i, job->inputRate, job->outputRate),
+				job->frames + (size_t) i * frameSize);
+}
 
-			}
-			pOutputMotion->SetPosture(startKeyframe + frame,
-					interpolatedPosture);
+int Interpolator::Resample(Motion * pInputMotion, double inputRate, double outputRate,
+		FrameWriter * pWriter)
+{
+	int numInputFrames = pInputMotion->GetNumFrames();
+	int frameSize = pInputMotion->GetFrameSize();
+	if (!(inputRate > 0) || !(outputRate > 0) || (numInputFrames < 1)) {
+		printf("Error: cannot resample %d frames from %g to %g frames per second.\n",
+				numInputFrames, inputRate, outputRate);
+		return -1;
+	}
+	if ((m_InterpolationType == BEZIER) && (numInputFrames <= 3)) {
+		printf("Error: Too less key frames to do the Interpolation.\n");
+		return -1;
+	}
+	int numOutputFrames = GetNumResampledFrames(numInputFrames, inputRate, outputRate);
+
+	// The input is covered by windows of keyframes, each sampled with its own evaluator,
+	// so that the control points kept at a time do not grow with the length of the
+	// motion. An evaluator also gets the keyframes around its window (at least 4 in
+	// all), which the control points of the first and last segment depend on. The
+	// frames of a window are evaluated in parallel, a batch at a time, and written in order.
+	const int segmentsPerWindow = 1024;
+	const int framesPerBatch = 512;
+	int * keyframes = new int[segmentsPerWindow + 4];
+	ResampleJob job;
+	job.inputRate = inputRate;
+	job.outputRate = outputRate;
+	job.frames = new double[(size_t) framesPerBatch * frameSize];
+	int numThreads = GetNumThreads();
+	job.framesPerTask = framesPerBatch / (4 * numThreads) + 1;
+
+	int frame = 0;
+	for (int first = 0; frame < numOutputFrames; first += segmentsPerWindow) {
+		int last = first + segmentsPerWindow;
+		if (last > numInputFrames - 1)
+			last = numInputFrames - 1;
+		int begin = (first > 0) ? first - 1 : 0;
+		int end = (last < numInputFrames - 1) ? last + 1 : last;
+		if (end - begin < 3)
+			begin = (end >= 3) ? end - 3 : 0;
+		for (int keyframe = begin; keyframe <= end; keyframe++)
+			keyframes[keyframe - begin] = keyframe;
+		MotionEvaluator evaluator(pInputMotion, keyframes, end - begin + 1,
+				m_InterpolationType, m_AngleRepresentation);
+		job.evaluator = &evaluator;
+
+		// the frames before the last keyframe of the window (or up to it, for the last window)
+		int endFrame = frame;
+		if (last == numInputFrames - 1)
+			endFrame = numOutputFrames;
+		else
+			while (ResampledTime(endFrame, inputRate, outputRate) < last)
+				endFrame++;
+
+		for (; frame < endFrame; frame += job.numFrames) {
+			job.firstFrame = frame;
+			job.numFrames = (endFrame - frame < framesPerBatch) ? endFrame - frame : framesPerBatch;
+			ParallelFor((job.numFrames + job.framesPerTask - 1) / job.framesPerTask, ResampleFrames,
+					&job, numThreads);
+			for (int i = 0; i < job.numFrames; i++)
+				pWriter->WriteFrame(job.frames + (size_t) i * frameSize);
 		}
+	}
 
+	delete[] keyframes;
+	delete[] job.frames;
+	return numOutputFrames;
+}
+
+// A keyframe in the window kept by InterpolateStream, followed by the input frames
+// up to the next keyframe
+struct StreamKeyframe {
+	double * frames; // frames[0] is the keyframe itself
+	int numFrames;
+	int capacity;
+	Quaternion<double> * quaternions; // rotations of the keyframe (see KeyframeQuaternions)
+};
+
+static double * AppendStreamFrame(StreamKeyframe * keyframe, int frameSize) {
+	if (keyframe->numFrames == keyframe->capacity) {
+		keyframe->capacity = (keyframe->capacity == 0) ? 16 : 2 * keyframe->capacity;
+		double * frames = new double[(size_t) keyframe->capacity * frameSize];
+		if (keyframe->numFrames > 0)
+			memcpy(frames, keyframe->frames, sizeof(double) * (size_t) keyframe->numFrames * frameSize);
+		delete[] keyframe->frames;
+		keyframe->frames = frames;
 	}
+	return keyframe->frames + (size_t) (keyframe->numFrames++) * frameSize;
+}
 
-	for (int frame = keyFramePos[num_keyFrames] + 1; frame < inputLength; frame++)
-		pOutputMotion->SetPosture(frame, *(pInputMotion->GetPosture(frame)));
+// frames before the first keyframe stay at the default posture
+static void WriteStreamLeadingFrames(AMCWriter * pWriter, double * frame, int frameSize, int * numFrames) {
+	memset(frame, 0, sizeof(double) * frameSize);
+	for (; *numFrames > 0; (*numFrames)--)
+		pWriter->WriteFrame(frame);
 }
 
-void Interpolator::LinearInterpolationQuaternion(Motion *pInputMotion,
-		Motion *pOutputMotion, int N)
+int Interpolator::InterpolateStream(AMCReader * pReader, AMCWriter * pWriter, int N)
 {
-	int inputLength = pInputMotion->GetNumFrames(); // frames are indexed 0, ..., inputLength-1
+	m_pSkeleton = pReader->GetSkeleton();
+	int frameSize = m_pSkeleton->getPostureLayout()->frameSize;
+	FindRotations();
+
+	// keyframes p_(n-1),p_n,p_(n+1),p_(n+2) of the segment being interpolated;
+	// segment p_n..p_(n+1) is written once p_(n+2) has been read (or the input ends).
+	// Bezier needs 4 keyframes, so nothing is written before the 4th has been read:
+	// with fewer, the input is rejected before any output.
+	StreamKeyframe window[4];
+	StreamKeyframe * keys[4];
+	for (int i = 0; i < 4; i++) {
+		window[i].frames = NULL;
+		window[i].numFrames = window[i].capacity = 0;
+		window[i].quaternions = new Quaternion<double>[m_NumRotations + 1];
+		keys[i] = &window[i];
+	}
+	int numKeys = 0;
+	int numKeyframesRead = 0;
+	int numLeadingFrames = 0; // frames before the first keyframe, not written yet
+	int minKeyframes = (m_InterpolationType == BEZIER) ? 4 : 3;
+
+	double * frame = new double[frameSize];
+	double * outputFrames = NULL;
+	int outputCapacity = 0;
+	int code;
+
+	for (int frameIndex = 0; (code = pReader->ReadFrame(frame)) == 1; frameIndex++) {
+		int isKeyframe;
+		if (num_keyFrames > 0)
+			isKeyframe = (numKeyframesRead < num_keyFrames)
+					&& (frameIndex == keyFramePos[numKeyframesRead + 1]);
+		else
+			isKeyframe = (frameIndex % (N + 1) == 0);
+
+		if (!isKeyframe) {
+			if (numKeys == 0)
+				numLeadingFrames++;
+			else
+				memcpy(AppendStreamFrame(keys[numKeys - 1], frameSize), frame, sizeof(double) * frameSize);
+			continue;
+		}
 
-	// keyframe ID  starts from 1
-	// frame number starts from 0
-	// frame number 0 ..... 21 ..... 62 ..
-	// keyframe ID  1       2        3  ..
-	// in non time uniform situation, the interval is different
-	// To get KeyFrame Position, use keyFramePos array
-	for (int keyFrameID = 1; keyFrameID < num_keyFrames; keyFrameID++) {
-		int startKeyframe = keyFramePos[keyFrameID];
-		int endKeyframe = keyFramePos[keyFrameID + 1];
-
-		Posture *startPosture = pInputMotion->GetPosture(startKeyframe);
-		Posture *endPosture = pInputMotion->GetPosture(endKeyframe);
-
-		// copy start and end keyframe
-		pOutputMotion->SetPosture(startKeyframe, *startPosture);
-		pOutputMotion->SetPosture(endKeyframe, *endPosture);
-
-		// interpolate in between
-		for (int frame = 1; frame <= endKeyframe - startKeyframe - 1; frame++) {
-			Posture interpolatedPosture;
-			double t = 1.0 * frame / (endKeyframe - startKeyframe);
-
-			// interpolate root position
-			interpolatedPosture.root_pos = startPosture->root_pos * (1 - t)
-					+ endPosture->root_pos * t;
-
-			// interpolate bone rotations
-			for (int bone = 0; bone < MAX_BONES_IN_ASF_FILE; bone++) {
-				Quaternion<double> start, end, result;
-				double startEuler[3], EndEuler[3], ResultEuler[3];
-				startPosture->bone_rotation[bone].getValue(startEuler);
-				endPosture->bone_rotation[bone].getValue(EndEuler);
-				Euler2Quaternion(startEuler, start);
-				Euler2Quaternion(EndEuler, end);
-				result = Slerp(start, end, t);
-				Quaternion2Euler(result, ResultEuler);
-				interpolatedPosture.bone_rotation[bone] = ResultEuler;
+		numKeyframesRead++;
+		keys[numKeys]->numFrames = 0;
+		memcpy(AppendStreamFrame(keys[numKeys], frameSize), frame, sizeof(double) * frameSize);
+		if (m_AngleRepresentation == QUATERNION)
+			KeyframeQuaternions(frame, keys[numKeys]->quaternions);
+		numKeys++;
+		if (numKeyframesRead < minKeyframes)
+			continue;
+		if (numKeyframesRead == minKeyframes)
+			WriteStreamLeadingFrames(pWriter, frame, frameSize, &numLeadingFrames);
+
+		// interpolate the segment between keys[numKeys - 3] and keys[numKeys - 2]
+		// (and with Bezier, the first time, the one held back before it)
+		for (int segment = (numKeyframesRead == minKeyframes) ? 0 : numKeys - 3; segment <= numKeys - 3; segment++) {
+			StreamKeyframe * start = keys[segment];
+			int segmentLength = start->numFrames;
+			if (segmentLength > outputCapacity) {
+				delete[] outputFrames;
+				outputCapacity = 2 * segmentLength;
+				outputFrames = new double[(size_t) outputCapacity * frameSize];
 			}
+			memset(outputFrames, 0, sizeof(double) * (size_t) segmentLength * frameSize);
+			InterpolateSegment((segment > 0) ? keys[segment - 1]->frames : NULL, start->frames,
+					keys[segment + 1]->frames, keys[segment + 2]->frames,
+					(segment > 0) ? keys[segment - 1]->quaternions : NULL, start->quaternions,
+					keys[segment + 1]->quaternions, keys[segment + 2]->quaternions,
+					(segment > 0) ? keys[segment - 1]->numFrames : 0, segmentLength, keys[segment + 1]->numFrames,
+					start->frames + frameSize, outputFrames);
+
+			pWriter->WriteFrame(start->frames);
+			for (int i = 0; i < segmentLength - 1; i++)
+				pWriter->WriteFrame(outputFrames + (size_t) i * frameSize);
+		}
+
+		// the start keyframe of this segment becomes p_(n-1) of the next one
+		if (numKeys == 4) {
+			StreamKeyframe * first = keys[0];
+			keys[0] = keys[1];
+			keys[1] = keys[2];
+			keys[2] = keys[3];
+			keys[3] = first;
+			numKeys = 3;
+		}
+	}
+
+	if ((code == 0) && (m_InterpolationType == BEZIER) && (numKeyframesRead <= 3)) {
+		printf("Error: Too less key frames to do the Interpolation.\n");
+		code = -1;
+	}
 
-			if (m_EnableIKSolver) {
-				// Get the actual hands and feet position and root position
-				// 5 left toes, 10 right toes, 22 left finger, 29 right finger
-				interpolatedPosture.root_pos = pInputMotion->GetPosture(startKeyframe + frame)->root_pos;
-				Skeleton *skeleton = pInputMotion->GetSkeleton();
-				skeleton->setPosture(*(pInputMotion->GetPosture(startKeyframe + frame)));
-				skeleton->computeBoneTipPos();
-				vector v22 = skeleton->getBoneTipPosition(22);
-				vector v5 = skeleton->getBoneTipPosition(5);
-				vector v10 = skeleton->getBoneTipPosition(10);
-				vector v29 = skeleton->getBoneTipPosition(29);
-				// Adjust current angle to reach these position
-				IKSolver::Solve(18, 22, v22, &interpolatedPosture, skeleton, &interpolatedPosture);
-				IKSolver::Solve(2, 5, v5, &interpolatedPosture, skeleton, &interpolatedPosture);
-				IKSolver::Solve(7, 10, v10, &interpolatedPosture, skeleton, &interpolatedPosture);
-				IKSolver::Solve(25, 29, v29, &interpolatedPosture, skeleton, &interpolatedPosture);
+	if (code == 0) {
+		WriteStreamLeadingFrames(pWriter, frame, frameSize, &numLeadingFrames);
+
+		// the last segment
+		if (numKeys >= 2) {
+			StreamKeyframe * start = keys[numKeys - 2];
+			int segmentLength = start->numFrames;
+			if (segmentLength > outputCapacity) {
+				delete[] outputFrames;
+				outputCapacity = segmentLength;
+				outputFrames = new double[(size_t) outputCapacity * frameSize];
 			}
+			memset(outputFrames, 0, sizeof(double) * (size_t) segmentLength * frameSize);
+			InterpolateSegment((numKeys == 3) ? keys[0]->frames : NULL, start->frames,
+					keys[numKeys - 1]->frames, NULL,
+					(numKeys == 3) ? keys[0]->quaternions : NULL, start->quaternions,
+					keys[numKeys - 1]->quaternions, NULL,
+					(numKeys == 3) ? keys[0]->numFrames : 0, segmentLength, 0,
+					start->frames + frameSize, outputFrames);
+
+			pWriter->WriteFrame(start->frames);
+			for (int i = 0; i < segmentLength - 1; i++)
+				pWriter->WriteFrame(outputFrames + (size_t) i * frameSize);
+		}
 
-			pOutputMotion->SetPosture(startKeyframe + frame,
-					interpolatedPosture);
+		// the last keyframe and the frames after it are copied
+		if (numKeys >= 1) {
+			StreamKeyframe * last = keys[numKeys - 1];
+			for (int i = 0; i < last->numFrames; i++)
+				pWriter->WriteFrame(last->frames + (size_t) i * frameSize);
 		}
+	}
 
-		startKeyframe = endKeyframe;
+	for (int i = 0; i < 4; i++) {
+		delete[] window[i].frames;
+		delete[] window[i].quaternions;
 	}
+	delete[] outputFrames;
+	delete[] frame;
 
-	for (int frame = keyFramePos[num_keyFrames] + 1; frame < inputLength; frame++)
-		pOutputMotion->SetPosture(frame, *(pInputMotion->GetPosture(frame)));
+	if (code < 0)
+		return -1;
+	return pWriter->GetNumFramesWritten();
 }
 
-void Interpolator::BezierInterpolationQuaternion(Motion *pInputMotion,
-		Motion *pOutputMotion, int N)
+void Interpolator::InterpolateSegments(int index, void * data)
 {
-	int inputLength = pInputMotion->GetNumFrames(); // frames are indexed 0, ..., inputLength-1
+	SegmentJob * job = (SegmentJob *) data;
+	int first = index * job->segmentsPerTask + 1;
+	int last = first + job->segmentsPerTask;
+	if (last > job->numSegments + 1)
+		last = job->numSegments + 1;
+	for (int keyFrameID = first; keyFrameID < last; keyFrameID++)
+		job->interpolator->InterpolateKeyframeSegment(job->kernel, keyFrameID, job->pInputMotion,
+				job->pOutputMotion, job->track);
+}
 
-	// keyframe ID  starts from 1
-	// frame number starts from 0
-	// frame number 0 ..... 21 ..... 62 ..
-	// keyframe ID  1       2        3  ..
-	// in non time uniform situation, the interval is different
-	// To get KeyFrame Position, use keyFramePos array
-	if (num_keyFrames <= 3)
-		throw "Too less key frames to do Interpolate";
-	for (int keyFrameID = 1; keyFrameID < num_keyFrames; keyFrameID++) {
-
-		int startKeyframe = keyFramePos[keyFrameID];
-		int endKeyframe = keyFramePos[keyFrameID + 1];
-		// q_n
-		Posture *startPosture = pInputMotion->GetPosture(startKeyframe);
-		// q_(n+1)
-		Posture *endPosture = pInputMotion->GetPosture(endKeyframe);
-
-		// copy start and end keyframe
-		pOutputMotion->SetPosture(startKeyframe, *startPosture);
-		pOutputMotion->SetPosture(endKeyframe, *endPosture);
-
-		// interpolate in between
-		for (int frame = 1; frame <= endKeyframe - startKeyframe - 1; frame++) {
-			Posture interpolatedPosture;
-			double t = 1.0 * frame / (endKeyframe - startKeyframe);
-
-			// interpolate root position
-			// a_n,b_(n+1)
-			vector a, b;
-			// p_(n-1),p_n,p_(n+1),p_(n+2)
-			vector p0, p1, p2, p3;
-			p1 = startPosture->root_pos;
-			p2 = endPosture->root_pos;
-
-			// a_n
-			// special case for a1
-			if (keyFrameID == 1) {
-				p3 = pInputMotion->GetPosture(keyFramePos[keyFrameID + 2])->root_pos;
-				a = Lerp(p1, Lerp(p3, p2, 2), 1.0 / 3);
-			}
-			else {
-				p0 = pInputMotion->GetPosture(keyFramePos[keyFrameID - 1])->root_pos;
-				// (a_n)_
-				vector a_ = Lerp(Lerp(p0, p1, 2), p2, 0.5);
-				a = Lerp(p1, a_, 1.0 / 3);
-			}
+void Interpolator::InterpolateKeyframeSegment(SegmentKernel kernel, int keyFrameID,
+		Motion * pInputMotion, Motion * pOutputMotion, const Quaternion<double> * track)
+{
+	int frameSize = pInputMotion->GetFrameSize();
+	int startKeyframe = keyFramePos[keyFrameID];
+	int endKeyframe = keyFramePos[keyFrameID + 1];
+
+	// copy the start keyframe (the end keyframe starts the next segment, or is
+	// copied with the frames after the last keyframe)
+	pOutputMotion->SetFrame(startKeyframe, pInputMotion->GetFrame(startKeyframe));
+
+	// p_(n-1),p_n,p_(n+1),p_(n+2)
+	const double * p0 = NULL, * p3 = NULL;
+	int previousLength = 0, nextLength = 0;
+	if (keyFrameID > 1) {
+		p0 = pInputMotion->GetFrame(keyFramePos[keyFrameID - 1]);
+		previousLength = startKeyframe - keyFramePos[keyFrameID - 1];
+	}
+	if (keyFrameID < num_keyFrames - 1) {
+		p3 = pInputMotion->GetFrame(keyFramePos[keyFrameID + 2]);
+		nextLength = keyFramePos[keyFrameID + 2] - endKeyframe;
+	}
 
-			// b_(n+1)
-			// special case for bn
-			if (keyFrameID == num_keyFrames - 1)
-				b = Lerp(p2, Lerp(p0, p1, 2), 1.0 / 3);
-			else {
-				p3 = pInputMotion->GetPosture(keyFramePos[keyFrameID + 2])->root_pos;
-				// (a_n+1)_
-				vector a_1 = Lerp(Lerp(p1, p2, 2), p3, 0.5);
-				b = Lerp(p2, a_1, -1.0 / 3);
-			}
-			interpolatedPosture.root_pos = DeCasteljauEuler(t, p1, a, b, p2);
-
-			// interpolate bone rotations
-			for (int bone = 0; bone < MAX_BONES_IN_ASF_FILE; bone++) {
-				// interpolate bone rotation
-				// a_n,b_(n+1)
-				Quaternion<double> a, b;
-				// p_(n-1),p_n,p_(n+1),p_(n+2)
-				Quaternion<double> q0, q1, q2, q3, resultQ;
-				double e0[3], e1[3], e2[3], e3[3], resultEuler[3];
-
-				startPosture->bone_rotation[bone].getValue(e1);
-				endPosture->bone_rotation[bone].getValue(e2);
-				Euler2Quaternion(e1, q1);
-				Euler2Quaternion(e2, q2);
-
-				// a_n
-				// special case for a1
-				if (keyFrameID == 1) {
-					pInputMotion->GetPosture(keyFramePos[keyFrameID + 2])->bone_rotation[bone].getValue(e3);
-					Euler2Quaternion(e3, q3);
-					Quaternion<double> temp = Double(q3, q2);
-					a = Slerp(q1, temp, 1.0 / 3);
-				}
-				else {
-					pInputMotion->GetPosture(keyFramePos[keyFrameID - 1])->bone_rotation[bone].getValue(e0);
-					Euler2Quaternion(e0, q0);
-					// (a_n)_
-					Quaternion<double> temp = Double(q0, q1);
-					Quaternion<double> a_ = Slerp(temp, q2, 0.5);
-					a = Slerp(q1, a_, 1.0 / 3);
-				}
-
-				// b_(n+1)
-				// special case for bn
-				if (keyFrameID == num_keyFrames - 1) {
-					Quaternion<double> temp = Slerp(q0, q1, 2);
-					b = Slerp(q2, temp, 1.0 / 3);
-				}
-				else {
-					pInputMotion->GetPosture(keyFramePos[keyFrameID + 2])->bone_rotation[bone].getValue(e3);
-					Euler2Quaternion(e3, q3);
-					// (a_n+1)_
-					Quaternion<double> temp = Double(q1, q2);
-					Quaternion<double> a_1 = Slerp(temp, q3, 0.5);
-					b = Slerp(q2, a_1, -1.0 / 3);
-				}
-
-				resultQ = DeCasteljauQuaternion(t, q1, a, b, q2);
-				Quaternion2Euler(resultQ, resultEuler);
-				interpolatedPosture.bone_rotation[bone] = resultEuler;
-			}
+	// the same keyframes in the quaternion track
+	const Quaternion<double> * q0 = NULL, * q1 = NULL, * q2 = NULL, * q3 = NULL;
+	if (track != NULL) {
+		q1 = track + (size_t) (keyFrameID - 1) * m_NumRotations;
+		q2 = q1 + m_NumRotations;
+		if (p0 != NULL)
+			q0 = q1 - m_NumRotations;
+		if (p3 != NULL)
+			q3 = q2 + m_NumRotations;
+	}
+
+	// interpolate in between
+	const double * p1 = pInputMotion->GetFrame(startKeyframe);
+	SegmentKeyframes keys = { p0, p1, pInputMotion->GetFrame(endKeyframe), p3, q0, q1, q2, q3,
+			previousLength, nextLength };
+	(this->*kernel)(keys, endKeyframe - startKeyframe, p1 + frameSize,
+			pOutputMotion->GetFrame(startKeyframe) + frameSize);
+}
+
+void Interpolator::InterpolateSegment(const double * p0, const double * p1,
+		const double * p2, const double * p3, const Quaternion<double> * q0,
+		const Quaternion<double> * q1, const Quaternion<double> * q2,
+		const Quaternion<double> * q3, int previousLength, int segmentLength,
+		int nextLength, const double * inputFrames, double * outputFrames)
+{
+	SegmentKeyframes keys = { p0, p1, p2, p3, q0, q1, q2, q3, previousLength, nextLength };
+	(this->*GetSegmentKernel())(keys, segmentLength, inputFrames, outputFrames);
+}
+
+// control points a_n, b_(n+1) of the Euler (or position) curve through the 3 values at offset
+void Interpolator::EulerControlPoints(const double * p0_, const double * p1_,
+		const double * p2_, const double * p3_, int offset, vector & a, vector & b)
+{
+	// p_(n-1),p_n,p_(n+1),p_(n+2)
+	vector p0, p1, p2, p3;
+	p1 = vector(p1_ + offset);
+	p2 = vector(p2_ + offset);
+
+	// a_n
+	// special case for a1
+	if (p0_ == NULL) {
+		p3 = vector(p3_ + offset);
+		a = Lerp(p1, Lerp(p3, p2, 2), 1.0 / 3);
+	}
+	else {
+		p0 = vector(p0_ + offset);
+		// (a_n)_
+		vector a_ = Lerp(Lerp(p0, p1, 2), p2, 0.5);
+		a = Lerp(p1, a_, 1.0 / 3);
+	}
+
+	// b_(n+1)
+	// special case for bn
+	if (p3_ == NULL)
+		b = Lerp(p2, Lerp(p0, p1, 2), 1.0 / 3);
+	else {
+		p3 = vector(p3_ + offset);
+		// (a_n+1)_
+		vector a_1 = Lerp(Lerp(p1, p2, 2), p3, 0.5);
+		b = Lerp(p2, a_1, -1.0 / 3);
+	}
+}
+
+// end points q_n, q_(n+1) and control points a_n, b_(n+1) of the quaternion curve
+// through the Euler angles at offset
+void Interpolator::QuaternionControlPoints(const Quaternion<double> * k0,
+		const Quaternion<double> * k1, const Quaternion<double> * k2,
+		const Quaternion<double> * k3, int rotation, Quaternion<double> & q1,
+		Quaternion<double> & a, Quaternion<double> & b, Quaternion<double> & q2)
+{
+	// p_(n-1),p_(n+2)
+	Quaternion<double> q0, q3;
+
+	q1 = k1[rotation];
+	q2 = k2[rotation];
+
+	// a_n
+	// special case for a1
+	if (k0 == NULL) {
+		q3 = k3[rotation];
+		Quaternion<double> temp = Double(q3, q2);
+		a = Slerp(q1, temp, 1.0 / 3);
+	}
+	else {
+		q0 = k0[rotation];
+		// (a_n)_
+		Quaternion<double> temp = Double(q0, q1);
+		Quaternion<double> a_ = Slerp(temp, q2, 0.5);
+		a = Slerp(q1, a_, 1.0 / 3);
+	}
 
-			if (m_EnableIKSolver) {
-				// Get the actual hands and feet position and root position
-				// 5 left toes, 10 right toes, 22 left finger, 29 right finger
-				interpolatedPosture.root_pos = pInputMotion->GetPosture(startKeyframe + frame)->root_pos;
-				Skeleton *skeleton = pInputMotion->GetSkeleton();
-				skeleton->setPosture(*(pInputMotion->GetPosture(startKeyframe + frame)));
-				skeleton->computeBoneTipPos();
-				vector v22 = skeleton->getBoneTipPosition(22);
-				vector v5 = skeleton->getBoneTipPosition(5);
-				vector v10 = skeleton->getBoneTipPosition(10);
-				vector v29 = skeleton->getBoneTipPosition(29);
-
-				// Debug 
-				// tt->setPosture(interpolatedPosture);
-				// tt->computeBoneTipPos();
-				// vector v2 = tt->getBoneTipPosition(22);
-				// IKSolver k;
-				///if((v1-v2).length() > 0.1)
-				///{
-				///	printf("%d %lf \n",startKeyframe + frame, (v1-v2).length());
-				///}
-
-				// Adjust current angle to reach these position
-				IKSolver::Solve(18, 22, v22, &interpolatedPosture, skeleton, &interpolatedPosture);
-				IKSolver::Solve(2, 5, v5, &interpolatedPosture, skeleton, &interpolatedPosture);
-				IKSolver::Solve(7, 10, v10, &interpolatedPosture, skeleton, &interpolatedPosture);
-				IKSolver::Solve(25, 29, v29, &interpolatedPosture, skeleton, &interpolatedPosture);
+	// b_(n+1)
+	// special case for bn
+	if (k3 == NULL) {
+		Quaternion<double> temp = Slerp(q0, q1, 2);
+		b = Slerp(q2, temp, 1.0 / 3);
+	}
+	else {
+		q3 = k3[rotation];
+		// (a_n+1)_
+		Quaternion<double> temp = Double(q1, q2);
+		Quaternion<double> a_1 = Slerp(temp, q3, 0.5);
+		b = Slerp(q2, a_1, -1.0 / 3);
+	}
+}
+
+// logarithm of the rotation from q to r (unit quaternions), along the short path: the
+// vector v with r = +-q * exp(v), where exp(v) = cos|v| + sin|v| v / |v| (|v| is half
+// the rotation angle)
+static vector RelativeLog(Quaternion<double> q, const Quaternion<double> & r)
+{
+	Quaternion<double> d = q.conj() * r;
+	if (d.Gets() < 0)
+		d = -1. * d;
+	vector v(d.Getx(), d.Gety(), d.Getz());
+	double sinHalfAngle = len(v);
+	if (sinHalfAngle < 1e-12)
+		return v;
+	return v * (atan2(sinHalfAngle, d.Gets()) / sinHalfAngle);
+}
+
+// q * exp(v)
+static Quaternion<double> MultiplyExp(const Quaternion<double> & q, vector v)
+{
+	double halfAngle = len(v);
+	double scale = (halfAngle < 1e-12) ? 1.0 : sin(halfAngle) / halfAngle;
+	Quaternion<double> result = q * Quaternion<double>(cos(halfAngle), scale * v.x(), scale * v.y(), scale * v.z());
+	result.Normalize();
+	return result;
+}
+
+// control points a_n, b_(n+1) of the Catmull-Rom curve through the 3 values at offset:
+// a_n = p_n + T_n / 3, b_(n+1) = p_(n+1) - T_(n+1) / 3 with the tangent T (per segment)
+// at a keyframe the difference of its neighbors over the frames between them, times
+// segmentLength; at the first and last keyframe, the difference to its neighbor. SQUAD
+// takes the keyframes to be uniformly spaced.
+void Interpolator::CatmullRomControlPoints(const double * p0_, const double * p1_,
+		const double * p2_, const double * p3_, int previousLength, int segmentLength,
+		int nextLength, int offset, vector & a, vector & b)
+{
+	if (m_InterpolationType == SQUAD)
+		previousLength = nextLength = segmentLength;
+	vector p1 = vector(p1_ + offset);
+	vector p2 = vector(p2_ + offset);
+
+	vector tangent1 = p2 - p1;
+	if (p0_ != NULL)
+		tangent1 = (p2 - vector(p0_ + offset)) * ((double) segmentLength / (previousLength + segmentLength));
+	a = p1 + tangent1 / 3;
+
+	vector tangent2 = p2 - p1;
+	if (p3_ != NULL)
+		tangent2 = (vector(p3_ + offset) - p1) * ((double) segmentLength / (segmentLength + nextLength));
+	b = p2 - tangent2 / 3;
+}
+
+// inner quaternions s_n, s_(n+1) of the SQUAD curve from q_n to q_(n+1): the tangents
+// T_n, T_(n+1) (as for CatmullRomControlPoints, of log(q_n^-1 q) for the neighbors q)
+// give s_n = q_n exp((T_n - log(q_n^-1 q_(n+1))) / 2) and
+// s_(n+1) = q_(n+1) exp(-(T_(n+1) + log(q_(n+1)^-1 q_n)) / 2); for uniformly spaced
+// keyframes, s_n = q_n exp(-(log(q_n^-1 q_(n+1)) + log(q_n^-1 q_(n-1))) / 4)
+void Interpolator::SquadControlPoints(const Quaternion<double> * k0,
+		const Quaternion<double> * k1, const Quaternion<double> * k2,
+		const Quaternion<double> * k3, int previousLength, int segmentLength,
+		int nextLength, int rotation, Quaternion<double> & s1, Quaternion<double> & s2)
+{
+	if (m_InterpolationType == SQUAD)
+		previousLength = nextLength = segmentLength;
+	const Quaternion<double> & q1 = k1[rotation];
+	const Quaternion<double> & q2 = k2[rotation];
+
+	vector forward = RelativeLog(q1, q2);
+	vector tangent1 = forward;
+	if (k0 != NULL)
+		tangent1 = (forward - RelativeLog(q1, k0[rotation]))
+				* ((double) segmentLength / (previousLength + segmentLength));
+	s1 = MultiplyExp(q1, (tangent1 - forward) * 0.5);
+
+	vector backward = RelativeLog(q2, q1);
+	vector tangent2 = backward * -1.0;
+	if (k3 != NULL)
+		tangent2 = (RelativeLog(q2, k3[rotation]) - backward)
+				* ((double) segmentLength / (segmentLength + nextLength));
+	s2 = MultiplyExp(q2, (tangent2 + backward) * -0.5);
+}
+
+// power form (see cubiccurves.h) of the Bezier curves at offsets[i] of the packed
+// frames, from p1 to p2 with control points a[i], b[i]
+static void CurveCoefficients(int numCurves, const int * offsets, const double * p1,
+		const vector * a, const vector * b, const double * p2, double * coefficients)
+{
+	double p1Values[3 * (MAX_BONES_IN_ASF_FILE + 1)], p2Values[3 * (MAX_BONES_IN_ASF_FILE + 1)];
+	double aValues[3 * (MAX_BONES_IN_ASF_FILE + 1)], bValues[3 * (MAX_BONES_IN_ASF_FILE + 1)];
+	for (int i = 0; i < numCurves; i++) {
+		vector(p1 + offsets[i]).getValue(p1Values + 3 * i);
+		vector(a[i]).getValue(aValues + 3 * i);
+		vector(b[i]).getValue(bValues + 3 * i);
+		vector(p2 + offsets[i]).getValue(p2Values + 3 * i);
+	}
+	BezierToPowerForm(3 * numCurves, p1Values, aValues, bValues, p2Values, coefficients);
+}
+
+// The interpolation kernels: one per interpolation type, angle representation and IK
+// setting. The constant conditions on the template parameters are resolved by the
+// compiler, so the loop over the frames has no branches on the settings. The keyframes
+// before and after the segment (and their absence for the first and last segment) only
+// change the curves, which are computed once before the loop.
+template <InterpolationType interpolationType, AngleRepresentation angleRepresentation, bool enableIK>
+void Interpolator::InterpolateSegmentKernel(const SegmentKeyframes & keys, int segmentLength,
+		const double * inputFrames, double * outputFrames)
+{
+	int frameSize = m_pSkeleton->getPostureLayout()->frameSize;
+	const double * p1 = keys.p1;
+	const double * p2 = keys.p2;
+
+	// the curves of the root position and (EULER) the bone rotations
+	int offsets[MAX_BONES_IN_ASF_FILE + 1];
+	int numCurves = 0;
+	offsets[numCurves++] = PostureLayout::getRootPosOffset();
+	if (angleRepresentation == EULER)
+		for (int rotation = 0; rotation < m_NumRotations; rotation++)
+			offsets[numCurves++] = m_RotationOffsets[rotation];
+	double coefficients[4 * 3 * (MAX_BONES_IN_ASF_FILE + 1)];
+	if (interpolationType != LINEAR) {
+		vector a[MAX_BONES_IN_ASF_FILE + 1], b[MAX_BONES_IN_ASF_FILE + 1];
+		for (int i = 0; i < numCurves; i++)
+			if (interpolationType == BEZIER)
+				EulerControlPoints(keys.p0, p1, p2, keys.p3, offsets[i], a[i], b[i]);
+			else
+				CatmullRomControlPoints(keys.p0, p1, p2, keys.p3, keys.previousLength, segmentLength,
+						keys.nextLength, offsets[i], a[i], b[i]);
+		CurveCoefficients(numCurves, offsets, p1, a, b, p2, coefficients);
+	}
+
+	// (QUATERNION) the quaternions of the bone rotations at the keyframes, and the Bezier
+	// control points a_n, b_(n+1) or the SQUAD inner quaternions s_n, s_(n+1)
+	RotationQuaternions q1, a, b, q2;
+	if (angleRepresentation == QUATERNION)
+		for (int rotation = 0; rotation < m_NumRotations; rotation++) {
+			q1.Set(rotation, keys.q1[rotation]);
+			q2.Set(rotation, keys.q2[rotation]);
+			Quaternion<double> start, controlA, controlB, end;
+			if (interpolationType == BEZIER)
+				QuaternionControlPoints(keys.q0, keys.q1, keys.q2, keys.q3, rotation, start, controlA,
+						controlB, end);
+			else if (interpolationType != LINEAR)
+				SquadControlPoints(keys.q0, keys.q1, keys.q2, keys.q3, keys.previousLength,
+						segmentLength, keys.nextLength, rotation, controlA, controlB);
+			if (interpolationType != LINEAR) {
+				a.Set(rotation, controlA);
+				b.Set(rotation, controlB);
 			}
+		}
+	RotationQuaternions temp1, temp2, temp3;
+	double values[3 * (MAX_BONES_IN_ASF_FILE + 1)];
+	double resultEuler[3 * MAX_BONES_IN_ASF_FILE];
+	// the IK solver's own pose of the (shared) skeleton
+	SkeletonPose * pose = enableIK ? new SkeletonPose(m_pSkeleton) : NULL;
+
+	// interpolate in between
+	for (int frame = 1; frame <= segmentLength - 1; frame++) {
+		double * outputFrame = outputFrames + (size_t) (frame - 1) * frameSize;
+		double t = 1.0 * frame / segmentLength;
+
+		// root position, and with EULER, bone rotations
+		if (interpolationType == LINEAR)
+			for (int i = 0; i < numCurves; i++)
+				(vector(p1 + offsets[i]) * (1 - t) + vector(p2 + offsets[i]) * t).getValue(outputFrame + offsets[i]);
+		else {
+			EvaluatePowerForm(3 * numCurves, coefficients, t, values);
+			for (int i = 0; i < numCurves; i++)
+				vector(values + 3 * i).getValue(outputFrame + offsets[i]);
+		}
 
-			pOutputMotion->SetPosture(startKeyframe + frame,
-					interpolatedPosture);
+		// bone rotations, for all rotations at once
+		if (angleRepresentation == QUATERNION) {
+			int n = m_NumRotations;
+			if (interpolationType == LINEAR)
+				SlerpArrays(n, q1.Arrays(), q2.Arrays(), t, temp1.Arrays());
+			else if (interpolationType == BEZIER) {
+				// DeCasteljauQuaternion
+				SlerpArrays(n, q1.Arrays(), a.Arrays(), t, temp1.Arrays());
+				SlerpArrays(n, a.Arrays(), b.Arrays(), t, temp2.Arrays());
+				SlerpArrays(n, b.Arrays(), q2.Arrays(), t, temp3.Arrays());
+				SlerpArrays(n, temp1.Arrays(), temp2.Arrays(), t, temp1.Arrays());
+				SlerpArrays(n, temp2.Arrays(), temp3.Arrays(), t, temp2.Arrays());
+				SlerpArrays(n, temp1.Arrays(), temp2.Arrays(), t, temp1.Arrays());
+			}
+			else {
+				// squad(t) = Slerp(Slerp(q_n, q_(n+1), t), Slerp(s_n, s_(n+1), t), 2t(1 - t))
+				SlerpArrays(n, q1.Arrays(), q2.Arrays(), t, temp1.Arrays());
+				SlerpArrays(n, a.Arrays(), b.Arrays(), t, temp2.Arrays());
+				SlerpArrays(n, temp1.Arrays(), temp2.Arrays(), 2 * t * (1 - t), temp1.Arrays());
+			}
+			QuaternionArraysToEuler(n, temp1.Arrays(), resultEuler);
+			for (int rotation = 0; rotation < n; rotation++)
+				vector(resultEuler + 3 * rotation).getValue(outputFrame + m_RotationOffsets[rotation]);
 		}
 
+		if (enableIK)
+			SolveIK(inputFrames + (size_t) (frame - 1) * frameSize, outputFrame, pose);
 	}
+	delete pose;
+}
 
-	for (int frame = keyFramePos[num_keyFrames]; frame < inputLength; frame++)
-		pOutputMotion->SetPosture(frame, *(pInputMotion->GetPosture(frame)));
+Interpolator::SegmentKernel Interpolator::GetSegmentKernel()
+{
+	// indexed by interpolation type, angle representation and IK; the IK solver only
+	// adjusts quaternion interpolation, and SQUAD only interpolates quaternions
+	static const SegmentKernel kernels[4][2][2] = {
+		{
+			{ &Interpolator::InterpolateSegmentKernel<LINEAR, EULER, false>,
+			  &Interpolator::InterpolateSegmentKernel<LINEAR, EULER, false> },
+			{ &Interpolator::InterpolateSegmentKernel<LINEAR, QUATERNION, false>,
+			  &Interpolator::InterpolateSegmentKernel<LINEAR, QUATERNION, true> } },
+		{
+			{ &Interpolator::InterpolateSegmentKernel<BEZIER, EULER, false>,
+			  &Interpolator::InterpolateSegmentKernel<BEZIER, EULER, false> },
+			{ &Interpolator::InterpolateSegmentKernel<BEZIER, QUATERNION, false>,
+			  &Interpolator::InterpolateSegmentKernel<BEZIER, QUATERNION, true> } },
+		{
+			{ NULL, NULL },
+			{ &Interpolator::InterpolateSegmentKernel<SQUAD, QUATERNION, false>,
+			  &Interpolator::InterpolateSegmentKernel<SQUAD, QUATERNION, true> } },
+		{
+			{ &Interpolator::InterpolateSegmentKernel<CATMULL_ROM, EULER, false>,
+			  &Interpolator::InterpolateSegmentKernel<CATMULL_ROM, EULER, false> },
+			{ &Interpolator::InterpolateSegmentKernel<CATMULL_ROM, QUATERNION, false>,
+			  &Interpolator::InterpolateSegmentKernel<CATMULL_ROM, QUATERNION, true> } }
+	};
+	SegmentKernel kernel = NULL;
+	if ((m_InterpolationType >= LINEAR) && (m_InterpolationType <= CATMULL_ROM)
+			&& (m_AngleRepresentation >= EULER) && (m_AngleRepresentation <= QUATERNION))
+		kernel = kernels[m_InterpolationType][m_AngleRepresentation][m_EnableIKSolver ? 1 : 0];
+	if (kernel == NULL) {
+		printf("Error: unknown interpolation / angle representation type.\n");
+		exit(1);
+	}
+	return kernel;
+}
+
+void Interpolator::FindRotations()
+{
+	const PostureLayout * layout = m_pSkeleton->getPostureLayout();
+	int numActiveBones = m_pSkeleton->getNumActiveBones();
+	const int * activeBones = m_pSkeleton->getActiveBones();
+	m_NumRotations = 0;
+	for (int i = 0; i < numActiveBones; i++)
+		m_RotationOffsets[m_NumRotations++] = layout->rotationOffset[activeBones[i]];
+}
+
+void Interpolator::KeyframeQuaternions(const double * frame, Quaternion<double> * quaternions)
+{
+	double angles[3 * MAX_BONES_IN_ASF_FILE];
+	for (int rotation = 0; rotation < m_NumRotations; rotation++)
+		vector(frame + m_RotationOffsets[rotation]).getValue(angles + 3 * rotation);
+	RotationQuaternions converted;
+	EulerToQuaternionArrays(m_NumRotations, angles, converted.Arrays());
+
+	for (int rotation = 0; rotation < m_NumRotations; rotation++)
+		quaternions[rotation] = converted.Get(rotation);
+}
+
+void Interpolator::SolveIK(const double * inputFrame, double * outputFrame, SkeletonPose * pose)
+{
+	// Get the actual hands and feet position and root position
+	// 5 left toes, 10 right toes, 22 left finger, 29 right finger
+	int rootPos = PostureLayout::getRootPosOffset();
+	vector(inputFrame + rootPos).getValue(outputFrame + rootPos);
+	pose->ComputeBoneTipPos(inputFrame);
+	vector v22 = pose->GetBoneTipPosition(22);
+	vector v5 = pose->GetBoneTipPosition(5);
+	vector v10 = pose->GetBoneTipPosition(10);
+	vector v29 = pose->GetBoneTipPosition(29);
+	// Adjust current angle to reach these position
+	IKSolver::Solve(18, 22, v22, outputFrame, pose, outputFrame, m_IKJacobian);
+	IKSolver::Solve(2, 5, v5, outputFrame, pose, outputFrame, m_IKJacobian);
+	IKSolver::Solve(7, 10, v10, outputFrame, pose, outputFrame, m_IKJacobian);
+	IKSolver::Solve(25, 29, v29, outputFrame, pose, outputFrame, m_IKJacobian);
 }
 
 void Interpolator::Euler2Quaternion(double angles[3], Quaternion<double> & q)
 {
-	double Rotation[9];
-	Euler2Rotation(angles, Rotation);
-	q = q.Matrix2Quaternion(Rotation);
+	// closed form of Euler2Rotation followed by Matrix2Quaternion
+	EulerToQuaternion(angles, q);
 }
 
 void Interpolator::Quaternion2Euler(Quaternion<double> & q, double angles[3])
 {
-	double Rotation[9];
-	q.Quaternion2Matrix(Rotation);
-	Rotation2Euler(Rotation, angles);
+	// closed form of Quaternion2Matrix followed by Rotation2Euler
+	QuaternionToEuler(q, angles);
 }
 
 // Reference: Physically based Rendering from theory to implementation 2nd
@@ -509,6 +898,7 @@ void Interpolator::SetTimeUniformKeyframe(int interval, int length)
 {
 	int keyFrameID, currentKeyFramePos = 0;
 	for (keyFrameID = 1; ; keyFrameID++) {
+		ReserveKeyframes(keyFrameID);
 		keyFramePos[keyFrameID] = currentKeyFramePos;
 		currentKeyFramePos += interval + 1;
 		if (currentKeyFramePos >= length)
@@ -520,9 +910,26 @@ void Interpolator::SetTimeUniformKeyframe(int interval, int length)
 void Interpolator::AddNextKeyframePos(int keyFramePos)
 {
 	num_keyFrames++;
+	ReserveKeyframes(num_keyFrames);
 	this->keyFramePos[num_keyFrames] = keyFramePos;
 }
 
+void Interpolator::ReserveKeyframes(int numKeyframes)
+{
+	// keyframe IDs start from 1
+	if (numKeyframes < keyFramePosCapacity)
+		return;
+	int capacity = (keyFramePosCapacity == 0) ? 1024 : 2 * keyFramePosCapacity;
+	while (capacity <= numKeyframes)
+		capacity *= 2;
+	int * newKeyFramePos = new int[capacity];
+	if (keyFramePos != NULL)
+		memcpy(newKeyFramePos, keyFramePos, sizeof(int) * keyFramePosCapacity);
+	delete[] keyFramePos;
+	keyFramePos = newKeyFramePos;
+	keyFramePosCapacity = capacity;
+}
+
 
 void Interpolator::Rotation2Euler(double R[9], double angles[3])
 {
@@ -11,17 +11,28 @@
 #define _INTERPOLATOR_H
 
 #include "motion.h"
+#include "amcstream.h"
 #include "quaternion.h"
+#include "skeletonpose.h"
+#include "IKSolver.h"
 #include <iostream>
 
+// SQUAD and CATMULL_ROM are cubic curves through the keyframes, like BEZIER, that
+// interpolate quaternions with 3 slerps per frame instead of 6: SQUAD with the inner
+// quaternions of Shoemake (the tangents of uniformly spaced keyframes), CATMULL_ROM with
+// tangents scaled by the spacing of the keyframes. SQUAD only interpolates quaternions.
 enum InterpolationType {
-	LINEAR = 0, BEZIER = 1
+	LINEAR = 0, BEZIER = 1, SQUAD = 2, CATMULL_ROM = 3
 };
 
 enum AngleRepresentation {
 	EULER = 0, QUATERNION = 1
 };
 
+class MotionEvaluator;
+class InterpolationSession;
+class KeyframeSelector;
+
 class Interpolator {
 public:
 	//constructor, destructor
@@ -44,23 +55,64 @@ public:
 		m_EnableIKSolver = EnableIkSolver;
 	}
 	;
+	//Set how the IK solver computes its Jacobian (default: ANALYTIC_JACOBIAN)
+	void SetIKJacobian(IKJacobian ikJacobian) {
+		m_IKJacobian = ikJacobian;
+	}
+	;
 	//Create interpolated motion and store it into pOutputMotion (which will also be allocated)
 	void Interpolate(Motion * pInputMotion, Motion ** pOutputMotion, int N);
 
+	//Interpolate the motion read from pReader and write it to pWriter, frame by frame.
+	//Only the keyframes around the current segment and the frames between them are
+	//kept in memory, so the length of the motion is not limited.
+	//Keyframes are those added with AddNextKeyframePos, or else every (N+1)-th frame.
+	//Returns the number of frames written, or -1 on error.
+	int InterpolateStream(AMCReader * pReader, AMCWriter * pWriter, int N);
+
+	//Resample the motion from inputRate to outputRate frames per second (e.g. 120 to 30)
+	//and write the frames to pWriter as they are computed, without creating the output
+	//motion. Every input frame is a keyframe; output frame j is the posture at input frame
+	//j * inputRate / outputRate (see MotionEvaluator), up to the last input frame. IK is
+	//not used. Returns the number of frames written, or -1 on error.
+	int Resample(Motion * pInputMotion, double inputRate, double outputRate, FrameWriter * pWriter);
+	//Number of frames Resample writes
+	static int GetNumResampledFrames(int numInputFrames, double inputRate, double outputRate);
+
+	//Create an evaluator that samples the interpolated motion at any time (see motionevaluator.h),
+	//with the keyframes, interpolation type and angle representation set so far (IK is not used).
+	//The caller deletes it. Throws 1 if there are too few keyframes.
+	MotionEvaluator * CreateEvaluator(Motion * pInputMotion);
+
 	// set time uniform keyframe
 	void SetTimeUniformKeyframe(int interval,int length);
 
 	// set keyframe position
 	void AddNextKeyframePos(int keyFramePos);
+	// remove all keyframes (e.g. before adding those of KeyframeSelector)
+	void ClearKeyframes() {
+		num_keyFrames = 0;
+	}
 private:
+	// compute control points and segments with the routines below
+	friend class MotionEvaluator;
+	friend class InterpolationSession;
+	friend class KeyframeSelector;
+
 	InterpolationType m_InterpolationType; //Interpolation type (Linear, Bezier)
 	AngleRepresentation m_AngleRepresentation; //Angle representation (Euler, Quaternion)
 	bool m_EnableIKSolver;
+	IKJacobian m_IKJacobian;
 
-	int keyFramePos[10000];
+	int * keyFramePos; // indexed by keyframe ID, which starts from 1
+	int keyFramePosCapacity;
 	int num_keyFrames;
+	void ReserveKeyframes(int numKeyframes);
+	const Skeleton * m_pSkeleton; // skeleton of the motion being interpolated
 	// conversion routines
 	// angles are given in degrees; assume XYZ Euler angle order
+	// (the quaternion conversions use the closed forms of quaternionarrays.h, and the
+	// interpolation loops their batch variants; the matrix routines are the reference)
 	void Rotation2Euler(double R[9], double angles[3]);
 	void Euler2Rotation(double angles[3], double R[9]);
 	void Euler2Quaternion(double angles[3], Quaternion<double> & q);
@@ -70,17 +122,81 @@ private:
 	Quaternion<double> Slerp(Quaternion<double>  & qStart, Quaternion<double>  & qEnd, double t);
 	Quaternion<double> Double(Quaternion<double> p, Quaternion<double> q);
 
+	// bone rotations that have a slot in the packed frames (see PostureLayout), in bone order
+	int m_NumRotations;
+	int m_RotationOffsets[MAX_BONES_IN_ASF_FILE];
+	void FindRotations();
+
+	// quaternion track: convert the rotations of a keyframe to quaternions (with s >= 0),
+	// once per keyframe; every slerp takes the short path, so neighboring keyframes may
+	// be in opposite hemispheres
+	void KeyframeQuaternions(const double * frame, Quaternion<double> * quaternions);
+
+	// keyframes of a segment, see InterpolateSegment
+	struct SegmentKeyframes {
+		const double * p0, * p1, * p2, * p3;
+		const Quaternion<double> * q0, * q1, * q2, * q3;
+		int previousLength, nextLength;
+	};
+	// Interpolation kernel of InterpolateSegment, for the interpolation type, angle
+	// representation and IK setting it is compiled for; GetSegmentKernel chooses the
+	// one for the current settings (once per motion rather than per segment).
+	typedef void (Interpolator::*SegmentKernel)(const SegmentKeyframes & keys,
+			int segmentLength, const double * inputFrames, double * outputFrames);
+	template <InterpolationType interpolationType, AngleRepresentation angleRepresentation, bool enableIK>
+	void InterpolateSegmentKernel(const SegmentKeyframes & keys, int segmentLength,
+			const double * inputFrames, double * outputFrames);
+	SegmentKernel GetSegmentKernel();
+
+	// interpolate the segment that starts at keyframe keyFrameID of Interpolate with
+	// kernel (track is the quaternion track, or NULL); safe to call concurrently for
+	// different segments
+	void InterpolateKeyframeSegment(SegmentKernel kernel, int keyFrameID, Motion * pInputMotion,
+			Motion * pOutputMotion, const Quaternion<double> * track);
+	// ParallelFor task over the segments of a SegmentJob (see interpolator.cpp)
+	struct SegmentJob;
+	static void InterpolateSegments(int index, void * data);
+
 	// interpolation routines
-	void LinearInterpolationEuler(Motion * pInputMotion, Motion * pOutputMotion,
-			int N);
-	void BezierInterpolationEuler(Motion * pInputMotion, Motion * pOutputMotion,
-			int N);
-	void LinearInterpolationQuaternion(Motion * pInputMotion,
-			Motion * pOutputMotion, int N);
-	void BezierInterpolationQuaternion(Motion * pInputMotion,
-			Motion * pOutputMotion, int N);
-
-	// Bezier spline evaluation
+	// The frames strictly between keyframes p1 and p2 (segmentLength frames apart) are
+	// written to outputFrames, consecutive packed frames (see PostureLayout) that must
+	// be zeroed. p0 and p3 are the keyframes before p1 and after p2, NULL for the first
+	// and last segment; previousLength and nextLength are the frames from p0 to p1 and
+	// from p2 to p3 (0 if there is no such keyframe). q0..q3 are the same keyframes in
+	// the quaternion track (only used with QUATERNION). inputFrames are the original
+	// frames between p1 and p2, which give the IK targets.
+	void InterpolateSegment(const double * p0, const double * p1, const double * p2,
+			const double * p3, const Quaternion<double> * q0, const Quaternion<double> * q1,
+			const Quaternion<double> * q2, const Quaternion<double> * q3,
+			int previousLength, int segmentLength, int nextLength,
+			const double * inputFrames, double * outputFrames);
+
+	// Bezier control points of one segment (computed once per segment and bone, and
+	// shared by all frames of the segment), for the 3 values at offset in the packed
+	// frames, or for one rotation of the quaternion track
+	void EulerControlPoints(const double * p0, const double * p1, const double * p2,
+			const double * p3, int offset, vector & a, vector & b);
+	void QuaternionControlPoints(const Quaternion<double> * q0, const Quaternion<double> * q1,
+			const Quaternion<double> * q2, const Quaternion<double> * q3, int rotation,
+			Quaternion<double> & start, Quaternion<double> & a, Quaternion<double> & b,
+			Quaternion<double> & end);
+	// The same for SQUAD and CATMULL_ROM (the lengths are those of InterpolateSegment):
+	// the Bezier control points of the Catmull-Rom curve, and the inner quaternions s_n,
+	// s_(n+1) of the SQUAD curve with the same tangents at the keyframes
+	void CatmullRomControlPoints(const double * p0, const double * p1, const double * p2,
+			const double * p3, int previousLength, int segmentLength, int nextLength,
+			int offset, vector & a, vector & b);
+	void SquadControlPoints(const Quaternion<double> * q0, const Quaternion<double> * q1,
+			const Quaternion<double> * q2, const Quaternion<double> * q3,
+			int previousLength, int segmentLength, int nextLength, int rotation,
+			Quaternion<double> & s1, Quaternion<double> & s2);
+
+	// move hands and feet of outputFrame to where they are in inputFrame
+	// (pose is the caller's pose of m_pSkeleton)
+	void SolveIK(const double * inputFrame, double * outputFrame, SkeletonPose * pose);
+
+	// Bezier spline evaluation (the interpolation routines use the power form of the
+	// Euler curves, see cubiccurves.h)
 	vector DeCasteljauEuler(double t, vector p0, vector p1, vector p2,
 			vector p3); // evaluate Bezier spline at t, using DeCasteljau construction, vector version
 	Quaternion<double> DeCasteljauQuaternion(double t, Quaternion<double> p0,
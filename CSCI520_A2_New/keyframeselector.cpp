@@ -0,0 +1,244 @@
+/*
+ keyframeselector.cpp
+
+ See keyframeselector.h.
+
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "keyframeselector.h"
+#include "quaternionarrays.h"
+
+// Bezier (and other cubic) segments are chosen within this fraction of the budget, so
+// that most of them are still within the budget with the actual keyframe after them
+#define CUBIC_MARGIN 0.8
+
+KeyframeSelector::KeyframeSelector(Interpolator * pInterpolator, Motion * pInputMotion,
+		KeyframeError errorType)
+{
+	m_pInterpolator = pInterpolator;
+	m_pInputMotion = pInputMotion;
+	m_pSkeleton = pInputMotion->GetSkeleton();
+	m_pPose = new SkeletonPose(m_pSkeleton);
+	m_ErrorType = errorType;
+	m_NumFrames = pInputMotion->GetNumFrames();
+	m_FrameSize = pInputMotion->GetFrameSize();
+	m_pFrames = NULL;
+	m_FramesCapacity = 0;
+
+	// the segments are interpolated with the interpolator's own routines
+	pInterpolator->m_pSkeleton = m_pSkeleton;
+	pInterpolator->FindRotations();
+	m_Track = new Quaternion<double>[4 * (pInterpolator->m_NumRotations + 1)];
+}
+
+KeyframeSelector::~KeyframeSelector()
+{
+	delete[] m_pFrames;
+	delete[] m_Track;
+	delete m_pPose;
+}
+
+// rotation angle (in degrees) between the orientations given by two sets of XYZ Euler angles
+static double RotationAngle(const double * angles1, const double * angles2)
+{
+	double a[3] = { angles1[0], angles1[1], angles1[2] };
+	double b[3] = { angles2[0], angles2[1], angles2[2] };
+	Quaternion<double> p, q;
+	EulerToQuaternion(a, p);
+	EulerToQuaternion(b, q);
+
+	// 2 atan2(|p - q|, |p + q|), with q in the hemisphere of p; accurate also for small angles
+	double dot = p.Gets() * q.Gets() + p.Getx() * q.Getx() + p.Gety() * q.Gety() + p.Getz() * q.Getz();
+	if (dot < 0)
+		q = -1. * q;
+	Quaternion<double> difference = p - q, sum = p + q;
+	return 360. / M_PI * atan2(sqrt(difference.Norm2()), sqrt(sum.Norm2()));
+}
+
+double KeyframeSelector::FrameError(const double * frame, int f)
+{
+	const double * input = m_pInputMotion->GetFrame(f);
+	double error = 0;
+	if (m_ErrorType == ANGLE_ERROR) {
+		int numRotations = m_pInterpolator->m_NumRotations;
+		const int * offsets = m_pInterpolator->m_RotationOffsets;
+		for (int rotation = 0; rotation < numRotations; rotation++) {
+			double angle = RotationAngle(frame + offsets[rotation], input + offsets[rotation]);
+			if (angle > error)
+				error = angle;
+		}
+	}
+	else {
+		int numBones = m_pSkeleton->NUM_BONES_IN_ASF_FILE;
+		vector tips[MAX_BONES_IN_ASF_FILE];
+		m_pPose->ComputeBoneTipPos(input);
+		for (int bone = 0; bone < numBones; bone++)
+			tips[bone] = m_pPose->GetBoneTipPosition(bone);
+		m_pPose->ComputeBoneTipPos(frame);
+		for (int bone = 0; bone < numBones; bone++) {
+			double distance = (m_pPose->GetBoneTipPosition(bone) - tips[bone]).length();
+			if (distance > error)
+				error = distance;
+		}
+	}
+	return error;
+}
+
+double KeyframeSelector::SegmentError(int k0, int k1, int k2, int k3, double maxError)
+{
+	int segmentLength = k2 - k1;
+	if (segmentLength <= 1)
+		return 0;
+
+	if (segmentLength - 1 > m_FramesCapacity) {
+		delete[] m_pFrames;
+		m_FramesCapacity = 2 * (segmentLength - 1);
+		if (m_FramesCapacity > m_NumFrames)
+			m_FramesCapacity = m_NumFrames;
+		m_pFrames = new double[(size_t) m_FramesCapacity * m_FrameSize];
+	}
+	memset(m_pFrames, 0, sizeof(double) * (size_t) (segmentLength - 1) * m_FrameSize);
+
+	// the keyframes, and with QUATERNION, their quaternions
+	int keyframes[4] = { k0, k1, k2, k3 };
+	const double * p[4];
+	const Quaternion<double> * q[4];
+	int numRotations = m_pInterpolator->m_NumRotations;
+	for (int i = 0; i < 4; i++) {
+		p[i] = (keyframes[i] >= 0) ? m_pInputMotion->GetFrame(keyframes[i]) : NULL;
+		q[i] = NULL;
+		if ((p[i] != NULL) && (m_pInterpolator->m_AngleRepresentation == QUATERNION)) {
+			m_pInterpolator->KeyframeQuaternions(p[i], m_Track + i * numRotations);
+			q[i] = m_Track + i * numRotations;
+		}
+	}
+	m_pInterpolator->InterpolateSegment(p[0], p[1], p[2], p[3], q[0], q[1], q[2], q[3],
+			(k0 >= 0) ? k1 - k0 : 0, segmentLength, (k3 >= 0) ? k3 - k2 : 0,
+			p[1] + m_FrameSize, m_pFrames);
+
+	double error = 0;
+	for (int i = 0; i < segmentLength - 1; i++) {
+		double frameError = FrameError(m_pFrames + (size_t) i * m_FrameSize, k1 + 1 + i);
+		if (frameError > error)
+			error = frameError;
+		if (error > maxError)
+			break;
+	}
+	return error;
+}
+
+int KeyframeSelector::SegmentFits(int k0, int k1, int end, double maxError)
+{
+	InterpolationType interpolationType = m_pInterpolator->m_InterpolationType;
+	if (interpolationType == LINEAR)
+		return SegmentError(k0, k1, end, -1, maxError) <= maxError;
+
+	// the keyframe after end is guessed to be as far from end as k1 is (Bezier needs a
+	// keyframe on at least one side)
+	int last = m_NumFrames - 1;
+	int k3 = (end == last) ? -1 : ((2 * end - k1 < last) ? 2 * end - k1 : last);
+	if ((interpolationType == BEZIER) && (k0 < 0) && (k3 < 0))
+		return 0;
+	return SegmentError(k0, k1, end, k3, maxError) <= maxError;
+}
+
+int KeyframeSelector::FindSegmentEnd(int k0, int k1, double maxError)
+{
+	int last = m_NumFrames - 1;
+
+	// segment k1..good fits, k1..bad does not
+	int good = k1 + 1, bad = -1;
+	for (int length = 2; (good < last) && (bad < 0); length *= 2) {
+		int end = (k1 + length < last) ? k1 + length : last;
+		if (SegmentFits(k0, k1, end, maxError))
+			good = end;
+		else
+			bad = end;
+	}
+
+	while (bad - good > 1) {
+		int end = (good + bad) / 2;
+		if (SegmentFits(k0, k1, end, maxError))
+			good = end;
+		else
+			bad = end;
+	}
+	return good;
+}
+
+int KeyframeSelector::Select(double maxError)
+{
+	int last = m_NumFrames - 1;
+	int bezier = (m_pInterpolator->m_InterpolationType == BEZIER);
+	// the cubic curves also depend on the keyframes before and after a segment
+	int cubic = (m_pInterpolator->m_InterpolationType != LINEAR);
+	if ((m_NumFrames < 2) || (bezier && (m_NumFrames < 4))) {
+		printf("Error: too few frames (%d) to select keyframes.\n", m_NumFrames);
+		return -1;
+	}
+
+	int * keyframes = new int[m_NumFrames];
+	int numKeyframes = 0;
+	keyframes[numKeyframes++] = 0;
+	while (keyframes[numKeyframes - 1] < last) {
+		int k0 = (numKeyframes >= 2) ? keyframes[numKeyframes - 2] : -1;
+		keyframes[numKeyframes] = FindSegmentEnd(k0, keyframes[numKeyframes - 1],
+				cubic ? CUBIC_MARGIN * maxError : maxError);
+		numKeyframes++;
+	}
+
+	if (bezier) {
+		// Bezier interpolation needs 4 keyframes: split the longest segments
+		while (numKeyframes < 4) {
+			int longest = 0;
+			for (int s = 1; s < numKeyframes - 1; s++)
+				if (keyframes[s + 1] - keyframes[s] > keyframes[longest + 1] - keyframes[longest])
+					longest = s;
+			memmove(keyframes + longest + 2, keyframes + longest + 1,
+					sizeof(int) * (numKeyframes - longest - 1));
+			keyframes[longest + 1] = (keyframes[longest] + keyframes[longest + 2]) / 2;
+			numKeyframes++;
+		}
+	}
+
+	if (cubic) {
+		// check the segments with their actual neighbors, splitting the ones over the
+		// budget; a keyframe added in segment s also changes segment s - 1, which is
+		// checked again
+		for (int s = 0; s < numKeyframes - 1;) {
+			double error = SegmentError((s > 0) ? keyframes[s - 1] : -1, keyframes[s], keyframes[s + 1],
+					(s + 2 < numKeyframes) ? keyframes[s + 2] : -1, maxError);
+			if (error <= maxError) {
+				s++;
+				continue;
+			}
+			memmove(keyframes + s + 2, keyframes + s + 1, sizeof(int) * (numKeyframes - s - 1));
+			keyframes[s + 1] = (keyframes[s] + keyframes[s + 2]) / 2;
+			numKeyframes++;
+			if (s > 0)
+				s--;
+		}
+	}
+
+	m_pInterpolator->ClearKeyframes();
+	for (int i = 0; i < numKeyframes; i++)
+		m_pInterpolator->AddNextKeyframePos(keyframes[i]);
+	delete[] keyframes;
+	return numKeyframes;
+}
+
+double KeyframeSelector::ComputeError()
+{
+	Motion * pOutputMotion = NULL;
+	m_pInterpolator->Interpolate(m_pInputMotion, &pOutputMotion, 0);
+	double error = 0;
+	for (int f = 0; f < m_NumFrames; f++) {
+		double frameError = FrameError(pOutputMotion->GetFrame(f), f);
+		if (frameError > error)
+			error = frameError;
+	}
+	delete pOutputMotion;
+	return error;
+}
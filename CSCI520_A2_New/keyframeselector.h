@@ -0,0 +1,79 @@
+/*
+ keyframeselector.h
+
+ Automatic keyframe selection: the fewest keyframes (found greedily) for which the
+ interpolated motion stays within an error budget of the input motion, for the
+ interpolation type, angle representation and IK setting of an Interpolator.
+
+ The error of a frame is either the largest rotation angle between the interpolated
+ and the input orientation of any bone (ANGLE_ERROR, in degrees), or the largest
+ distance between the interpolated and the input tip position of any bone, as given
+ by Skeleton::computeBoneTipPos (POSITION_ERROR, in skeleton units).
+
+ Keyframes are chosen from the first frame on, each as far after the previous one as
+ the budget allows (found by doubling the segment and then bisecting). Only the frames
+ of the segment being tried are interpolated and compared, and the comparison stops
+ at the first frame over the budget, so the cost grows with the length of the motion
+ times the logarithm of the segment lengths. Bezier, SQUAD and Catmull-Rom segments
+ also depend on the keyframe after their end, which is guessed while choosing (the
+ same distance again), so they are chosen within a smaller budget; the chosen keyframes
+ are then checked with their actual neighbors, and segments over the budget are split
+ in half.
+
+ */
+
+#ifndef _KEYFRAMESELECTOR_H
+#define _KEYFRAMESELECTOR_H
+
+#include "motion.h"
+#include "interpolator.h"
+
+enum KeyframeError {
+	ANGLE_ERROR = 0, POSITION_ERROR = 1
+};
+
+class KeyframeSelector {
+public:
+	// pInterpolator must stay alive while the selector is used
+	KeyframeSelector(Interpolator * pInterpolator, Motion * pInputMotion, KeyframeError errorType);
+	~KeyframeSelector();
+
+	// Replace the keyframes of the interpolator with the fewest the greedy search finds
+	// for which every frame is within maxError. The first and the last frame are always
+	// keyframes. Returns the number of keyframes, or -1 if the motion is too short for
+	// the interpolation type.
+	int Select(double maxError);
+
+	// largest error of any frame when the motion is interpolated with the current
+	// keyframes of the interpolator (with Interpolator::Interpolate)
+	double ComputeError();
+
+protected:
+	Interpolator * m_pInterpolator;
+	Motion * m_pInputMotion;
+	const Skeleton * m_pSkeleton;
+	SkeletonPose * m_pPose; // POSITION_ERROR poses the frames with this, not the skeleton
+	KeyframeError m_ErrorType;
+	int m_NumFrames;
+	int m_FrameSize;
+
+	// interpolated frames of the segment being tried
+	double * m_pFrames;
+	int m_FramesCapacity;
+	// quaternion track of the 4 keyframes of a segment
+	Quaternion<double> * m_Track;
+
+	// error of interpolated frame compared with input frame f
+	double FrameError(const double * frame, int f);
+	// Interpolate the frames strictly between keyframes at frames k1 and k2, with k0 and
+	// k3 the keyframes before and after (-1 for none), and return the largest error; the
+	// comparison stops at the first frame with an error over maxError.
+	double SegmentError(int k0, int k1, int k2, int k3, double maxError);
+	// whether segment k1..end (with k0 before it) is within maxError
+	int SegmentFits(int k0, int k1, int end, double maxError);
+	// largest frame end for which SegmentFits (at least k1 + 1)
+	int FindSegmentEnd(int k0, int k1, double maxError);
+};
+
+#endif
+
@@ -7,20 +7,24 @@
  */
 #include <stdio.h>
 #include <string.h>
-#include <fstream>
 #include <math.h>
 #include <stdlib.h>
 
 #include "skeleton.h"
 #include "motion.h"
 #include "vector.h"
+#include "fileio.h"
+#include "amcstream.h"
+#include "parallel.h"
 
 Motion::Motion(int numFrames_, Skeleton * pSkeleton_) {
 	pSkeleton = pSkeleton_;
-	m_NumFrames = numFrames_;
+	m_pFrames = NULL;
+	m_pScratchPosture = NULL;
+	m_pMappedFile = NULL;
 
 	//allocate postures array
-	m_pPostures = new Posture[m_NumFrames];
+	AllocateFrames(numFrames_);
 
 	//Set all postures to default posture
 	SetPosturesToDefault();
@@ -29,240 +33,471 @@ Motion::Motion(int numFrames_, Skeleton * pSkeleton_) {
 Motion::Motion(char *amc_filename, double scale, Skeleton * pSkeleton_) {
 	pSkeleton = pSkeleton_;
 	m_NumFrames = 0;
-	m_pPostures = NULL;
-
-	int code = readAMCfile(amc_filename, scale);
-	if (code < 0)
+	m_FrameSize = pSkeleton->getPostureLayout()->frameSize;
+	m_pFrames = NULL;
+	m_pScratchPosture = NULL;
+	m_pMappedFile = NULL;
+
+	int code;
+	if (isBinaryFile(amc_filename))
+		code = readBinaryFile(amc_filename, scale);
+	else
+		code = readAMCfile(amc_filename, scale);
+	if (code < 0) {
+		ReleaseFrames();
 		throw 1;
+	}
 }
 
 Motion::~Motion() {
-	if (m_pPostures != NULL)
-		delete[] m_pPostures;
+	ReleaseFrames();
+	if (m_pScratchPosture != NULL)
+		delete m_pScratchPosture;
+}
+
+void Motion::ReleaseFrames() {
+	if (m_pMappedFile != NULL)
+		delete m_pMappedFile;
+	else if (m_pFrames != NULL)
+		delete[] m_pFrames;
+	m_pMappedFile = NULL;
+	m_pFrames = NULL;
+}
+
+void Motion::AllocateFrames(int numFrames) {
+	ReleaseFrames();
+
+	m_NumFrames = numFrames;
+	m_FrameSize = pSkeleton->getPostureLayout()->frameSize;
+	m_pFrames = new double[(size_t) m_NumFrames * m_FrameSize];
 }
 
 //Set all postures to default posture
 void Motion::SetPosturesToDefault() {
-	for (int frame = 0; frame < m_NumFrames; frame++) {
-		//set root position to (0,0,0)
-		m_pPostures[frame].root_pos.setValue(0.0, 0.0, 0.0);
-		//set each bone orientation to (0,0,0)
-		for (int j = 0; j < MAX_BONES_IN_ASF_FILE; j++)
-			m_pPostures[frame].bone_rotation[j].setValue(0.0, 0.0, 0.0);
-
-	}
+	//root position and each bone orientation to (0,0,0)
+	memset(m_pFrames, 0, sizeof(double) * (size_t) m_NumFrames * m_FrameSize);
 }
 
 //Set posture at spesified frame
 void Motion::SetPosture(int frameIndex, Posture InPosture) {
-	m_pPostures[frameIndex] = InPosture;
+	GetPostureLayout()->Pack(InPosture, GetFrame(frameIndex));
 }
 
 void Motion::SetBoneRotation(int frameIndex, int boneIndex, vector vRot) {
-	m_pPostures[frameIndex].bone_rotation[boneIndex] = vRot;
+	int offset = GetPostureLayout()->rotationOffset[boneIndex];
+	if (offset < 0)
+		return;
+	vRot.getValue(GetFrame(frameIndex) + offset);
 }
 
 void Motion::SetRootPos(int frameIndex, vector vPos) {
-	m_pPostures[frameIndex].root_pos = vPos;
+	vPos.getValue(GetFrame(frameIndex) + PostureLayout::getRootPosOffset());
+}
+
+vector Motion::GetBoneRotation(int frameIndex, int boneIndex) {
+	int offset = GetPostureLayout()->rotationOffset[boneIndex];
+	if (offset < 0)
+		return vector(0.0, 0.0, 0.0);
+	return vector(GetFrame(frameIndex) + offset);
+}
+
+vector Motion::GetRootPos(int frameIndex) {
+	return vector(GetFrame(frameIndex) + PostureLayout::getRootPosOffset());
+}
+
+void Motion::GetPosture(int frameIndex, Posture * pPosture) {
+	GetPostureLayout()->Unpack(GetFrame(frameIndex), *pPosture);
 }
 
 Posture * Motion::GetPosture(int frameIndex) {
+	if (m_pScratchPosture == NULL)
+		m_pScratchPosture = new Posture;
+	GetPosture(frameIndex, m_pScratchPosture);
+	return m_pScratchPosture;
+}
+
+double * Motion::GetFrame(int frameIndex) {
 	if (frameIndex < 0 || frameIndex >= m_NumFrames) {
-		printf("Error in Motion::GetPosture: frame index %d is illegal.\n",
+		printf("Error in Motion::GetFrame: frame index %d is illegal.\n",
 				frameIndex);
 		printf("m_NumFrames = %d\n", m_NumFrames);
 		exit(0);
 	}
-	return &(m_pPostures[frameIndex]);
+	return m_pFrames + (size_t) frameIndex * m_FrameSize;
 }
 
-int Motion::readAMCfile(char* name, double scale) {
-	Bone *hroot, *bone;
-	bone = hroot = pSkeleton->getRoot();
-
-	std::ifstream file(name, std::ios::in);
-	if (file.fail())
-		return -1;
-
-	int n = 0;
-	char str[2048];
+void Motion::SetFrame(int frameIndex, const double * frame) {
+	memcpy(GetFrame(frameIndex), frame, sizeof(double) * m_FrameSize);
+}
 
-	// count the number of lines
-	while (!file.eof()) {
-		file.getline(str, 2048);
-		if (file.eof())
-			break;
-		//We do not want to count empty lines
-		if (strcmp(str, "") != 0)
-			n++;
+// frame-number lines found in one byte range of an AMC file
+struct AMCScanChunk {
+	const char * begin;
+	const char * end;
+	const char * fileEnd;
+	const char ** frameStarts;
+	int numFrames;
+	int capacity;
+};
+
+static void ScanAMCChunk(int index, void * data) {
+	AMCScanChunk * chunk = (AMCScanChunk *) data + index;
+	const char * p = chunk->begin;
+
+	// a frame starts at every line whose first character is a digit
+	while ((p = (const char *) memchr(p, '\n', chunk->end - p)) != NULL) {
+		p++;
+		const char * q = p;
+		while ((q < chunk->fileEnd) && ((*q == ' ') || (*q == '\t') || (*q == '\r')))
+			q++;
+		if ((q == chunk->fileEnd) || (*q < '0') || (*q > '9'))
+			continue;
+
+		if (chunk->numFrames == chunk->capacity) {
+			chunk->capacity = (chunk->capacity == 0) ? 1024 : 2 * chunk->capacity;
+			chunk->frameStarts = (const char **) realloc(chunk->frameStarts,
+					sizeof(const char *) * chunk->capacity);
+		}
+		chunk->frameStarts[chunk->numFrames++] = q;
 	}
+}
 
-	file.close();
-
-	//Compute number of frames. 
-	//Subtract 3 to  ignore the header
-	//There are (NUM_BONES_IN_ASF_FILE - 2) moving bones and 2 dummy bones (lhipjoint and rhipjoint)
-	int numbones = pSkeleton->numBonesInSkel(bone[0]);
-	int movbones = pSkeleton->movBonesInSkel(bone[0]);
-	n = (n - 3) / ((movbones) + 1);
-
-	m_NumFrames = n;
+// a range of frames parsed by one task
+struct AMCParseJob {
+	Skeleton * pSkeleton;
+	double scale;
+	const char ** frameStarts; // numFrames + 1 entries; the last one is the end of the file
+	double * frames;
+	int frameSize;
+	int numFrames;
+	int framesPerTask;
+	int * taskErrors;
+};
+
+static void ParseAMCFrames(int index, void * data) {
+	AMCParseJob * job = (AMCParseJob *) data;
+	Bone * bones = job->pSkeleton->getRoot();
+
+	int first = index * job->framesPerTask;
+	int last = first + job->framesPerTask;
+	if (last > job->numFrames)
+		last = job->numFrames;
+
+	for (int f = first; f < last; f++) {
+		double * frame = job->frames + (size_t) f * job->frameSize;
+		memset(frame, 0, sizeof(double) * job->frameSize);
+
+		const char * end = job->frameStarts[f + 1];
+		int frame_num;
+		const char * p = ParseInt(job->frameStarts[f], end, &frame_num);
+		p = ParseAMCFrame(p, end, job->pSkeleton, bones, job->scale, frame, f + 1);
+		if (p != end) {
+			if (p != NULL)
+				printf("Error in Motion::readAMCfile: unexpected number in frame %d.\n", f + 1);
+			job->taskErrors[index] = 1;
+			return;
+		}
+	}
+}
 
-	//Allocate memory for state vector
-	m_pPostures = new Posture[m_NumFrames];
+static int TokenEquals(const char * token, size_t length, const char * keyword) {
+	return (strlen(keyword) == length) && (strncmp(token, keyword, length) == 0);
+}
 
-	//Set all postures to default posture
-	SetPosturesToDefault();
+// The frame-number lines are located first, so that all frames can be allocated at
+// once; then chunks of frames are parsed concurrently, each into its own frames.
+int Motion::readAMCfile(char* name, double scale) {
+	MappedFile file;
+	if (file.Open(name) != 0)
+		return -1;
 
-	file.open(name);
+	const char * p = file.GetData();
+	const char * end = p + file.GetSize();
 
 	// process the header (add rotational DOFs to skeleton if requested)
 	while (1) {
-		file >> str;
+		p = SkipWhitespace(p, end);
+		if (p == end) {
+			printf("Error in Motion::readAMCfile: no :DEGREES line in '%s'.\n", name);
+			return -1;
+		}
+
+		// comment line
+		if (*p == '#') {
+			p = SkipLine(p, end);
+			continue;
+		}
+
+		const char * token = p;
+		p = SkipToken(p, end);
 
-		if (strcmp(str, ":FORCE-ALL-JOINTS-BE-3DOF") == 0)
+		if (TokenEquals(token, p - token, ":FORCE-ALL-JOINTS-BE-3DOF"))
 			pSkeleton->enableAllRotationalDOFs();
 
-		if (strcmp(str, ":DEGREES") == 0)
+		if (TokenEquals(token, p - token, ":DEGREES"))
 			break;
 	}
 
-	for (int i = 0; i < m_NumFrames; i++) {
-		//read frame number
-		int frame_num;
-		file >> frame_num;
-
-		//There are (NUM_BONES_IN_ASF_FILE - 2) movable bones and 2 dummy bones (lhipjoint and rhipjoint)
-		for (int j = 0; j < movbones; j++) {
-			//read bone name
-			file >> str;
-
-			//fine the bone index corresponding to the bone name
-			int bone_idx;
-			for (bone_idx = 0; bone_idx < numbones; bone_idx++)
-				if (strcmp(str, pSkeleton->idx2name(bone_idx)) == 0)
-					break;
-
-			//init rotation angles for this bone to (0, 0, 0)
-			m_pPostures[i].bone_rotation[bone_idx].setValue(0.0, 0.0, 0.0);
-
-			for (int x = 0; x < bone[bone_idx].dof; x++) {
-				double tmp;
-				file >> tmp;
-				//	printf("%d %f\n",bone[bone_idx].dofo[x],tmp);
-				switch (bone[bone_idx].dofo[x]) {
-				case 0:
-					printf("FATAL ERROR in bone %d not found %d\n", bone_idx,
-							x);
-					x = bone[bone_idx].dof;
-					break;
-				case 1:
-					m_pPostures[i].bone_rotation[bone_idx].p[0] = tmp;
-					break;
-				case 2:
-					m_pPostures[i].bone_rotation[bone_idx].p[1] = tmp;
-					break;
-				case 3:
-					m_pPostures[i].bone_rotation[bone_idx].p[2] = tmp;
-					break;
-				case 4:
-					m_pPostures[i].bone_translation[bone_idx].p[0] = tmp
-							* scale;
-					break;
-				case 5:
-					m_pPostures[i].bone_translation[bone_idx].p[1] = tmp
-							* scale;
-					break;
-				case 6:
-					m_pPostures[i].bone_translation[bone_idx].p[2] = tmp
-							* scale;
-					break;
-				case 7:
-					m_pPostures[i].bone_length[bone_idx].p[0] = tmp; // * scale;
-					break;
-				}
-			}
-			if (strcmp(str, "root") == 0) {
-				m_pPostures[i].root_pos.p[0] =
-						m_pPostures[i].bone_translation[0].p[0];  // * scale;
-				m_pPostures[i].root_pos.p[1] =
-						m_pPostures[i].bone_translation[0].p[1];  // * scale;
-				m_pPostures[i].root_pos.p[2] =
-						m_pPostures[i].bone_translation[0].p[2];  // * scale;
-			}
+	p = SkipWhitespace(p, end);
+	if ((p < end) && ((*p < '0') || (*p > '9'))) {
+		printf("Error in Motion::readAMCfile: bone data before the first frame number.\n");
+		return -1;
+	}
 
-			// read joint angles, including root orientation
-		}
+	// find the frame-number lines, in chunks of at least 1 MB
+	int numChunks = GetNumThreads();
+	if ((end - p) / (1 << 20) + 1 < numChunks)
+		numChunks = (int) ((end - p) / (1 << 20)) + 1;
+	AMCScanChunk * chunks = new AMCScanChunk[numChunks];
+	for (int c = 0; c < numChunks; c++) {
+		chunks[c].begin = p + (end - p) * c / numChunks;
+		chunks[c].end = p + (end - p) * (c + 1) / numChunks;
+		chunks[c].fileEnd = end;
+		chunks[c].frameStarts = NULL;
+		chunks[c].numFrames = chunks[c].capacity = 0;
+	}
+	ParallelFor(numChunks, ScanAMCChunk, chunks);
+
+	int numFrames = (p < end) ? 1 : 0;
+	for (int c = 0; c < numChunks; c++)
+		numFrames += chunks[c].numFrames;
+
+	const char ** frameStarts = new const char *[numFrames + 1];
+	frameStarts[0] = p;
+	int numFramesFound = (p < end) ? 1 : 0;
+	for (int c = 0; c < numChunks; c++) {
+		memcpy(frameStarts + numFramesFound, chunks[c].frameStarts,
+				sizeof(const char *) * chunks[c].numFrames);
+		numFramesFound += chunks[c].numFrames;
+		free(chunks[c].frameStarts);
 	}
+	frameStarts[numFrames] = end;
+	delete[] chunks;
+
+	// parse the frames
+	AllocateFrames(numFrames);
+
+	AMCParseJob job;
+	job.pSkeleton = pSkeleton;
+	job.scale = scale;
+	job.frameStarts = frameStarts;
+	job.frames = m_pFrames;
+	job.frameSize = m_FrameSize;
+	job.numFrames = numFrames;
+	job.framesPerTask = numFrames / (8 * GetNumThreads()) + 1;
+	if (job.framesPerTask < 64)
+		job.framesPerTask = 64;
+	int numTasks = (numFrames + job.framesPerTask - 1) / job.framesPerTask;
+	job.taskErrors = new int[numTasks + 1];
+	memset(job.taskErrors, 0, sizeof(int) * (numTasks + 1));
+
+	ParallelFor(numTasks, ParseAMCFrames, &job);
+
+	int error = 0;
+	for (int t = 0; t < numTasks; t++)
+		error |= job.taskErrors[t];
+	delete[] job.taskErrors;
+	delete[] frameStarts;
+	if (error)
+		return -1;
 
-	file.close();
-	printf("%d samples in '%s' are read.\n", n, name);
-	return n;
+	printf("%d samples in '%s' are read.\n", m_NumFrames, name);
+	return m_NumFrames;
 }
 
+// Text is formatted into a large buffer (shortest round-trip numbers, see FormatDouble)
+// and written out in big chunks.
 int Motion::writeAMCfile(char * filename, double scale,
 		int forceAllJointsBe3DOF) {
-	Bone * bone = pSkeleton->getRoot();
+	OutputBuffer os;
+	if (os.Open(filename) != 0)
+		return -1;
+
+	AppendAMCHeader(os, forceAllJointsBe3DOF);
+	for (int f = 0; f < m_NumFrames; f++)
+		AppendAMCFrame(os, pSkeleton, GetFrame(f), f + 1, scale);
+
+	if (os.Close() != 0) {
+		printf("Error: failed to write '%s'\n", filename);
+		return -1;
+	}
+	printf("Write %d samples to '%s' \n", m_NumFrames, filename);
+	return 0;
+}
+
+// binary motion file header; frames follow at dataOffset (a multiple of 64 bytes)
+struct BinaryMotionHeader {
+	char magic[8];
+	unsigned int version;
+	unsigned int byteOrder; // binaryByteOrder as written by the producing machine
+	unsigned int valueSize; // 8: double, 4: float
+	unsigned int frameSize; // values per frame
+	unsigned int numFrames;
+	unsigned int dataOffset;
+	unsigned long long layoutFingerprint; // PostureLayout::fingerprint
+	double scale; // translations are stored multiplied by this scale
+	char reserved[16];
+};
+
+static const char binaryMagic[8] = { 'M', 'O', 'T', 'I', 'O', 'N', 'B', 0 };
+static const unsigned int binaryVersion = 1;
+static const unsigned int binaryByteOrder = 0x01020304;
+
+int Motion::isBinaryFile(char* filename) {
+	char magic[8];
+	FILE * file = fopen(filename, "rb");
+	if (file == NULL)
+		return 0;
+	int isBinary = (fread(magic, 1, 8, file) == 8) && (memcmp(magic, binaryMagic, 8) == 0);
+	fclose(file);
+	return isBinary;
+}
+
+int Motion::writeBinaryFile(char* filename, double scale, int singlePrecision) {
+	BinaryMotionWriter writer(pSkeleton, scale, singlePrecision);
+	if (writer.Open(filename, m_NumFrames) != 0)
+		return -1;
+	for (int f = 0; f < m_NumFrames; f++)
+		writer.WriteFrame(GetFrame(f));
+
+	if (writer.Close() != 0) {
+		printf("Error: failed to write '%s'\n", filename);
+		return -1;
+	}
+	printf("Write %d samples to '%s' \n", m_NumFrames, filename);
+	return 0;
+}
+
+int Motion::readBinaryFile(char* name, double scale) {
+	MappedFile * file = new MappedFile;
+	if (file->Open(name, MappedFile::COPY_ON_WRITE) != 0) {
+		delete file;
+		return -1;
+	}
 
-	std::ofstream os(filename);
-	if (os.fail())
+	BinaryMotionHeader header;
+	const char * error = NULL;
+	if (file->GetSize() < sizeof(header))
+		error = "truncated header";
+	else {
+		memcpy(&header, file->GetData(), sizeof(header));
+		if (header.byteOrder != binaryByteOrder)
+			error = "written on a machine with a different byte order";
+		else if (header.version != binaryVersion)
+			error = "unsupported version";
+		else if ((header.valueSize != sizeof(double)) && (header.valueSize != sizeof(float)))
+			error = "unsupported value type";
+		else if ((header.layoutFingerprint != GetPostureLayout()->fingerprint)
+				|| ((int) header.frameSize != m_FrameSize))
+			error = "recorded for a different skeleton";
+		else if ((header.dataOffset % sizeof(double) != 0) || (file->GetSize()
+				< header.dataOffset + (size_t) header.valueSize * header.numFrames * header.frameSize))
+			error = "truncated frame data";
+	}
+	if (error != NULL) {
+		printf("Error in Motion::readBinaryFile: '%s' %s.\n", name, error);
+		delete file;
 		return -1;
+	}
 
-	// header lines
-	os << ":FULLY-SPECIFIED" << std::endl;
-	if (forceAllJointsBe3DOF)
-		os << ":FORCE-ALL-JOINTS-BE-3DOF" << std::endl;
-	os << ":DEGREES" << std::endl;
-
-	int numbones = pSkeleton->numBonesInSkel(bone[0]);
-
-	int root = Skeleton::getRootIndex();
-	for (int f = 0; f < m_NumFrames; f++) {
-		os << f + 1 << std::endl;
-		os << "root " << m_pPostures[f].root_pos.p[0] / scale << " "
-				<< m_pPostures[f].root_pos.p[1] / scale << " "
-				<< m_pPostures[f].root_pos.p[2] / scale << " "
-				<< m_pPostures[f].bone_rotation[root].p[0] << " "
-				<< m_pPostures[f].bone_rotation[root].p[1] << " "
-				<< m_pPostures[f].bone_rotation[root].p[2];
-
-		for (int j = 2; j < numbones; j++) {
-			//output bone name
-			if (bone[j].dof != 0) {
-				os << std::endl << pSkeleton->idx2name(j);
-
-				//output bone rotation angles
-				for (int d = 0; d < bone[j].dof; d++) {
-					// traverse all DOFs
-
-					// is this DOF rx ?
-					if (bone[j].dofo[d] == 1) {
-						// if enabled, output the DOF
-						if (bone[j].dofrx == 1)
-							os << " " << m_pPostures[f].bone_rotation[j].p[0];
-					}
-
-					// is this DOF ry ?
-					if (bone[j].dofo[d] == 2) {
-						// if enabled, output the DOF
-						if (bone[j].dofry == 1)
-							os << " " << m_pPostures[f].bone_rotation[j].p[1];
-					}
-
-					// is this DOF rz ?
-					if (bone[j].dofo[d] == 3) {
-						// if enabled, output the DOF
-						if (bone[j].dofrz == 1)
-							os << " " << m_pPostures[f].bone_rotation[j].p[2];
-					}
-				}
+	m_NumFrames = header.numFrames;
+	char * data = file->GetData() + header.dataOffset;
+	if (header.valueSize == sizeof(double)) {
+		// use the mapped frames in place
+		m_pFrames = (double *) data;
+		m_pMappedFile = file;
+	}
+	else {
+		AllocateFrames(header.numFrames);
+		const float * source = (const float *) data;
+		for (size_t i = 0; i < (size_t) m_NumFrames * m_FrameSize; i++)
+			m_pFrames[i] = source[i];
+		delete file;
+	}
+
+	// translations were stored with the writer's scale
+	if (header.scale != scale) {
+		const PostureLayout * layout = GetPostureLayout();
+		int numActiveBones = pSkeleton->getNumActiveBones();
+		const int * activeBones = pSkeleton->getActiveBones();
+		double factor = scale / header.scale;
+		for (int f = 0; f < m_NumFrames; f++) {
+			double * frame = GetFrame(f);
+			for (int i = 0; i < numActiveBones; i++) {
+				int offset = layout->translationOffset[activeBones[i]];
+				if (offset >= 0)
+					for (int d = 0; d < 3; d++)
+						frame[offset + d] *= factor;
 			}
 		}
-		os << std::endl;
 	}
 
-	os.close();
-	printf("Write %d samples to '%s' \n", m_NumFrames, filename);
+	printf("%d samples in '%s' are read.\n", m_NumFrames, name);
+	return m_NumFrames;
+}
+
+BinaryMotionWriter::BinaryMotionWriter(Skeleton * pSkeleton, double scale, int singlePrecision) {
+	m_pSkeleton = pSkeleton;
+	m_Scale = scale;
+	m_SinglePrecision = singlePrecision;
+	m_NumFrames = 0;
+	m_NumFramesWritten = 0;
+	m_pFloatFrame = NULL;
+	if (singlePrecision)
+		m_pFloatFrame = new float[pSkeleton->getPostureLayout()->frameSize];
+}
+
+BinaryMotionWriter::~BinaryMotionWriter() {
+	Close();
+	delete[] m_pFloatFrame;
+}
+
+int BinaryMotionWriter::Open(const char * filename, int numFrames) {
+	if (m_Output.Open(filename) != 0) {
+		printf("Error in BinaryMotionWriter::Open: cannot open '%s'.\n", filename);
+		return -1;
+	}
+	m_NumFrames = numFrames;
+	m_NumFramesWritten = 0;
+
+	BinaryMotionHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, binaryMagic, 8);
+	header.version = binaryVersion;
+	header.byteOrder = binaryByteOrder;
+	header.valueSize = m_SinglePrecision ? sizeof(float) : sizeof(double);
+	header.frameSize = m_pSkeleton->getPostureLayout()->frameSize;
+	header.numFrames = numFrames;
+	header.dataOffset = (sizeof(header) + 63) / 64 * 64;
+	header.layoutFingerprint = m_pSkeleton->getPostureLayout()->fingerprint;
+	header.scale = m_Scale;
+
+	char padding[64];
+	memset(padding, 0, sizeof(padding));
+	m_Output.Append((const char *) &header, sizeof(header));
+	m_Output.Append(padding, header.dataOffset - sizeof(header));
 	return 0;
 }
 
+int BinaryMotionWriter::Close() {
+	int code = m_Output.Close();
+	if (m_NumFramesWritten != m_NumFrames) {
+		printf("Error in BinaryMotionWriter::Close: %d frames written, %d announced.\n",
+				m_NumFramesWritten, m_NumFrames);
+		code = -1;
+	}
+	m_NumFrames = m_NumFramesWritten;
+	return code;
+}
+
+void BinaryMotionWriter::WriteFrame(const double * frame) {
+	int frameSize = m_pSkeleton->getPostureLayout()->frameSize;
+	m_NumFramesWritten++;
+	if (m_SinglePrecision) {
+		for (int i = 0; i < frameSize; i++)
+			m_pFloatFrame[i] = (float) frame[i];
+		m_Output.Append((const char *) m_pFloatFrame, sizeof(float) * frameSize);
+	}
+	else
+		m_Output.Append((const char *) frame, sizeof(double) * frameSize);
+}
@@ -6,6 +6,10 @@
  1. read an AMC file and store it in a sequence of state vector 
  2. write an AMC file
  3. export to a mrdplot format for plotting the trajectories
+ 4. read/write a binary motion file: a 64-byte header (magic, version, value type,
+    frame size, frame count, scale, skeleton layout fingerprint) followed by the
+    packed frames as fixed-stride records. Double precision files are memory-mapped
+    and used in place, without parsing or copying.
 
  You can add more motion data processing functions in this class. 
 
@@ -21,12 +25,15 @@
 #include "types.h"
 #include "posture.h"
 #include "skeleton.h"
+#include "fileio.h"
+#include "amcstream.h"
 
 class Motion {
 	//function members
 public:
 
 	// parse AMC file (default scale=0.06)
+	// binary motion files (see writeBinaryFile) are recognized by their header and mapped instead
 	Motion(char *amc_filename, double scale, Skeleton * pSkeleton);
 
 	//Use to create default motion with specified number of frames
@@ -41,6 +48,13 @@ public:
 	int writeAMCfile(char* filename, double scale,
 			int forceAllJointsBe3DOF = 0);
 
+	// write all frames into a binary motion file; translations are stored already scaled
+	// singlePrecision = 1 halves the file size, but such files are widened to doubles on load
+	int writeBinaryFile(char* filename, double scale, int singlePrecision = 0);
+
+	// returns 1 if the file starts with the binary motion file header
+	static int isBinaryFile(char* filename);
+
 	//Set all postures to default posture
 	//Root position at (0,0,0), orientation of each bone to (0,0,0)
 	void SetPosturesToDefault();
@@ -51,13 +65,36 @@ public:
 	//Set root position at specified frame
 	void SetRootPos(int frameIndex, vector vPos);
 	//Set specified bone rotation at specified frame
+	//(ignored for bones without DOFs, which have no storage)
 	void SetBoneRotation(int frameIndex, int boneIndex, vector vRot);
 
+	//Get root position / bone rotation at specified frame
+	vector GetRootPos(int frameIndex);
+	vector GetBoneRotation(int frameIndex, int boneIndex);
+
 	int GetNumFrames() {
 		return m_NumFrames;
 	}
+
+	//Unpack the posture at specified frame into a full Posture
+	void GetPosture(int frameIndex, Posture * pPosture);
+
+	//Legacy accessor: the returned posture is unpacked into a scratch buffer owned by the motion
+	//and is only valid until the next call. Prefer GetFrame or GetPosture(frameIndex, pPosture).
 	Posture * GetPosture(int frameIndex);
 
+	//Packed frame at specified frame; GetFrameSize() doubles laid out as described by GetPostureLayout()
+	double * GetFrame(int frameIndex);
+	void SetFrame(int frameIndex, const double * frame);
+
+	int GetFrameSize() {
+		return m_FrameSize;
+	}
+
+	const PostureLayout * GetPostureLayout() {
+		return pSkeleton->getPostureLayout();
+	}
+
 	Skeleton * GetSkeleton() {
 		return pSkeleton;
 	}
@@ -65,11 +102,48 @@ public:
 protected:
 	int m_NumFrames; //number of frames in the motion 
 	Skeleton * pSkeleton;
-	//Root position and all bone rotation angles for each frame (as read from AMC file)
-	Posture * m_pPostures;
+	//Root position and all bone rotation angles for each frame (as read from AMC file),
+	//packed with m_FrameSize doubles per frame
+	int m_FrameSize;
+	double * m_pFrames;
+	//scratch posture returned by the legacy GetPosture(frameIndex)
+	Posture * m_pScratchPosture;
+	//non-NULL if m_pFrames points into a memory-mapped binary motion file
+	MappedFile * m_pMappedFile;
+
+	//Allocate (zeroed) storage for numFrames packed frames
+	void AllocateFrames(int numFrames);
+	void ReleaseFrames();
 
 	// The default value is 0.06
 	int readAMCfile(char* name, double scale);
+	int readBinaryFile(char* name, double scale);
+};
+
+// Writes a binary motion file (see Motion::writeBinaryFile) one packed frame at a time,
+// without holding the motion in memory. The header records the number of frames, so
+// it must be known when the file is opened.
+class BinaryMotionWriter : public FrameWriter {
+public:
+	// see Motion::writeBinaryFile for scale and singlePrecision
+	BinaryMotionWriter(Skeleton * pSkeleton, double scale, int singlePrecision = 0);
+	~BinaryMotionWriter();
+
+	// open the file and write the header; returns 0 on success, -1 on failure
+	int Open(const char * filename, int numFrames);
+	// returns 0 on success, -1 if any write failed or if the number of frames
+	// written is not the one given to Open
+	int Close();
+
+	void WriteFrame(const double * frame);
+
+protected:
+	Skeleton * m_pSkeleton;
+	double m_Scale;
+	int m_SinglePrecision;
+	int m_NumFrames;
+	float * m_pFloatFrame;
+	OutputBuffer m_Output;
 };
 
 #endif
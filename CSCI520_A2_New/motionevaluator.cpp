@@ -0,0 +1,284 @@
+/*
+ motionevaluator.cpp
+
+ See motionevaluator.h.
+
+ */
+#include <stdio.h>
+#include <string.h>
+#include "motionevaluator.h"
+#include "cubiccurves.h"
+
+MotionEvaluator::MotionEvaluator(Motion * pMotion, const int * keyframes, int numKeyframes,
+		InterpolationType interpolationType, AngleRepresentation angleRepresentation)
+{
+	if ((numKeyframes < 1) || ((interpolationType == BEZIER) && (numKeyframes <= 3))) {
+		printf("Error: too few keyframes to interpolate.\n");
+		throw 1;
+	}
+	if ((interpolationType == SQUAD) && (angleRepresentation == EULER)) {
+		printf("Error: SQUAD only interpolates quaternions.\n");
+		throw 1;
+	}
+	for (int i = 0; i < numKeyframes; i++)
+		if ((keyframes[i] < 0) || (keyframes[i] >= pMotion->GetNumFrames())
+				|| ((i > 0) && (keyframes[i] <= keyframes[i - 1]))) {
+			printf("Error: keyframe %d is not an increasing frame index of the motion.\n", i);
+			throw 1;
+		}
+
+	m_pMotion = pMotion;
+	m_pSkeleton = pMotion->GetSkeleton();
+	m_FrameSize = pMotion->GetFrameSize();
+	m_InterpolationType = interpolationType;
+	m_AngleRepresentation = angleRepresentation;
+
+	m_NumKeyframes = numKeyframes;
+	m_KeyframePos = new int[numKeyframes];
+	memcpy(m_KeyframePos, keyframes, sizeof(int) * numKeyframes);
+	m_KeyframeInterval = (numKeyframes > 1) ? keyframes[1] - keyframes[0] : 1;
+	for (int i = 1; i < numKeyframes; i++)
+		if (keyframes[i] - keyframes[i - 1] != m_KeyframeInterval)
+			m_KeyframeInterval = 0;
+
+	// the control points and the track are computed as Interpolator does
+	Interpolator interpolator;
+	interpolator.SetInterpolationType(interpolationType);
+	interpolator.SetAngleRepresentation(angleRepresentation);
+	interpolator.SetIKSolverOnOFF(false);
+	interpolator.m_pSkeleton = m_pSkeleton;
+	interpolator.FindRotations();
+	m_NumRotations = interpolator.m_NumRotations;
+	memcpy(m_RotationOffsets, interpolator.m_RotationOffsets, sizeof(int) * m_NumRotations);
+
+	m_NumCurves = 0;
+	m_CurveOffsets[m_NumCurves++] = PostureLayout::getRootPosOffset();
+	if (angleRepresentation == EULER)
+		for (int rotation = 0; rotation < m_NumRotations; rotation++)
+			m_CurveOffsets[m_NumCurves++] = m_RotationOffsets[rotation];
+
+	int numSegments = numKeyframes - 1;
+	m_Coefficients = NULL;
+	if (interpolationType != LINEAR) {
+		m_Coefficients = new double[(size_t) numSegments * 12 * m_NumCurves];
+		double * p1Values = new double[3 * m_NumCurves];
+		double * aValues = new double[3 * m_NumCurves];
+		double * bValues = new double[3 * m_NumCurves];
+		double * p2Values = new double[3 * m_NumCurves];
+		for (int segment = 0; segment < numSegments; segment++) {
+			const double * p0 = NULL, * p3 = NULL;
+			if (segment > 0)
+				p0 = pMotion->GetFrame(keyframes[segment - 1]);
+			if (segment < numSegments - 1)
+				p3 = pMotion->GetFrame(keyframes[segment + 2]);
+			const double * p1 = pMotion->GetFrame(keyframes[segment]);
+			const double * p2 = pMotion->GetFrame(keyframes[segment + 1]);
+
+			for (int i = 0; i < m_NumCurves; i++) {
+				vector controlA, controlB;
+				if (interpolationType == BEZIER)
+					interpolator.EulerControlPoints(p0, p1, p2, p3, m_CurveOffsets[i], controlA, controlB);
+				else
+					interpolator.CatmullRomControlPoints(p0, p1, p2, p3, PreviousLength(segment),
+							SegmentLength(segment), NextLength(segment), m_CurveOffsets[i],
+							controlA, controlB);
+				vector(p1 + m_CurveOffsets[i]).getValue(p1Values + 3 * i);
+				controlA.getValue(aValues + 3 * i);
+				controlB.getValue(bValues + 3 * i);
+				vector(p2 + m_CurveOffsets[i]).getValue(p2Values + 3 * i);
+			}
+			BezierToPowerForm(3 * m_NumCurves, p1Values, aValues, bValues, p2Values,
+					m_Coefficients + (size_t) segment * 12 * m_NumCurves);
+		}
+		delete[] p1Values;
+		delete[] aValues;
+		delete[] bValues;
+		delete[] p2Values;
+	}
+
+	m_Track = NULL;
+	m_QuaternionControlPoints = NULL;
+	if (angleRepresentation == QUATERNION) {
+		Quaternion<double> * track = new Quaternion<double>[(size_t) numKeyframes * m_NumRotations];
+		for (int keyframe = 0; keyframe < numKeyframes; keyframe++)
+			interpolator.KeyframeQuaternions(pMotion->GetFrame(keyframes[keyframe]),
+					track + (size_t) keyframe * m_NumRotations);
+
+		m_Track = new double[(size_t) numKeyframes * 4 * m_NumRotations];
+		for (int keyframe = 0; keyframe < numKeyframes; keyframe++) {
+			QuaternionArrays arrays = GetQuaternions(m_Track, keyframe);
+			for (int rotation = 0; rotation < m_NumRotations; rotation++) {
+				const Quaternion<double> & q = track[(size_t) keyframe * m_NumRotations + rotation];
+				arrays.s[rotation] = q.Gets();
+				arrays.x[rotation] = q.Getx();
+				arrays.y[rotation] = q.Gety();
+				arrays.z[rotation] = q.Getz();
+			}
+		}
+
+		if (interpolationType != LINEAR) {
+			m_QuaternionControlPoints = new double[(size_t) numSegments * 8 * m_NumRotations];
+			for (int segment = 0; segment < numSegments; segment++) {
+				const Quaternion<double> * q1 = track + (size_t) segment * m_NumRotations;
+				const Quaternion<double> * q2 = q1 + m_NumRotations;
+				const Quaternion<double> * q0 = (segment > 0) ? q1 - m_NumRotations : NULL;
+				const Quaternion<double> * q3 = (segment < numSegments - 1) ? q2 + m_NumRotations : NULL;
+
+				QuaternionArrays a = GetQuaternions(m_QuaternionControlPoints, 2 * segment);
+				QuaternionArrays b = GetQuaternions(m_QuaternionControlPoints, 2 * segment + 1);
+				for (int rotation = 0; rotation < m_NumRotations; rotation++) {
+					Quaternion<double> start, controlA, controlB, end;
+					if (interpolationType == BEZIER)
+						interpolator.QuaternionControlPoints(q0, q1, q2, q3, rotation, start, controlA,
+								controlB, end);
+					else
+						interpolator.SquadControlPoints(q0, q1, q2, q3, PreviousLength(segment),
+								SegmentLength(segment), NextLength(segment), rotation, controlA, controlB);
+					a.s[rotation] = controlA.Gets();
+					a.x[rotation] = controlA.Getx();
+					a.y[rotation] = controlA.Gety();
+					a.z[rotation] = controlA.Getz();
+					b.s[rotation] = controlB.Gets();
+					b.x[rotation] = controlB.Getx();
+					b.y[rotation] = controlB.Gety();
+					b.z[rotation] = controlB.Getz();
+				}
+			}
+		}
+		delete[] track;
+	}
+}
+
+MotionEvaluator::~MotionEvaluator()
+{
+	delete[] m_KeyframePos;
+	delete[] m_Coefficients;
+	delete[] m_Track;
+	delete[] m_QuaternionControlPoints;
+}
+
+QuaternionArrays MotionEvaluator::GetQuaternions(double * storage, int block) const
+{
+	double * s = storage + (size_t) block * 4 * m_NumRotations;
+	QuaternionArrays arrays = { s, s + m_NumRotations, s + 2 * m_NumRotations, s + 3 * m_NumRotations };
+	return arrays;
+}
+
+int MotionEvaluator::SegmentLength(int segment) const
+{
+	return m_KeyframePos[segment + 1] - m_KeyframePos[segment];
+}
+
+int MotionEvaluator::PreviousLength(int segment) const
+{
+	return (segment > 0) ? SegmentLength(segment - 1) : 0;
+}
+
+int MotionEvaluator::NextLength(int segment) const
+{
+	return (segment < m_NumKeyframes - 2) ? SegmentLength(segment + 1) : 0;
+}
+
+int MotionEvaluator::FindSegment(double t) const
+{
+	int segment;
+	if (m_KeyframeInterval > 0)
+		segment = (int) ((t - m_KeyframePos[0]) / m_KeyframeInterval);
+	else {
+		// the last keyframe at or before t
+		int low = 0, high = m_NumKeyframes - 1;
+		while (low < high) {
+			int middle = (low + high + 1) / 2;
+			if (m_KeyframePos[middle] <= t)
+				low = middle;
+			else
+				high = middle - 1;
+		}
+		segment = low;
+	}
+	if (segment > m_NumKeyframes - 2)
+		segment = m_NumKeyframes - 2;
+	if (segment < 0)
+		segment = 0;
+	return segment;
+}
+
+void MotionEvaluator::Evaluate(double t, double * frame) const
+{
+	if (!(t > GetStartTime()))
+		t = GetStartTime();
+	if (t > GetEndTime())
+		t = GetEndTime();
+
+	// at the keyframes (and with a single keyframe), the keyframe itself
+	int segment = (m_NumKeyframes > 1) ? FindSegment(t) : 0;
+	const double * p1 = m_pMotion->GetFrame(m_KeyframePos[segment]);
+	if ((m_NumKeyframes == 1) || (t == m_KeyframePos[segment])) {
+		memcpy(frame, p1, sizeof(double) * m_FrameSize);
+		return;
+	}
+	const double * p2 = m_pMotion->GetFrame(m_KeyframePos[segment + 1]);
+	if (t == m_KeyframePos[segment + 1]) {
+		memcpy(frame, p2, sizeof(double) * m_FrameSize);
+		return;
+	}
+
+	// the same parameter as Interpolator for the frames of the segment
+	double u = (t - m_KeyframePos[segment]) / (m_KeyframePos[segment + 1] - m_KeyframePos[segment]);
+	memset(frame, 0, sizeof(double) * m_FrameSize);
+
+	// root position, and with EULER, bone rotations
+	if (m_InterpolationType == LINEAR)
+		for (int i = 0; i < m_NumCurves; i++) {
+			int offset = m_CurveOffsets[i];
+			(vector(p1 + offset) * (1 - u) + vector(p2 + offset) * u).getValue(frame + offset);
+		}
+	else {
+		double values[3 * (MAX_BONES_IN_ASF_FILE + 1)];
+		EvaluatePowerForm(3 * m_NumCurves, m_Coefficients + (size_t) segment * 12 * m_NumCurves, u, values);
+		for (int i = 0; i < m_NumCurves; i++)
+			vector(values + 3 * i).getValue(frame + m_CurveOffsets[i]);
+	}
+	if (m_AngleRepresentation == EULER)
+		return;
+
+	// bone rotations, as in Interpolator::InterpolateSegmentKernel
+	double temp[3][4 * MAX_BONES_IN_ASF_FILE];
+	QuaternionArrays temp1 = { temp[0], temp[0] + m_NumRotations, temp[0] + 2 * m_NumRotations, temp[0] + 3 * m_NumRotations };
+	QuaternionArrays temp2 = { temp[1], temp[1] + m_NumRotations, temp[1] + 2 * m_NumRotations, temp[1] + 3 * m_NumRotations };
+	QuaternionArrays temp3 = { temp[2], temp[2] + m_NumRotations, temp[2] + 2 * m_NumRotations, temp[2] + 3 * m_NumRotations };
+	QuaternionArrays q1 = GetQuaternions(m_Track, segment);
+	QuaternionArrays q2 = GetQuaternions(m_Track, segment + 1);
+	int n = m_NumRotations;
+	if (m_InterpolationType == LINEAR)
+		SlerpArrays(n, q1, q2, u, temp1);
+	else if (m_InterpolationType != BEZIER) {
+		QuaternionArrays s1 = GetQuaternions(m_QuaternionControlPoints, 2 * segment);
+		QuaternionArrays s2 = GetQuaternions(m_QuaternionControlPoints, 2 * segment + 1);
+		SlerpArrays(n, q1, q2, u, temp1);
+		SlerpArrays(n, s1, s2, u, temp2);
+		SlerpArrays(n, temp1, temp2, 2 * u * (1 - u), temp1);
+	}
+	else {
+		QuaternionArrays qa = GetQuaternions(m_QuaternionControlPoints, 2 * segment);
+		QuaternionArrays qb = GetQuaternions(m_QuaternionControlPoints, 2 * segment + 1);
+		SlerpArrays(n, q1, qa, u, temp1);
+		SlerpArrays(n, qa, qb, u, temp2);
+		SlerpArrays(n, qb, q2, u, temp3);
+		SlerpArrays(n, temp1, temp2, u, temp1);
+		SlerpArrays(n, temp2, temp3, u, temp2);
+		SlerpArrays(n, temp1, temp2, u, temp1);
+	}
+	double resultEuler[3 * MAX_BONES_IN_ASF_FILE];
+	QuaternionArraysToEuler(n, temp1, resultEuler);
+	for (int rotation = 0; rotation < n; rotation++)
+		vector(resultEuler + 3 * rotation).getValue(frame + m_RotationOffsets[rotation]);
+}
+
+void MotionEvaluator::Evaluate(double t, Posture * pPosture) const
+{
+	// a packed frame never holds more than a Posture
+	double frame[sizeof(Posture) / sizeof(double)];
+	Evaluate(t, frame);
+	m_pSkeleton->getPostureLayout()->Unpack(frame, *pPosture);
+}
@@ -0,0 +1,94 @@
+/*
+ motionevaluator.h
+
+ Continuous-time evaluation of an interpolated motion: the posture at any (fractional)
+ frame time t, with the interpolation type and angle representation of Interpolator,
+ without creating the interpolated motion.
+
+ Everything that only depends on a segment (the quaternion track of the keyframes and
+ the control points of the curves) is computed once by the constructor; Evaluate then finds
+ the segment of t (in constant time for uniformly spaced keyframes, by binary search
+ otherwise) and evaluates the curves at t. At integer times, the postures are those
+ Interpolator::Interpolate writes (without IK, which the evaluator does not support).
+
+ Evaluate does not modify the evaluator, so several threads may sample the same
+ evaluator at once. The motion must stay alive (and unchanged) while it is sampled.
+
+ */
+
+#ifndef _MOTIONEVALUATOR_H
+#define _MOTIONEVALUATOR_H
+
+#include "motion.h"
+#include "interpolator.h"
+#include "quaternionarrays.h"
+
+class MotionEvaluator {
+public:
+	// keyframes are numKeyframes increasing frame indices of pMotion; Bezier interpolation
+	// needs at least 4 of them. Throws 1 if the keyframes are not valid (or for SQUAD
+	// with EULER).
+	MotionEvaluator(Motion * pMotion, const int * keyframes, int numKeyframes,
+			InterpolationType interpolationType, AngleRepresentation angleRepresentation);
+	~MotionEvaluator();
+
+	// the curves are defined from the first to the last keyframe
+	double GetStartTime() const {
+		return m_KeyframePos[0];
+	}
+	double GetEndTime() const {
+		return m_KeyframePos[m_NumKeyframes - 1];
+	}
+
+	int GetFrameSize() const {
+		return m_FrameSize;
+	}
+
+	// Posture at time t (in frames: t = 12.5 is halfway between frames 12 and 13), as a
+	// packed frame of GetFrameSize() doubles (see PostureLayout). t is clamped to
+	// [GetStartTime(), GetEndTime()]; at a keyframe, the keyframe is returned as is.
+	void Evaluate(double t, double * frame) const;
+	void Evaluate(double t, Posture * pPosture) const;
+
+protected:
+	Motion * m_pMotion;
+	const Skeleton * m_pSkeleton;
+	int m_FrameSize;
+	InterpolationType m_InterpolationType;
+	AngleRepresentation m_AngleRepresentation;
+
+	int m_NumKeyframes;
+	int * m_KeyframePos; // indexed from 0
+	int m_KeyframeInterval; // > 0 if all keyframes are that many frames apart
+
+	// root position and bone rotations with a slot in the packed frames
+	int m_NumCurves;
+	int m_CurveOffsets[MAX_BONES_IN_ASF_FILE + 1]; // the root position is curve 0
+	int m_NumRotations;
+	int m_RotationOffsets[MAX_BONES_IN_ASF_FILE];
+
+	// BEZIER, CATMULL_ROM, EULER: power form of every curve (see cubiccurves.h), per
+	// segment (segment n at m_Coefficients + 12 * m_NumCurves * n)
+	// BEZIER, SQUAD, CATMULL_ROM, QUATERNION: the same for the root position only
+	// (m_NumCurves is then 1)
+	double * m_Coefficients;
+
+	// QUATERNION: rotations of every keyframe (keyframe k is block k) and, unless LINEAR,
+	// the control points a_n, b_(n+1) (or for SQUAD and CATMULL_ROM, the inner quaternions
+	// s_n, s_(n+1)) of every segment (segment n is blocks 2n, 2n+1); a block holds the
+	// s, x, y and z arrays of m_NumRotations quaternions
+	double * m_Track;
+	double * m_QuaternionControlPoints;
+
+	// segment that contains t (clamped): keyframes segment and segment + 1
+	int FindSegment(double t) const;
+	// frames of a segment, and of the segments before and after it (0 if none)
+	int SegmentLength(int segment) const;
+	int PreviousLength(int segment) const;
+	int NextLength(int segment) const;
+	// block of m_NumRotations quaternions in m_Track or m_QuaternionControlPoints
+	QuaternionArrays GetQuaternions(double * storage, int block) const;
+};
+
+#endif
+
@@ -0,0 +1,178 @@
+/*
+ parallel.cpp
+
+ See parallel.h.
+
+ */
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "parallel.h"
+
+static int defaultNumThreads = 0;
+
+int GetNumThreads() {
+	if (defaultNumThreads > 0)
+		return defaultNumThreads;
+	int numThreads = (int) std::thread::hardware_concurrency();
+	return (numThreads < 1) ? 1 : numThreads;
+}
+
+struct ParallelForState {
+	std::atomic<int> nextTask;
+	int numTasks;
+	void (*task)(int index, void * data);
+	void * data;
+};
+
+static void ParallelForWorker(ParallelForState * state) {
+	int index;
+	while ((index = state->nextTask++) < state->numTasks)
+		state->task(index, state->data);
+}
+
+// Worker threads kept between the calls of ParallelFor. Worker i waits for a new
+// generation and takes part in it if i < numActive; workers i >= numWorkers quit.
+// The pool is never freed, so the workers can be left waiting at exit.
+struct ThreadPool {
+	std::atomic<int> busy; // 1 while a ParallelFor (or SetNumThreads) uses the pool
+	std::mutex lock; // guards the fields below
+	std::condition_variable workReady;
+	std::condition_variable workDone;
+	unsigned long generation;
+	int numActive;
+	int numRunning; // active workers that have not finished the generation
+	ParallelForState * state;
+
+	std::thread * workers;
+	int numWorkers;
+	int capacity;
+};
+
+static ThreadPool * pool = NULL;
+static std::mutex poolCreation;
+
+static void PoolWorker(ThreadPool * p, int id, unsigned long generation) {
+	std::unique_lock<std::mutex> lock(p->lock);
+	for (;;) {
+		while ((p->generation == generation) && (id < p->numWorkers))
+			p->workReady.wait(lock);
+		if (id >= p->numWorkers)
+			return;
+		generation = p->generation;
+		if (id >= p->numActive)
+			continue;
+		ParallelForState * state = p->state;
+		lock.unlock();
+		ParallelForWorker(state);
+		lock.lock();
+		if (--p->numRunning == 0)
+			p->workDone.notify_one();
+	}
+}
+
+static ThreadPool * GetPool() {
+	std::lock_guard<std::mutex> guard(poolCreation);
+	if (pool == NULL) {
+		pool = new ThreadPool;
+		pool->busy = 0;
+		pool->generation = 0;
+		pool->numActive = pool->numRunning = 0;
+		pool->state = NULL;
+		pool->workers = NULL;
+		pool->numWorkers = pool->capacity = 0;
+	}
+	return pool;
+}
+
+// the pool for the calling thread, or NULL if it is in use (e.g. by the ParallelFor
+// this is called from a task of); ReleasePool gives it back
+static ThreadPool * AcquirePool() {
+	ThreadPool * p = GetPool();
+	int idle = 0;
+	return p->busy.compare_exchange_strong(idle, 1) ? p : NULL;
+}
+
+static void ReleasePool(ThreadPool * p) {
+	p->busy = 0;
+}
+
+// start or stop workers until there are numWorkers; the caller has acquired the pool
+static void ResizePool(ThreadPool * p, int numWorkers) {
+	if (numWorkers > p->capacity) {
+		int capacity = (2 * p->capacity > numWorkers) ? 2 * p->capacity : numWorkers;
+		std::thread * workers = new std::thread[capacity];
+		for (int i = 0; i < p->numWorkers; i++)
+			workers[i] = std::move(p->workers[i]);
+		delete[] p->workers;
+		p->workers = workers;
+		p->capacity = capacity;
+	}
+
+	int numOld = p->numWorkers;
+	{
+		std::lock_guard<std::mutex> guard(p->lock);
+		p->numWorkers = numWorkers;
+	}
+	if (numWorkers < numOld) {
+		p->workReady.notify_all();
+		for (int i = numWorkers; i < numOld; i++)
+			p->workers[i].join();
+	}
+	for (int i = numOld; i < numWorkers; i++)
+		p->workers[i] = std::thread(PoolWorker, p, i, p->generation);
+}
+
+void SetNumThreads(int numThreads) {
+	defaultNumThreads = (numThreads < 1) ? 0 : numThreads;
+
+	// stop the workers the new count does not need (they are started again if a
+	// ParallelFor asks for more threads)
+	ThreadPool * p = AcquirePool();
+	if (p == NULL)
+		return;
+	if (p->numWorkers > GetNumThreads() - 1)
+		ResizePool(p, GetNumThreads() - 1);
+	ReleasePool(p);
+}
+
+void ParallelFor(int numTasks, void (*task)(int index, void * data), void * data,
+		int numThreads) {
+	if (numThreads < 1)
+		numThreads = GetNumThreads();
+	if (numThreads > numTasks)
+		numThreads = numTasks;
+
+	// a ParallelFor inside a task (or next to another one) runs on the calling thread
+	ThreadPool * p = (numThreads > 1) ? AcquirePool() : NULL;
+	if (p == NULL) {
+		for (int index = 0; index < numTasks; index++)
+			task(index, data);
+		return;
+	}
+	if (p->numWorkers < numThreads - 1)
+		ResizePool(p, numThreads - 1);
+
+	ParallelForState state;
+	state.nextTask = 0;
+	state.numTasks = numTasks;
+	state.task = task;
+	state.data = data;
+
+	{
+		std::lock_guard<std::mutex> guard(p->lock);
+		p->state = &state;
+		p->numActive = p->numRunning = numThreads - 1;
+		p->generation++;
+	}
+	p->workReady.notify_all();
+	ParallelForWorker(&state);
+	{
+		std::unique_lock<std::mutex> lock(p->lock);
+		while (p->numRunning > 0)
+			p->workDone.wait(lock);
+	}
+	ReleasePool(p);
+}
@@ -0,0 +1,28 @@
+/*
+ parallel.h
+
+ Minimal data-parallel helper: runs independent tasks on a set of worker threads
+ that take task indices from a shared counter, so uneven tasks balance themselves.
+ The worker threads are started by the first ParallelFor that needs them and wait
+ for the next one in between.
+
+ */
+
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+// Number of threads ParallelFor uses when numThreads is 0.
+// Defaults to the number of hardware threads; values < 1 restore the default.
+// Stops the worker threads beyond the new number.
+void SetNumThreads(int numThreads);
+int GetNumThreads();
+
+// Call task(index, data) for index = 0, ..., numTasks-1 on up to numThreads threads
+// (0: GetNumThreads()), including the calling thread. Tasks may run in any order
+// and concurrently; the call returns when all of them are done. A ParallelFor
+// called from a task, or while another thread is in one, runs its tasks on the
+// calling thread only.
+void ParallelFor(int numTasks, void (*task)(int index, void * data), void * data,
+		int numThreads = 0);
+
+#endif
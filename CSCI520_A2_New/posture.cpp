@@ -5,5 +5,53 @@
  Revision 3 - Jernej Barbic and Yili Zhao, Feb, 2012
 
  */
+#include <string.h>
 #include "posture.h"
 
+void PostureLayout::Pack(const Posture & posture, double * frame) const {
+	memset(frame, 0, sizeof(double) * frameSize);
+
+	int root = getRootPosOffset();
+	for (int d = 0; d < 3; d++)
+		frame[root + d] = posture.root_pos.p[d];
+
+	for (int j = 0; j < MAX_BONES_IN_ASF_FILE; j++) {
+		if (rotationOffset[j] >= 0)
+			for (int d = 0; d < 3; d++)
+				frame[rotationOffset[j] + d] = posture.bone_rotation[j].p[d];
+
+		// the root translation aliases the root position, which was already stored
+		if ((translationOffset[j] >= 0) && (translationOffset[j] != root))
+			for (int d = 0; d < 3; d++)
+				frame[translationOffset[j] + d] = posture.bone_translation[j].p[d];
+
+		if (lengthOffset[j] >= 0)
+			frame[lengthOffset[j]] = posture.bone_length[j].p[0];
+	}
+}
+
+void PostureLayout::Unpack(const double * frame, Posture & posture) const {
+	int root = getRootPosOffset();
+	posture.root_pos.setValue(frame[root], frame[root + 1], frame[root + 2]);
+
+	for (int j = 0; j < MAX_BONES_IN_ASF_FILE; j++) {
+		if (rotationOffset[j] >= 0)
+			posture.bone_rotation[j].setValue(frame[rotationOffset[j]],
+					frame[rotationOffset[j] + 1], frame[rotationOffset[j] + 2]);
+		else
+			posture.bone_rotation[j].setValue(0.0, 0.0, 0.0);
+
+		if (translationOffset[j] >= 0)
+			posture.bone_translation[j].setValue(frame[translationOffset[j]],
+					frame[translationOffset[j] + 1], frame[translationOffset[j] + 2]);
+		else
+			posture.bone_translation[j].setValue(0.0, 0.0, 0.0);
+
+		if (lengthOffset[j] >= 0)
+			posture.bone_length[j].setValue(frame[lengthOffset[j]], 0.0, 0.0);
+		else
+			posture.bone_length[j].setValue(0.0, 0.0, 0.0);
+
+		posture.bone_end_pos[j].setValue(0.0, 0.0, 0.0);
+	}
+}
@@ -10,6 +10,8 @@
 #include "types.h"
 
 //Root position and all bone rotation angles (including root) 
+//This is the full, fixed-size representation; Motion stores frames packed (see PostureLayout)
+//and converts to/from Posture only for callers that still need it.
 struct Posture {
 public:
 	//Root position (x, y, z)		
@@ -30,5 +32,31 @@ public:
 
 };
 
-#endif
+//Layout of a packed posture: a frame is a flat array of frameSize doubles holding
+//only the bones that exist in the skeleton and only the DOF groups they use.
+//  [0..2]                      root position
+//  rotationOffset[bone]        x, y, z Euler angles of every bone with dof > 0
+//  translationOffset[bone]     x, y, z translation of bones with translational DOFs (root aliases the root position)
+//  lengthOffset[bone]          length of bones with the 'l' DOF
+//An offset of -1 means the bone does not store that group; it reads back as 0.
+//The layout is built by the Skeleton (see Skeleton::getPostureLayout).
+struct PostureLayout {
+	int frameSize;
+	//hash of the bone names and all offsets; binary motion files record it
+	//so that frames are never read with a different layout
+	unsigned long long fingerprint;
+	int rotationOffset[MAX_BONES_IN_ASF_FILE];
+	int translationOffset[MAX_BONES_IN_ASF_FILE];
+	int lengthOffset[MAX_BONES_IN_ASF_FILE];
+
+	static int getRootPosOffset()
+	{
+		return 0;
+	}
+
+	//convert between the packed and the full representation
+	void Pack(const Posture & posture, double * frame) const;
+	void Unpack(const double * frame, Posture & posture) const;
+};
 
+#endif
@@ -0,0 +1,165 @@
+/*
+ quaternionarrays.cpp
+
+ See quaternionarrays.h.
+
+ */
+#include <math.h>
+#include <float.h>
+
+#include "quaternionarrays.h"
+#include "types.h"
+
+// the kernels must round every multiplication and addition (see quaternionkernel.h)
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#define KERNEL_BODY "quaternionkernel.h"
+#include "simdkernels.h"
+
+static int IsSupported(SimdKernel kernel) {
+	switch (kernel) {
+	case SIMD_SCALAR:
+		return 1;
+#ifdef HAVE_SIMD_SSE2
+	case SIMD_SSE2:
+		return 1;
+#endif
+#ifdef HAVE_SIMD_AVX
+	case SIMD_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case SIMD_AVX512:
+		return __builtin_cpu_supports("avx512f");
+#endif
+	default:
+		return 0;
+	}
+}
+
+static SimdKernel FindSimdKernel() {
+	SimdKernel kernels[3] = { SIMD_AVX512, SIMD_AVX2, SIMD_SSE2 };
+	for (int i = 0; i < 3; i++)
+		if (IsSupported(kernels[i]))
+			return kernels[i];
+	return SIMD_SCALAR;
+}
+
+static SimdKernel simdKernel = FindSimdKernel();
+
+SimdKernel GetSimdKernel() {
+	return simdKernel;
+}
+
+int SetSimdKernel(SimdKernel kernel) {
+	if (!IsSupported(kernel))
+		return -1;
+	simdKernel = kernel;
+	return 0;
+}
+
+const char * GetSimdKernelName(SimdKernel kernel) {
+	const char * names[4] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+	return names[kernel];
+}
+
+void SlerpArrays(int count, const QuaternionArrays & start, const QuaternionArrays & end,
+		double t, const QuaternionArrays & result) {
+	switch (simdKernel) {
+#ifdef HAVE_SIMD_AVX
+	case SIMD_AVX512:
+		SlerpArraysAVX512(count, start, end, t, result);
+		break;
+	case SIMD_AVX2:
+		SlerpArraysAVX2(count, start, end, t, result);
+		break;
+#endif
+#ifdef HAVE_SIMD_SSE2
+	case SIMD_SSE2:
+		SlerpArraysSSE2(count, start, end, t, result);
+		break;
+#endif
+	default:
+		SlerpArraysScalar(count, start, end, t, result);
+		break;
+	}
+}
+
+void QuaternionArraysToEuler(int count, const QuaternionArrays & quaternions, double * angles) {
+	switch (simdKernel) {
+#ifdef HAVE_SIMD_AVX
+	case SIMD_AVX512:
+		QuaternionArraysToEulerAVX512(count, quaternions, angles);
+		break;
+	case SIMD_AVX2:
+		QuaternionArraysToEulerAVX2(count, quaternions, angles);
+		break;
+#endif
+#ifdef HAVE_SIMD_SSE2
+	case SIMD_SSE2:
+		QuaternionArraysToEulerSSE2(count, quaternions, angles);
+		break;
+#endif
+	default:
+		QuaternionArraysToEulerScalar(count, quaternions, angles);
+		break;
+	}
+}
+
+void EulerToQuaternionArrays(int count, const double * angles, const QuaternionArrays & quaternions) {
+	// only done for keyframes, so the C library sin and cos are fast enough
+	for (int i = 0; i < count; i++) {
+		Quaternion<double> q;
+		EulerToQuaternion(angles + 3 * i, q);
+		quaternions.s[i] = q.Gets();
+		quaternions.x[i] = q.Getx();
+		quaternions.y[i] = q.Gety();
+		quaternions.z[i] = q.Getz();
+	}
+}
+
+void EulerToQuaternion(const double angles[3], Quaternion<double> & q) {
+	// q = qz * qy * qx, with the half angles of each axis
+	double hx = angles[0] * M_PI / 360., hy = angles[1] * M_PI / 360., hz = angles[2] * M_PI / 360.;
+	double cx = cos(hx), sx = sin(hx);
+	double cy = cos(hy), sy = sin(hy);
+	double cz = cos(hz), sz = sin(hz);
+
+	double s = cx * cy * cz + sx * sy * sz;
+	double x = sx * cy * cz - cx * sy * sz;
+	double y = cx * sy * cz + sx * cy * sz;
+	double z = cx * cy * sz - sx * sy * cz;
+	if (s < 0)
+		q.Set(-s, -x, -y, -z);
+	else
+		q.Set(s, x, y, z);
+}
+
+void QuaternionToEuler(const Quaternion<double> & q, double angles[3]) {
+	double s = q.Gets(), x = q.Getx(), y = q.Gety(), z = q.Getz();
+
+	// the entries of Quaternion2Matrix that Rotation2Euler uses
+	double R0 = 1 - 2 * y * y - 2 * z * z;
+	double R3 = 2 * x * y + 2 * s * z;
+	double R6 = 2 * x * z - 2 * s * y;
+	double cy = sqrt(R0 * R0 + R3 * R3);
+
+	if (cy > 16 * DBL_EPSILON) {
+		double R7 = 2 * y * z + 2 * s * x;
+		double R8 = 1 - 2 * x * x - 2 * y * y;
+		angles[0] = atan2(R7, R8);
+		angles[1] = atan2(-R6, cy);
+		angles[2] = atan2(R3, R0);
+	} else {
+		double R4 = 1 - 2 * x * x - 2 * z * z;
+		double R5 = 2 * y * z - 2 * s * x;
+		angles[0] = atan2(-R5, R4);
+		angles[1] = atan2(-R6, cy);
+		angles[2] = 0;
+	}
+
+	for (int i = 0; i < 3; i++)
+		angles[i] *= 180 / M_PI;
+}
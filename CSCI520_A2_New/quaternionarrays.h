@@ -0,0 +1,62 @@
+/*
+ quaternionarrays.h
+
+ Operations on many quaternions at once, e.g. on all bone rotations of a frame:
+ 1. slerp of many quaternion pairs at the same t
+ 2. conversion of many quaternions to XYZ Euler angles, and back
+ 3. closed-form conversion of a single quaternion to XYZ Euler angles and back
+
+ The quaternions are stored as structure of arrays, so that consecutive quaternions
+ fill the lanes of the SIMD registers.
+
+ The slerp and quaternion to Euler kernels are compiled for AVX-512, AVX2 and SSE2
+ (x86) and as plain scalar code; the widest one the processor supports is selected
+ at run time. All of them compute the same values: acos, sin and atan2 are evaluated
+ with polynomials (not the C library), to within a few units in the last place of
+ Interpolator::Slerp and of the C library conversion.
+
+ */
+
+#ifndef _QUATERNIONARRAYS_H
+#define _QUATERNIONARRAYS_H
+
+#include "quaternion.h"
+
+// quaternion i is s[i] + x[i] * i + y[i] * j + z[i] * k
+struct QuaternionArrays {
+	double * s;
+	double * x;
+	double * y;
+	double * z;
+};
+
+// result[i] = Slerp(start[i], end[i], t) for i = 0, ..., count-1, along the short
+// path (end[i] is negated if it is more than 90 degrees away from start[i]; the
+// arrays are not modified). t must be on [0, 1]. result may be start or end.
+void SlerpArrays(int count, const QuaternionArrays & start, const QuaternionArrays & end,
+		double t, const QuaternionArrays & result);
+
+// angles[3 * i], ..., angles[3 * i + 2] = QuaternionToEuler(quaternion i)
+void QuaternionArraysToEuler(int count, const QuaternionArrays & quaternions, double * angles);
+// quaternion i = EulerToQuaternion(angles + 3 * i)
+void EulerToQuaternionArrays(int count, const double * angles, const QuaternionArrays & quaternions);
+
+// XYZ Euler angles in degrees (the rotation Rz * Ry * Rx of Interpolator::Euler2Rotation)
+// to the unit quaternion with s >= 0, from the half-angle sines and cosines
+void EulerToQuaternion(const double angles[3], Quaternion<double> & q);
+// unit quaternion to XYZ Euler angles in degrees; gives exactly the angles of
+// Quaternion2Matrix followed by Interpolator::Rotation2Euler, without the full matrix
+void QuaternionToEuler(const Quaternion<double> & q, double angles[3]);
+
+enum SimdKernel {
+	SIMD_SCALAR = 0, SIMD_SSE2 = 1, SIMD_AVX2 = 2, SIMD_AVX512 = 3
+};
+
+// kernel used by SlerpArrays, QuaternionArraysToEuler and BoneTracks; the widest
+// supported one unless set with SetSimdKernel
+SimdKernel GetSimdKernel();
+// returns 0 on success, -1 if the processor (or the build) does not support the kernel
+int SetSimdKernel(SimdKernel kernel);
+const char * GetSimdKernelName(SimdKernel kernel);
+
+#endif
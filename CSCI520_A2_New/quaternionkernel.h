@@ -0,0 +1,254 @@
+/*
+ quaternionkernel.h
+
+ Bodies of the QuaternionArrays kernels, included by quaternionarrays.cpp once per
+ instruction set through simdkernels.h (so there is no include guard), which defines
+ the vector macros (VDOUBLE, VADD, ...) used here.
+
+ Every lane does the same sequence of IEEE operations (no fused multiply-add),
+ so all instruction sets give identical results.
+
+ */
+
+// sin(x) for 0 <= x <= pi/2
+static KERNEL_INLINE KERNEL_TARGET VDOUBLE KERNEL_NAME(Sin)(VDOUBLE x) {
+	// Taylor series up to x^21 (the first omitted term is below 2e-18 at pi/2)
+	VDOUBLE x2 = VMUL(x, x);
+	VDOUBLE p = VSET1(1.9572941063391263e-20);
+	p = VADD(VMUL(p, x2), VSET1(-8.2206352466243300e-18));
+	p = VADD(VMUL(p, x2), VSET1(2.8114572543455206e-15));
+	p = VADD(VMUL(p, x2), VSET1(-7.6471637318198164e-13));
+	p = VADD(VMUL(p, x2), VSET1(1.6059043836821613e-10));
+	p = VADD(VMUL(p, x2), VSET1(-2.5052108385441720e-08));
+	p = VADD(VMUL(p, x2), VSET1(2.7557319223985893e-06));
+	p = VADD(VMUL(p, x2), VSET1(-1.9841269841269841e-04));
+	p = VADD(VMUL(p, x2), VSET1(8.3333333333333333e-03));
+	p = VADD(VMUL(p, x2), VSET1(-1.6666666666666666e-01));
+	return VADD(x, VMUL(VMUL(x, x2), p));
+}
+
+// asin(x) for 0 <= x <= sin(pi/8)
+static KERNEL_INLINE KERNEL_TARGET VDOUBLE KERNEL_NAME(Asin)(VDOUBLE x) {
+	// Taylor series up to x^37 (the first omitted term is below 1e-18 relative),
+	// with the even and odd powers of x^2 evaluated as two independent chains
+	VDOUBLE x2 = VMUL(x, x);
+	VDOUBLE x4 = VMUL(x2, x2);
+	VDOUBLE even = VSET1(0.0038809645588376690);
+	even = VADD(VMUL(even, x4), VSET1(0.0046601434869150960));
+	even = VADD(VMUL(even, x4), VSET1(0.0057400376708419240));
+	even = VADD(VMUL(even, x4), VSET1(0.0073125258735988454));
+	even = VADD(VMUL(even, x4), VSET1(0.0097616095291940780));
+	even = VADD(VMUL(even, x4), VSET1(0.0139648437500000000));
+	even = VADD(VMUL(even, x4), VSET1(0.0223721590909090920));
+	even = VADD(VMUL(even, x4), VSET1(0.0446428571428571440));
+	even = VADD(VMUL(even, x4), VSET1(0.1666666666666666600));
+	VDOUBLE odd = VSET1(0.0035692053938259347);
+	odd = VADD(VMUL(odd, x4), VSET1(0.0042409070936793630));
+	odd = VADD(VMUL(odd, x4), VSET1(0.0051533096823199050));
+	odd = VADD(VMUL(odd, x4), VSET1(0.0064472103118896490));
+	odd = VADD(VMUL(odd, x4), VSET1(0.0083903358096168150));
+	odd = VADD(VMUL(odd, x4), VSET1(0.0115518008961397050));
+	odd = VADD(VMUL(odd, x4), VSET1(0.0173527644230769240));
+	odd = VADD(VMUL(odd, x4), VSET1(0.0303819444444444440));
+	odd = VADD(VMUL(odd, x4), VSET1(0.0750000000000000000));
+	VDOUBLE p = VADD(even, VMUL(odd, x2));
+	return VADD(x, VMUL(VMUL(x, x2), p));
+}
+
+// slerp of VLANES quaternion pairs; see SlerpArrays
+static KERNEL_INLINE KERNEL_TARGET void KERNEL_NAME(SlerpLanes)(const double * start[4],
+		const double * end[4], double t, double * result[4]) {
+	VDOUBLE a[4], b[4];
+	for (int c = 0; c < 4; c++) {
+		a[c] = VLOAD(start[c]);
+		b[c] = VLOAD(end[c]);
+	}
+	VDOUBLE cosTheta = VADD(VADD(VADD(VMUL(a[0], b[0]), VMUL(a[1], b[1])),
+			VMUL(a[2], b[2])), VMUL(a[3], b[3]));
+
+	// choose the short path
+	VMASK flip = VLT(cosTheta, VSET1(0.0));
+	cosTheta = VBLEND(flip, cosTheta, VMUL(VSET1(-1.0), cosTheta));
+	for (int c = 0; c < 4; c++)
+		b[c] = VBLEND(flip, b[c], VMUL(VSET1(-1.0), b[c]));
+
+	// theta = acos(cosTheta), from the sine and cosine of theta/2 and the sine of
+	// theta/4 (cosTheta >= 0, so theta/4 <= pi/8); away from the nearly parallel case
+	// the subtractions are exact
+	VDOUBLE sinHalf = VSQRT(VMUL(VSUB(VSET1(1.0), cosTheta), VSET1(0.5)));
+	VDOUBLE cosHalf = VSQRT(VMUL(VADD(VSET1(1.0), cosTheta), VSET1(0.5)));
+	// sin(theta/4) = sin(theta/2) / d and 1 / sin(theta) = d / (d sin(theta)),
+	// with a single division
+	VDOUBLE d = VSQRT(VMUL(VSET1(2.0), VADD(VSET1(1.0), cosHalf)));
+	VDOUBLE sinTheta = VMUL(VSET1(2.0), VMUL(sinHalf, cosHalf));
+	VDOUBLE invProduct = VDIV(VSET1(1.0), VMUL(d, sinTheta));
+	VDOUBLE sinQuarter = VMUL(VMUL(sinHalf, sinTheta), invProduct);
+	VDOUBLE invSinTheta = VMUL(d, invProduct);
+	VDOUBLE theta = VMUL(VSET1(4.0), KERNEL_NAME(Asin)(sinQuarter));
+
+	VDOUBLE wa = VMUL(KERNEL_NAME(Sin)(VMUL(VSET1(1.0 - t), theta)), invSinTheta);
+	VDOUBLE wb = VMUL(KERNEL_NAME(Sin)(VMUL(VSET1(t), theta)), invSinTheta);
+
+	// avoid dividing by zero
+	VMASK nearlyParallel = VGT(cosTheta, VSET1(0.9995));
+	wa = VBLEND(nearlyParallel, wa, VSET1(1.0 - t));
+	wb = VBLEND(nearlyParallel, wb, VSET1(t));
+
+	VDOUBLE r[4];
+	for (int c = 0; c < 4; c++)
+		r[c] = VADD(VMUL(wa, a[c]), VMUL(wb, b[c]));
+	VDOUBLE invNorm = VDIV(VSET1(1.0), VSQRT(VADD(VADD(VADD(VMUL(r[0], r[0]),
+			VMUL(r[1], r[1])), VMUL(r[2], r[2])), VMUL(r[3], r[3]))));
+	for (int c = 0; c < 4; c++)
+		VSTORE(result[c], VMUL(r[c], invNorm));
+}
+
+
+// atan(z) for 0 <= z <= 1
+static KERNEL_INLINE KERNEL_TARGET VDOUBLE KERNEL_NAME(Atan)(VDOUBLE z) {
+	// atan(z) = pi/4 + atan((z - 1) / (z + 1)) moves z to [-tan(pi/8), tan(pi/8)]
+	VMASK large = VGT(z, VSET1(0.41421356237309503));
+	VDOUBLE u = VBLEND(large, z, VDIV(VSUB(z, VSET1(1.0)), VADD(z, VSET1(1.0))));
+
+	// Taylor series up to u^43 (the first omitted term is below 1e-18 relative),
+	// with the even and odd powers of u^2 evaluated as two independent chains
+	VDOUBLE u2 = VMUL(u, u);
+	VDOUBLE u4 = VMUL(u2, u2);
+	VDOUBLE even = VSET1(-0.023255813953488372);
+	even = VADD(VMUL(even, u4), VSET1(-0.02564102564102564));
+	even = VADD(VMUL(even, u4), VSET1(-0.02857142857142857));
+	even = VADD(VMUL(even, u4), VSET1(-0.03225806451612903));
+	even = VADD(VMUL(even, u4), VSET1(-0.037037037037037035));
+	even = VADD(VMUL(even, u4), VSET1(-0.043478260869565216));
+	even = VADD(VMUL(even, u4), VSET1(-0.05263157894736842));
+	even = VADD(VMUL(even, u4), VSET1(-0.06666666666666667));
+	even = VADD(VMUL(even, u4), VSET1(-0.09090909090909091));
+	even = VADD(VMUL(even, u4), VSET1(-0.14285714285714285));
+	even = VADD(VMUL(even, u4), VSET1(-0.3333333333333333));
+	VDOUBLE odd = VSET1(0.024390243902439025);
+	odd = VADD(VMUL(odd, u4), VSET1(0.02702702702702703));
+	odd = VADD(VMUL(odd, u4), VSET1(0.030303030303030304));
+	odd = VADD(VMUL(odd, u4), VSET1(0.034482758620689655));
+	odd = VADD(VMUL(odd, u4), VSET1(0.04));
+	odd = VADD(VMUL(odd, u4), VSET1(0.047619047619047616));
+	odd = VADD(VMUL(odd, u4), VSET1(0.058823529411764705));
+	odd = VADD(VMUL(odd, u4), VSET1(0.07692307692307693));
+	odd = VADD(VMUL(odd, u4), VSET1(0.1111111111111111));
+	odd = VADD(VMUL(odd, u4), VSET1(0.2));
+	VDOUBLE p = VADD(even, VMUL(odd, u2));
+	VDOUBLE r = VADD(u, VMUL(VMUL(u, u2), p));
+	return VBLEND(large, r, VADD(VSET1(0.7853981633974483), r));
+}
+
+// atan2(y, x) (x = -0 is taken as +0)
+static KERNEL_INLINE KERNEL_TARGET VDOUBLE KERNEL_NAME(Atan2)(VDOUBLE y, VDOUBLE x) {
+	VDOUBLE ax = VABS(x);
+	VDOUBLE ay = VABS(y);
+	VMASK swap = VGT(ay, ax);
+	VDOUBLE numerator = VBLEND(swap, ay, ax);
+	VDOUBLE denominator = VBLEND(swap, ax, ay);
+	// atan2(0, 0) = 0
+	VDOUBLE z = VBLEND(VGT(denominator, VSET1(0.0)), VSET1(0.0), VDIV(numerator, denominator));
+
+	VDOUBLE r = KERNEL_NAME(Atan)(z);
+	r = VBLEND(swap, r, VSUB(VSET1(1.5707963267948966), r));
+	r = VBLEND(VLT(x, VSET1(0.0)), r, VSUB(VSET1(3.1415926535897932), r));
+	return VCOPYSIGN(r, y);
+}
+
+// Euler angles of VLANES quaternions; see QuaternionArraysToEuler
+static KERNEL_INLINE KERNEL_TARGET void KERNEL_NAME(EulerLanes)(const double * quaternion[4],
+		double * angles[3]) {
+	VDOUBLE s = VLOAD(quaternion[0]);
+	VDOUBLE x = VLOAD(quaternion[1]);
+	VDOUBLE y = VLOAD(quaternion[2]);
+	VDOUBLE z = VLOAD(quaternion[3]);
+
+	// the entries of Quaternion2Matrix that Rotation2Euler uses
+	VDOUBLE two = VSET1(2.0), one = VSET1(1.0), minusOne = VSET1(-1.0);
+	VDOUBLE R0 = VSUB(VSUB(one, VMUL(VMUL(two, y), y)), VMUL(VMUL(two, z), z));
+	VDOUBLE R3 = VADD(VMUL(VMUL(two, x), y), VMUL(VMUL(two, s), z));
+	VDOUBLE R4 = VSUB(VSUB(one, VMUL(VMUL(two, x), x)), VMUL(VMUL(two, z), z));
+	VDOUBLE R5 = VSUB(VMUL(VMUL(two, y), z), VMUL(VMUL(two, s), x));
+	VDOUBLE R6 = VSUB(VMUL(VMUL(two, x), z), VMUL(VMUL(two, s), y));
+	VDOUBLE R7 = VADD(VMUL(VMUL(two, y), z), VMUL(VMUL(two, s), x));
+	VDOUBLE R8 = VSUB(VSUB(one, VMUL(VMUL(two, x), x)), VMUL(VMUL(two, y), y));
+
+	VDOUBLE cy = VSQRT(VADD(VMUL(R0, R0), VMUL(R3, R3)));
+	VMASK regular = VGT(cy, VSET1(16 * DBL_EPSILON));
+	VDOUBLE toDegrees = VSET1(180 / 3.1415926535897932);
+
+	VDOUBLE ax = VBLEND(regular, KERNEL_NAME(Atan2)(VMUL(minusOne, R5), R4),
+			KERNEL_NAME(Atan2)(R7, R8));
+	VDOUBLE ay = KERNEL_NAME(Atan2)(VMUL(minusOne, R6), cy);
+	VDOUBLE az = VBLEND(regular, VSET1(0.0), KERNEL_NAME(Atan2)(R3, R0));
+	VSTORE(angles[0], VMUL(ax, toDegrees));
+	VSTORE(angles[1], VMUL(ay, toDegrees));
+	VSTORE(angles[2], VMUL(az, toDegrees));
+}
+
+static KERNEL_TARGET void KERNEL_NAME(SlerpArrays)(int count, const QuaternionArrays & start,
+		const QuaternionArrays & end, double t, const QuaternionArrays & result) {
+	const double * a[4] = { start.s, start.x, start.y, start.z };
+	const double * b[4] = { end.s, end.x, end.y, end.z };
+	double * r[4] = { result.s, result.x, result.y, result.z };
+
+	for (int i = 0; i < count; i += VLANES) {
+		const double * la[4], * lb[4];
+		double * lr[4];
+		if (i + VLANES <= count) {
+			for (int c = 0; c < 4; c++) {
+				la[c] = a[c] + i;
+				lb[c] = b[c] + i;
+				lr[c] = r[c] + i;
+			}
+			KERNEL_NAME(SlerpLanes)(la, lb, t, lr);
+			continue;
+		}
+
+		// the remaining quaternions go through a copy padded with the identity, so
+		// that they get the same values as they would in a full vector
+		double pa[4][VLANES], pb[4][VLANES], pr[4][VLANES];
+		for (int c = 0; c < 4; c++) {
+			for (int lane = 0; lane < VLANES; lane++) {
+				pa[c][lane] = (i + lane < count) ? a[c][i + lane] : ((c == 0) ? 1.0 : 0.0);
+				pb[c][lane] = (i + lane < count) ? b[c][i + lane] : ((c == 0) ? 1.0 : 0.0);
+			}
+			la[c] = pa[c];
+			lb[c] = pb[c];
+			lr[c] = pr[c];
+		}
+		KERNEL_NAME(SlerpLanes)(la, lb, t, lr);
+		for (int c = 0; c < 4; c++)
+			for (int lane = 0; i + lane < count; lane++)
+				r[c][i + lane] = pr[c][lane];
+	}
+}
+
+static KERNEL_TARGET void KERNEL_NAME(QuaternionArraysToEuler)(int count,
+		const QuaternionArrays & quaternions, double * angles) {
+	const double * q[4] = { quaternions.s, quaternions.x, quaternions.y, quaternions.z };
+
+	for (int i = 0; i < count; i += VLANES) {
+		// the remaining quaternions are padded with the identity (see SlerpArrays)
+		double pq[4][VLANES], pa[3][VLANES];
+		const double * lq[4];
+		double * la[3] = { pa[0], pa[1], pa[2] };
+		if (i + VLANES <= count)
+			for (int c = 0; c < 4; c++)
+				lq[c] = q[c] + i;
+		else {
+			for (int c = 0; c < 4; c++) {
+				for (int lane = 0; lane < VLANES; lane++)
+					pq[c][lane] = (i + lane < count) ? q[c][i + lane] : ((c == 0) ? 1.0 : 0.0);
+				lq[c] = pq[c];
+			}
+		}
+		KERNEL_NAME(EulerLanes)(lq, la);
+
+		// interleave into angle triples
+		for (int lane = 0; (lane < VLANES) && (i + lane < count); lane++)
+			for (int c = 0; c < 3; c++)
+				angles[3 * (i + lane) + c] = pa[c][lane];
+	}
+}
@@ -0,0 +1,150 @@
+/*
+ simdkernels.h
+
+ Compiles a kernel body once per instruction set. The includer defines KERNEL_BODY
+ as the (quoted) name of the header with the body, e.g.
+
+   #define KERNEL_BODY "quaternionkernel.h"
+   #include "simdkernels.h"
+
+ and the body is included as plain scalar code, for SSE2 and (x86 with GCC or
+ clang) for AVX2 and AVX-512, with
+
+   KERNEL_NAME(name)  name of the instantiated functions
+   KERNEL_TARGET      function attribute that enables the instruction set (or nothing)
+   VDOUBLE, VMASK     vector of VLANES doubles, and the result of a comparison
+   VSET1(a) VLOAD(p) VSTORE(p, v) VADD VSUB VMUL VDIV VSQRT VLT VGT
+   VABS(a)            absolute value
+   VCOPYSIGN(a, b)    magnitude of a with the sign of b
+   VBLEND(m, a, b)    b in the lanes where m is set, a elsewhere
+
+ defined. HAVE_SIMD_SSE2 and HAVE_SIMD_AVX tell which of them were compiled, and
+ KERNEL_INLINE forces inlining. The includer must keep the compiler from contracting
+ multiplications and additions into fused multiply-adds (#pragma STDC FP_CONTRACT OFF
+ for Clang, #pragma GCC optimize("fp-contract=off") for GCC), so that all instruction
+ sets compute the same values.
+
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// AVX2 and AVX-512 kernels are compiled with target attributes and used if
+// __builtin_cpu_supports finds them
+#define HAVE_SIMD_AVX 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define HAVE_SIMD_SSE2 1
+#endif
+
+#if defined(HAVE_SIMD_AVX) || defined(HAVE_SIMD_SSE2)
+#include <immintrin.h>
+#endif
+
+// the lanes of the kernels are inlined into the loops over the arrays
+#ifndef KERNEL_INLINE
+#if defined(__GNUC__)
+#define KERNEL_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define KERNEL_INLINE __forceinline
+#else
+#define KERNEL_INLINE inline
+#endif
+#endif
+
+// scalar kernel: one lane
+#define KERNEL_NAME(name) name##Scalar
+#define KERNEL_TARGET
+#define VDOUBLE double
+#define VMASK bool
+#define VLANES 1
+#define VSET1(a) ((double) (a))
+#define VLOAD(p) (*(p))
+#define VSTORE(p, v) (*(p) = (v))
+#define VADD(a, b) ((a) + (b))
+#define VSUB(a, b) ((a) - (b))
+#define VMUL(a, b) ((a) * (b))
+#define VDIV(a, b) ((a) / (b))
+#define VSQRT(a) sqrt(a)
+#define VLT(a, b) ((a) < (b))
+#define VGT(a, b) ((a) > (b))
+#define VABS(a) fabs(a)
+#define VCOPYSIGN(a, b) copysign(a, b)
+#define VBLEND(m, a, b) ((m) ? (b) : (a))
+#include KERNEL_BODY
+#include "simdkernelsundef.h"
+
+#ifdef HAVE_SIMD_SSE2
+#define KERNEL_NAME(name) name##SSE2
+#define KERNEL_TARGET
+#define VDOUBLE __m128d
+#define VMASK __m128d
+#define VLANES 2
+#define VSET1(a) _mm_set1_pd(a)
+#define VLOAD(p) _mm_loadu_pd(p)
+#define VSTORE(p, v) _mm_storeu_pd(p, v)
+#define VADD(a, b) _mm_add_pd(a, b)
+#define VSUB(a, b) _mm_sub_pd(a, b)
+#define VMUL(a, b) _mm_mul_pd(a, b)
+#define VDIV(a, b) _mm_div_pd(a, b)
+#define VSQRT(a) _mm_sqrt_pd(a)
+#define VLT(a, b) _mm_cmplt_pd(a, b)
+#define VGT(a, b) _mm_cmpgt_pd(a, b)
+#define VABS(a) _mm_andnot_pd(_mm_set1_pd(-0.0), a)
+#define VCOPYSIGN(a, b) _mm_or_pd(VABS(a), _mm_and_pd(_mm_set1_pd(-0.0), b))
+#define VBLEND(m, a, b) _mm_or_pd(_mm_and_pd(m, b), _mm_andnot_pd(m, a))
+#include KERNEL_BODY
+#include "simdkernelsundef.h"
+#endif
+
+#ifdef HAVE_SIMD_AVX
+#define KERNEL_NAME(name) name##AVX2
+#define KERNEL_TARGET __attribute__((target("avx2")))
+#define VDOUBLE __m256d
+#define VMASK __m256d
+#define VLANES 4
+#define VSET1(a) _mm256_set1_pd(a)
+#define VLOAD(p) _mm256_loadu_pd(p)
+#define VSTORE(p, v) _mm256_storeu_pd(p, v)
+#define VADD(a, b) _mm256_add_pd(a, b)
+#define VSUB(a, b) _mm256_sub_pd(a, b)
+#define VMUL(a, b) _mm256_mul_pd(a, b)
+#define VDIV(a, b) _mm256_div_pd(a, b)
+#define VSQRT(a) _mm256_sqrt_pd(a)
+#define VLT(a, b) _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define VGT(a, b) _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define VABS(a) _mm256_andnot_pd(_mm256_set1_pd(-0.0), a)
+#define VCOPYSIGN(a, b) _mm256_or_pd(VABS(a), _mm256_and_pd(_mm256_set1_pd(-0.0), b))
+#define VBLEND(m, a, b) _mm256_blendv_pd(a, b, m)
+#include KERNEL_BODY
+#include "simdkernelsundef.h"
+
+// AVX-512 implies FMA: the explicitly rounded forms keep multiplications and
+// additions from being contracted into fused multiply-adds
+#define VROUND (_MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#define VSIGN _mm512_set1_epi64((long long) 0x8000000000000000ULL)
+#define KERNEL_NAME(name) name##AVX512
+#define KERNEL_TARGET __attribute__((target("avx512f")))
+#define VDOUBLE __m512d
+#define VMASK __mmask8
+#define VLANES 8
+#define VSET1(a) _mm512_set1_pd(a)
+#define VLOAD(p) _mm512_loadu_pd(p)
+#define VSTORE(p, v) _mm512_storeu_pd(p, v)
+#define VADD(a, b) _mm512_maskz_add_round_pd(0xff, a, b, VROUND)
+#define VSUB(a, b) _mm512_maskz_sub_round_pd(0xff, a, b, VROUND)
+#define VMUL(a, b) _mm512_maskz_mul_round_pd(0xff, a, b, VROUND)
+#define VDIV(a, b) _mm512_maskz_div_round_pd(0xff, a, b, VROUND)
+#define VSQRT(a) _mm512_maskz_sqrt_round_pd(0xff, a, VROUND)
+#define VLT(a, b) _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ)
+#define VGT(a, b) _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ)
+#define VABS(a) _mm512_abs_pd(a)
+#define VCOPYSIGN(a, b) _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(VABS(a)), \
+		_mm512_and_si512(VSIGN, _mm512_castpd_si512(b))))
+#define VBLEND(m, a, b) _mm512_mask_blend_pd(m, a, b)
+#include KERNEL_BODY
+#include "simdkernelsundef.h"
+#undef VROUND
+#undef VSIGN
+#endif
+
+#undef KERNEL_BODY
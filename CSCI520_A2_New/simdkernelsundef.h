@@ -0,0 +1,26 @@
+/*
+ simdkernelsundef.h
+
+ Undefines the macros of one instruction set of simdkernels.h, after its kernel body
+ (so there is no include guard).
+
+ */
+
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef VDOUBLE
+#undef VMASK
+#undef VLANES
+#undef VSET1
+#undef VLOAD
+#undef VSTORE
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VLT
+#undef VGT
+#undef VABS
+#undef VCOPYSIGN
+#undef VBLEND
@@ -57,19 +57,60 @@ int Skeleton::movBonesInSkel(Bone bone) {
 		return numBones;
 }
 
+// FNV-1a
+static unsigned int HashBoneName(const char *name, size_t length) {
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char) name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+void Skeleton::BuildBoneNameTable() {
+	for (int i = 0; i < BONE_NAME_TABLE_SIZE; i++)
+		m_BoneNameTable[i] = -1;
+	for (int i = 0; i < MAX_BONES_IN_ASF_FILE; i++)
+		m_pBoneByIdx[i] = NULL;
+
+	for (int i = 0; i < NUM_BONES_IN_ASF_FILE; i++) {
+		int idx = m_pBoneList[i].idx;
+		m_pBoneByIdx[idx] = &m_pBoneList[i];
+
+		const char *name = m_pBoneList[i].name;
+		unsigned int slot = HashBoneName(name, strlen(name)) & (BONE_NAME_TABLE_SIZE - 1);
+		while (m_BoneNameTable[slot] >= 0) {
+			if (strcmp(m_pBoneByIdx[m_BoneNameTable[slot]]->name, name) == 0) {
+				printf("Warning: bone name %s appears more than once\n", name);
+				break;
+			}
+			slot = (slot + 1) & (BONE_NAME_TABLE_SIZE - 1);
+		}
+		if (m_BoneNameTable[slot] < 0)
+			m_BoneNameTable[slot] = idx;
+	}
+}
+
 // helper function to convert ASF part name into bone index
-int Skeleton::name2idx(char *name) {
-	int i = 0;
-	while (strcmp(m_pBoneList[i].name, name) != 0 && i++ < NUM_BONES_IN_ASF_FILE)
-		;
-	return m_pBoneList[i].idx;
+int Skeleton::name2idx(const char *name) {
+	return name2idx(name, strlen(name));
+}
+
+int Skeleton::name2idx(const char *name, size_t length) {
+	unsigned int slot = HashBoneName(name, length) & (BONE_NAME_TABLE_SIZE - 1);
+	while (m_BoneNameTable[slot] >= 0) {
+		const char *candidate = m_pBoneByIdx[m_BoneNameTable[slot]]->name;
+		if ((strncmp(candidate, name, length) == 0) && (candidate[length] == 0))
+			return m_BoneNameTable[slot];
+		slot = (slot + 1) & (BONE_NAME_TABLE_SIZE - 1);
+	}
+	return -1;
 }
 
 char * Skeleton::idx2name(int idx) {
-	int i = 0;
-	while (m_pBoneList[i].idx != idx && i++ < NUM_BONES_IN_ASF_FILE)
-		;
-	return m_pBoneList[i].name;
+	if ((idx < 0) || (idx >= MAX_BONES_IN_ASF_FILE) || (m_pBoneByIdx[idx] == NULL))
+		return NULL;
+	return m_pBoneByIdx[idx]->name;
 }
 
 int Skeleton::readASFfile(char* asf_filename, double scale) {
@@ -203,6 +244,9 @@ int Skeleton::readASFfile(char* asf_filename, double scale) {
 	}
 	printf("READ %d\n", NUM_BONES_IN_ASF_FILE);
 
+	//all bone names are known now; the hierarchy below and the AMC reader look them up by name
+	BuildBoneNameTable();
+
 	//
 	//read and build the hierarchy of the skeleton
 	//
@@ -237,11 +281,13 @@ int Skeleton::readASFfile(char* asf_filename, double scale) {
 			part_name = strtok(str, " ");
 			j = 0;
 			while (part_name != NULL) {
-				if (j == 0)
-					parent = name2idx(part_name);
+				int idx = name2idx(part_name);
+				if (idx < 0)
+					printf("unknown bone %s in hierarchy\n", part_name);
+				else if (j == 0)
+					parent = idx;
 				else
-					setChildrenAndSibling(parent,
-							&m_pBoneList[name2idx(part_name)]);
+					setChildrenAndSibling(parent, m_pBoneByIdx[idx]);
 				part_name = strtok(NULL, " ");
 				j++;
 			}
@@ -260,16 +306,15 @@ int Skeleton::readASFfile(char* asf_filename, double scale) {
  when this function first called
  */
 Bone* Skeleton::getBone(Bone *ptr, int bIndex) {
-	static Bone *theptr;
 	if (ptr == NULL)
 		return (NULL);
-	else if (ptr->idx == bIndex) {
-		theptr = ptr;
-		return (theptr);
-	} else {
-		getBone(ptr->child, bIndex);
-		getBone(ptr->sibling, bIndex);
-		return (theptr);
+	else if (ptr->idx == bIndex)
+		return (ptr);
+	else {
+		Bone *found = getBone(ptr->child, bIndex);
+		if (found == NULL)
+			found = getBone(ptr->sibling, bIndex);
+		return (found);
 	}
 }
 
@@ -452,6 +497,9 @@ void Skeleton::enableAllRotationalDOFs() {
 			m_pBoneList[j].dofo[m_pBoneList[j].dof] = 0;
 		}
 	}
+
+	// the new DOFs are part of the forward kinematics
+	BuildForwardKinematics();
 }
 
 // set the skeleton's pose based on the given posture
@@ -494,6 +542,110 @@ void Skeleton::setPosture(Posture posture) {
 	m_pBoneList[0].tz = posture.root_pos.p[2];
 }
 
+// set the skeleton's pose based on a packed frame
+void Skeleton::setPosture(const double * frame) {
+	const PostureLayout & layout = m_PostureLayout;
+	int root = PostureLayout::getRootPosOffset();
+	m_RootPos[0] = frame[root];
+	m_RootPos[1] = frame[root + 1];
+	m_RootPos[2] = frame[root + 2];
+
+	for (int j = 0; j < NUM_BONES_IN_ASF_FILE; j++) {
+		const double * rotation = (layout.rotationOffset[j] >= 0) ? frame + layout.rotationOffset[j] : NULL;
+		const double * translation = (layout.translationOffset[j] >= 0) ? frame + layout.translationOffset[j] : NULL;
+
+		if (rotation != NULL) {
+			if (m_pBoneList[j].dofrx)
+				m_pBoneList[j].rx = rotation[0];
+			if (m_pBoneList[j].dofry)
+				m_pBoneList[j].ry = rotation[1];
+			if (m_pBoneList[j].dofrz)
+				m_pBoneList[j].rz = rotation[2];
+		}
+
+		if (translation != NULL) {
+			if (m_pBoneList[j].doftx)
+				m_pBoneList[j].tx = translation[0];
+			if (m_pBoneList[j].dofty)
+				m_pBoneList[j].ty = translation[1];
+			if (m_pBoneList[j].doftz)
+				m_pBoneList[j].tz = translation[2];
+		}
+
+		if (m_pBoneList[j].doftl && (layout.lengthOffset[j] >= 0))
+			m_pBoneList[j].tl = frame[layout.lengthOffset[j]];
+	}
+
+	// for calucutate tip position
+	m_pBoneList[0].tx = frame[root];
+	m_pBoneList[0].ty = frame[root + 1];
+	m_pBoneList[0].tz = frame[root + 2];
+}
+
+void Skeleton::BuildPostureLayout() {
+	PostureLayout & layout = m_PostureLayout;
+	int root = Skeleton::getRootIndex();
+	int offset = PostureLayout::getRootPosOffset() + 3;
+
+	for (int j = 0; j < MAX_BONES_IN_ASF_FILE; j++) {
+		layout.rotationOffset[j] = -1;
+		layout.translationOffset[j] = -1;
+		layout.lengthOffset[j] = -1;
+	}
+
+	// every bone with DOFs gets all three rotations, so that enableAllRotationalDOFs
+	// does not change the layout of frames that were already loaded
+	m_NumActiveBones = 0;
+	for (int j = 0; j < NUM_BONES_IN_ASF_FILE; j++) {
+		if (m_pBoneList[j].dof == 0)
+			continue;
+		layout.rotationOffset[j] = offset;
+		offset += 3;
+		m_ActiveBones[m_NumActiveBones++] = j;
+	}
+
+	layout.translationOffset[root] = PostureLayout::getRootPosOffset();
+	for (int j = 0; j < NUM_BONES_IN_ASF_FILE; j++) {
+		if ((j == root) || !(m_pBoneList[j].doftx || m_pBoneList[j].dofty || m_pBoneList[j].doftz))
+			continue;
+		layout.translationOffset[j] = offset;
+		offset += 3;
+	}
+
+	for (int j = 0; j < NUM_BONES_IN_ASF_FILE; j++) {
+		if (!m_pBoneList[j].doftl)
+			continue;
+		layout.lengthOffset[j] = offset;
+		offset++;
+	}
+
+	layout.frameSize = offset;
+
+	// FNV-1a over the frame size, and the name and offsets of every bone
+	unsigned long long hash = 14695981039346656037ULL;
+	int values[4];
+	for (int j = -1; j < NUM_BONES_IN_ASF_FILE; j++) {
+		if (j < 0) {
+			values[0] = values[1] = values[2] = values[3] = layout.frameSize;
+		}
+		else {
+			for (const char *c = m_pBoneList[j].name; *c != 0; c++) {
+				hash ^= (unsigned char) *c;
+				hash *= 1099511628211ULL;
+			}
+			values[0] = m_pBoneList[j].idx;
+			values[1] = layout.rotationOffset[m_pBoneList[j].idx];
+			values[2] = layout.translationOffset[m_pBoneList[j].idx];
+			values[3] = layout.lengthOffset[m_pBoneList[j].idx];
+		}
+		for (int v = 0; v < 4; v++) {
+			hash ^= (unsigned int) values[v];
+			hash *= 1099511628211ULL;
+		}
+	}
+	layout.fingerprint = hash;
+}
+
 //Set the aspect ratio of each bone 
 void Skeleton::set_bone_shape(Bone *bone) {
 	int root = Skeleton::getRootIndex();
@@ -554,6 +706,12 @@ Skeleton::Skeleton(char *asf_filename, double scale) {
 
 	//Set the aspect ratio of each bone 
 	set_bone_shape(m_pRootBone);
+
+	//Compute where each bone's DOFs live in a packed frame
+	BuildPostureLayout();
+
+	//Flatten the hierarchy for computeBoneTipPos
+	BuildForwardKinematics();
 }
 
 Skeleton::~Skeleton() {
@@ -577,76 +735,167 @@ void Skeleton::GetRotationAngle(double rotationAngle[3]) {
 	rotationAngle[2] = rz;
 }
 
-void Skeleton::computeBoneTipPos()
+// m = m * translation by (x, y, z), for a 3x4 affine matrix m
+static inline void TranslateAffine(double m[3][4], double x, double y, double z)
 {
-	double identityMat[4][4];
-	memset(identityMat,0,sizeof(double)*16);
-	for(int i = 0; i < 4; i++)
-		identityMat[i][i] = 1;
-	Traverse(getRoot(), identityMat);
+	for (int row = 0; row < 3; row++)
+		m[row][3] = m[row][0] * x + m[row][1] * y + m[row][2] * z + m[row][3];
 }
 
-// Traverse bone tree to caluculate all tip position of the bones
-void Skeleton::Traverse(Bone *ptr, double transToWorld[4][4])
+// m = m * rotation around axis X, Y or Z by angle a (in degrees); the same products as
+// matrix_multS with the 4x4 matrices of rotationX, rotationY and rotationZ, without the zeros
+static inline void RotateAffineX(double m[3][4], double a)
 {
-	if (ptr != 0) {
-		double transToWorldForChild[4][4];
-		ProcessBone(ptr, transToWorld, transToWorldForChild);
-		Traverse(ptr->child, transToWorldForChild);
-		Traverse(ptr->sibling, transToWorld);
+	a = a * M_PI / 180.;
+	double c = cos(a), s = sin(a);
+	for (int row = 0; row < 3; row++) {
+		double y = m[row][1], z = m[row][2];
+		m[row][1] = y * c + z * s;
+		m[row][2] = y * -s + z * c;
 	}
 }
 
-// Caluculate the tip position for each bone and prepare the transfer matrix for his child
-void Skeleton::ProcessBone(Bone *ptr, double transToWorld[4][4], double TransferMatForChild[4][4])
+static inline void RotateAffineY(double m[3][4], double a)
 {
-	//Transform (rotate) from the local coordinate system of this bone to it's parent
-	//This step corresponds to doing: ModelviewMatrix = M_k * (rot_parent_current)
-	double temp[4][4];
-	matrix_transpose(ptr->rot_parent_current, temp);
-	matrix_mult(transToWorld, temp, TransferMatForChild);
-
-	//translate AMC
-	if (ptr->doftz) {
-		translate(temp, 0, 0, double(ptr->tz));
-		matrix_multS(TransferMatForChild, temp);
+	a = a * M_PI / 180.;
+	double c = cos(a), s = sin(a);
+	for (int row = 0; row < 3; row++) {
+		double x = m[row][0], z = m[row][2];
+		m[row][0] = x * c + z * -s;
+		m[row][2] = x * s + z * c;
 	}
-	if (ptr->dofty) {
-		translate(temp, 0, double(ptr->ty), 0);
-		matrix_multS(TransferMatForChild, temp);
+}
+
+static inline void RotateAffineZ(double m[3][4], double a)
+{
+	a = a * M_PI / 180.;
+	double c = cos(a), s = sin(a);
+	for (int row = 0; row < 3; row++) {
+		double x = m[row][0], y = m[row][1];
+		m[row][0] = x * c + y * s;
+		m[row][1] = x * -s + y * c;
 	}
-	if (ptr->doftx) {
-		translate(temp, double(ptr->tx), 0, 0);
-		matrix_multS(TransferMatForChild, temp);
+}
+
+void Skeleton::BuildForwardKinematics()
+{
+	// depth first from the root, children before siblings (the order in which the
+	// recursive traversal visited the bones)
+	Bone *stack[MAX_BONES_IN_ASF_FILE];
+	int stackParent[MAX_BONES_IN_ASF_FILE];
+	int top = 0;
+	stack[top] = m_pRootBone;
+	stackParent[top] = -1;
+	top++;
+
+	m_NumFKBones = 0;
+	for (int i = 0; i < MAX_BONES_IN_ASF_FILE; i++)
+		m_FKPosition[i] = -1;
+	while ((top > 0) && (m_NumFKBones < MAX_BONES_IN_ASF_FILE)) {
+		top--;
+		Bone *bone = stack[top];
+		int position = m_NumFKBones++;
+		m_FKOrder[position] = bone->idx;
+		m_FKPosition[bone->idx] = position;
+		m_FKParent[position] = stackParent[top];
+		m_FKDofs[position] = (bone->doftx ? FK_TX : 0) | (bone->dofty ? FK_TY : 0) | (bone->doftz ? FK_TZ : 0)
+				| (bone->dofrx ? FK_RX : 0) | (bone->dofry ? FK_RY : 0) | (bone->dofrz ? FK_RZ : 0);
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++)
+				m_FKRotation[position][i][j] = bone->rot_parent_current[j][i];
+			m_FKOffset[position][i] = bone->dir[i] * bone->length;
+		}
+
+		// push the children in reverse, so that the first child comes out first
+		int first = top;
+		for (Bone *child = bone->child; (child != NULL) && (top < MAX_BONES_IN_ASF_FILE); child = child->sibling) {
+			stack[top] = child;
+			stackParent[top] = position;
+			top++;
+		}
+		for (int i = first, j = top - 1; i < j; i++, j--) {
+			Bone *swap = stack[i];
+			stack[i] = stack[j];
+			stack[j] = swap;
+		}
 	}
+}
 
-	//rotate AMC (rarely used)
-	if (ptr->dofrz) {
-		rotationZ(temp, double(ptr->rz));
-		matrix_multS(TransferMatForChild, temp);
+void Skeleton::TransformBone(int position, const double parent[3][4], const double dofValues[6], double m[3][4],
+		double joint[4][3]) const
+{
+	//Transform (rotate) from the local coordinate system of this bone to it's parent
+	//(the root's parent is the world)
+	const double (*r)[3] = m_FKRotation[position];
+	if (parent == NULL) {
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 3; col++)
+				m[row][col] = r[row][col];
+			m[row][3] = 0;
+		}
 	}
-	if (ptr->dofry) {
-		rotationY(temp, double(ptr->ry));
-		matrix_multS(TransferMatForChild, temp);
+	else {
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 3; col++)
+				m[row][col] = parent[row][0] * r[0][col] + parent[row][1] * r[1][col] + parent[row][2] * r[2][col];
+			m[row][3] = parent[row][3];
+		}
 	}
-	if (ptr->dofrx) {
-		rotationX(temp, double(ptr->rx));
-		matrix_multS(TransferMatForChild, temp);
+
+	//translate AMC
+	int dofs = m_FKDofs[position];
+	if (dofs & FK_TZ)
+		TranslateAffine(m, 0, 0, dofValues[2]);
+	if (dofs & FK_TY)
+		TranslateAffine(m, 0, dofValues[1], 0);
+	if (dofs & FK_TX)
+		TranslateAffine(m, dofValues[0], 0, 0);
+
+	//rotate AMC (each rotation turns about an axis of the frame the ones before it left)
+	if (joint != NULL)
+		for (int row = 0; row < 3; row++) {
+			joint[0][row] = m[row][3];
+			joint[3][row] = m[row][2];
+		}
+	if (dofs & FK_RZ)
+		RotateAffineZ(m, dofValues[5]);
+	if (joint != NULL)
+		for (int row = 0; row < 3; row++)
+			joint[2][row] = m[row][1];
+	if (dofs & FK_RY)
+		RotateAffineY(m, dofValues[4]);
+	if (joint != NULL)
+		for (int row = 0; row < 3; row++)
+			joint[1][row] = m[row][0];
+	if (dofs & FK_RX)
+		RotateAffineX(m, dofValues[3]);
+
+	//translate from the bone origin to its tip (the origin of its children)
+	TranslateAffine(m, m_FKOffset[position][0], m_FKOffset[position][1], m_FKOffset[position][2]);
+}
+
+void Skeleton::GetFrameDofs(int position, const double * frame, double dofValues[6]) const
+{
+	int bone = m_FKOrder[position];
+	int dofs = m_FKDofs[position];
+	int translation = m_PostureLayout.translationOffset[bone];
+	int rotation = m_PostureLayout.rotationOffset[bone];
+	for (int i = 0; i < 3; i++) {
+		dofValues[i] = ((dofs & (FK_TX << i)) && (translation >= 0)) ? frame[translation + i] : 0;
+		dofValues[3 + i] = ((dofs & (FK_RX << i)) && (rotation >= 0)) ? frame[rotation + i] : 0;
 	}
+}
 
-	//Compute tx, ty, tz : translation from pBone to its child (in local coordinate system of pBone)
-	double tx = ptr->dir[0] * ptr->length;
-	double ty = ptr->dir[1] * ptr->length;
-	double tz = ptr->dir[2] * ptr->length;
-	translate(temp, tx, ty, tz);
-	matrix_multS(TransferMatForChild, temp);
-
-	//Calculate tip position
-	double tip[3];
-	matrix_transform_affine(TransferMatForChild, 0, 0, 0, tip);
-	m_pBoneTipPos[ptr->idx][0] = tip[0];
-	m_pBoneTipPos[ptr->idx][1] = tip[1];
-	m_pBoneTipPos[ptr->idx][2] = tip[2];
-
-	//printf("id: %d  %lf %lf %lf\n", ptr->idx, rr[0], rr[1], rr[2]);
-}
\ No newline at end of file
+void Skeleton::computeBoneTipPos()
+{
+	for (int i = 0; i < m_NumFKBones; i++) {
+		const Bone *bone = m_pBoneByIdx[m_FKOrder[i]];
+		double dofValues[6] = { bone->tx, bone->ty, bone->tz, bone->rx, bone->ry, bone->rz };
+		int parent = m_FKParent[i];
+		TransformBone(i, (parent >= 0) ? m_FKTransform[parent] : NULL, dofValues, m_FKTransform[i]);
+
+		m_pBoneTipPos[bone->idx][0] = m_FKTransform[i][0][3];
+		m_pBoneTipPos[bone->idx][1] = m_FKTransform[i][1][3];
+		m_pBoneTipPos[bone->idx][2] = m_FKTransform[i][2][3];
+	}
+}
@@ -7,11 +7,18 @@
  Revision 2 - Alla and Kiran, Jan 18, 2002
  Revision 3 - Jernej Barbic and Yili Zhao, Feb, 2012
 
+ The hierarchy, the DOFs, the posture layout and the flattened forward kinematics do
+ not change once the ASF file is read (and enableAllRotationalDOFs called), so a
+ const Skeleton can be shared by any number of threads. setPosture and
+ computeBoneTipPos pose the skeleton itself (the bone angles and tip positions), for
+ one user at a time; threads pose their own SkeletonPose instead (see skeletonpose.h).
+
  */
 
 #ifndef _SKELETON_H
 #define _SKELETON_H
 
+#include <stddef.h>
 #include "posture.h"
 #include "transform.h"
 
@@ -71,6 +78,25 @@ public:
 
 	//Set the skeleton's pose based on the given posture    
 	void setPosture(Posture posture);
+	//Set the skeleton's pose based on a packed frame (see getPostureLayout)
+	void setPosture(const double * frame);
+
+	//Layout of the packed frames stored by Motion; fixed once the ASF file is read
+	const PostureLayout * getPostureLayout() const
+	{
+		return &m_PostureLayout;
+	}
+
+	//Bones with rotational DOFs (those with rotations in the packed frames), in index
+	//order; per-frame loops iterate over these instead of all MAX_BONES_IN_ASF_FILE bones
+	int getNumActiveBones() const
+	{
+		return m_NumActiveBones;
+	}
+	const int * getActiveBones() const
+	{
+		return m_ActiveBones;
+	}
 
 	//Initial posture Root at (0,0,0)
 	//All bone rotations are set to 0
@@ -79,7 +105,10 @@ public:
 	// marks previously unavailable rotational DOFs as available, and sets them to 0
 	void enableAllRotationalDOFs();
 
-	int name2idx(char *);
+	// bone name <-> bone index, O(1) through the table built when the ASF file is read;
+	// name2idx returns -1 and idx2name NULL for unknown bones
+	int name2idx(const char *name);
+	int name2idx(const char *name, size_t length); // name need not be null-terminated
 
 	char *idx2name(int);
 
@@ -123,6 +152,8 @@ public:
 
 	int movBonesInSkel(Bone bone);
 
+	//Compute the tip position of every bone for the current pose, in one pass over the
+	//bones in parent-before-child order (see BuildForwardKinematics)
 	void computeBoneTipPos();
 
 	vector getBoneTipPosition(int boneId)
@@ -137,6 +168,7 @@ public:
 
 	//This recursive function traverses skeleton hierarchy 
 	//and returns a pointer to the bone with index - bIndex
+	//(NULL if there is none below ptr or its siblings)
 	//ptr should be a pointer to the root node 
 	//when this function first called
 	Bone *getBone(Bone *ptr, int bIndex);
@@ -156,9 +188,23 @@ public:
 
 	void ComputeRotationToParentCoordSystem(Bone *bone);
 
-	// Caluculate the tip position for each bone and prepare the transfer matrix for his child
-	void ProcessBone(Bone *ptr, double transToWorld[4][4], double TransferMatForChild[4][4]);
-	void Traverse(Bone *ptr, double transToWorld[4][4]);
+	//Assign packed frame offsets to every bone (rotations for all bones with DOFs,
+	//translations and lengths only where the ASF file declares them)
+	void BuildPostureLayout();
+
+	//Flatten the hierarchy for computeBoneTipPos: order the bones so that every parent
+	//comes before its children, and keep the parent, the DOF mask, the transposed
+	//rot_parent_current and the bone offset of each in arrays in that order
+	void BuildForwardKinematics();
+
+	//Transform of the bone at position in m_FKOrder (bone tip frame to world), from the
+	//transform of its parent (NULL for the root) and its DOF values (tx, ty, tz, rx, ry, rz).
+	//joint (if not NULL) is set to the pivot of the bone's rotations and the world axes
+	//that rx, ry and rz turn about (for analytic derivatives of the pose)
+	void TransformBone(int position, const double parent[3][4], const double dofValues[6], double m[3][4],
+			double joint[4][3] = NULL) const;
+	//DOF values of the bone at position in m_FKOrder in a packed frame (0 where it has none)
+	void GetFrameDofs(int position, const double * frame, double dofValues[6]) const;
 
 	// root position in world coordinate system
 	double m_RootPos[3];
@@ -173,7 +219,29 @@ public:
 	vector m_pBoneTipPos[MAX_BONES_IN_ASF_FILE]; // Array of positions of bone tip
 	// call computeBoneTipPos to fill in
 
+	// flattened hierarchy (see BuildForwardKinematics), indexed by position in m_FKOrder
+	enum { FK_TX = 1, FK_TY = 2, FK_TZ = 4, FK_RX = 8, FK_RY = 16, FK_RZ = 32 };
+	int m_NumFKBones;
+	int m_FKOrder[MAX_BONES_IN_ASF_FILE]; // bone index
+	int m_FKParent[MAX_BONES_IN_ASF_FILE]; // position of the parent, -1 for the root
+	int m_FKPosition[MAX_BONES_IN_ASF_FILE]; // bone index -> position, -1 if not in the hierarchy
+	int m_FKDofs[MAX_BONES_IN_ASF_FILE]; // FK_* mask of the DOFs of the bone
+	double m_FKRotation[MAX_BONES_IN_ASF_FILE][3][3]; // bone to parent rotation
+	double m_FKOffset[MAX_BONES_IN_ASF_FILE][3]; // bone origin to tip, in bone coordinates
+	double m_FKTransform[MAX_BONES_IN_ASF_FILE][3][4]; // bone tip frame to world, 3x4 affine
+
+	PostureLayout m_PostureLayout;
+	int m_NumActiveBones;
+	int m_ActiveBones[MAX_BONES_IN_ASF_FILE];
+
 	void removeCR(char *str); // removes CR at the end of line
+
+	//Intern all bone names into m_BoneNameTable (open addressing, linear probing)
+	void BuildBoneNameTable();
+
+	enum { BONE_NAME_TABLE_SIZE = 2 * MAX_BONES_IN_ASF_FILE }; // power of two
+	int m_BoneNameTable[BONE_NAME_TABLE_SIZE]; // bone index, or -1 for an empty slot
+	Bone *m_pBoneByIdx[MAX_BONES_IN_ASF_FILE]; // bone index -> bone
 };
 
 #endif
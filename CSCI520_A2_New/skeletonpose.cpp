@@ -0,0 +1,148 @@
+/*
+ skeletonpose.cpp
+
+ See skeletonpose.h.
+
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "skeletonpose.h"
+
+SkeletonPose::SkeletonPose(const Skeleton * pSkeleton)
+{
+	m_pSkeleton = pSkeleton;
+	int numBones = pSkeleton->m_NumFKBones;
+	m_pTransforms = new double[(numBones > 0) ? numBones : 1][3][4];
+	m_pChainPositions = new int[(numBones > 0) ? numBones : 1];
+	m_pChainIndex = new int[(numBones > 0) ? numBones : 1];
+	m_pChainJoints = new double[(numBones > 0) ? numBones : 1][4][3];
+	for (int i = 0; i < numBones; i++)
+		m_pChainIndex[i] = -1;
+	m_NumChainBones = 0;
+	m_ChainHasBase = 0;
+}
+
+SkeletonPose::~SkeletonPose()
+{
+	delete[] m_pTransforms;
+	delete[] m_pChainPositions;
+	delete[] m_pChainIndex;
+	delete[] m_pChainJoints;
+}
+
+void SkeletonPose::ComputeBoneTipPos(const double * frame)
+{
+	const Skeleton * skeleton = m_pSkeleton;
+	for (int i = 0; i < skeleton->m_NumFKBones; i++) {
+		double dofValues[6];
+		skeleton->GetFrameDofs(i, frame, dofValues);
+		int parent = skeleton->m_FKParent[i];
+		skeleton->TransformBone(i, (parent >= 0) ? m_pTransforms[parent] : NULL, dofValues, m_pTransforms[i]);
+	}
+}
+
+vector SkeletonPose::GetBoneTipPosition(int boneId) const
+{
+	int position = ((boneId >= 0) && (boneId < MAX_BONES_IN_ASF_FILE)) ? m_pSkeleton->m_FKPosition[boneId] : -1;
+	if (position < 0)
+		return vector(0, 0, 0);
+	return vector(m_pTransforms[position][0][3], m_pTransforms[position][1][3], m_pTransforms[position][2][3]);
+}
+
+int SkeletonPose::SetChain(int startBone, int endBone, const double * frame)
+{
+	const Skeleton * skeleton = m_pSkeleton;
+	int start = ((startBone >= 0) && (startBone < MAX_BONES_IN_ASF_FILE)) ? skeleton->m_FKPosition[startBone] : -1;
+	int end = ((endBone >= 0) && (endBone < MAX_BONES_IN_ASF_FILE)) ? skeleton->m_FKPosition[endBone] : -1;
+
+	// the path from endBone up to startBone, then reversed
+	for (int i = 0; i < m_NumChainBones; i++)
+		m_pChainIndex[m_pChainPositions[i]] = -1;
+	m_NumChainBones = 0;
+	for (int position = end; (start >= 0) && (position >= 0); position = skeleton->m_FKParent[position]) {
+		m_pChainPositions[m_NumChainBones++] = position;
+		if (position == start)
+			break;
+	}
+	if ((start < 0) || (m_NumChainBones == 0) || (m_pChainPositions[m_NumChainBones - 1] != start)) {
+		printf("Error: bone %d is not bone %d or one of its ancestors.\n", startBone, endBone);
+		m_NumChainBones = 0;
+		m_ChainHasBase = 0;
+		return -1;
+	}
+	for (int i = 0, j = m_NumChainBones - 1; i < j; i++, j--) {
+		int swap = m_pChainPositions[i];
+		m_pChainPositions[i] = m_pChainPositions[j];
+		m_pChainPositions[j] = swap;
+	}
+	for (int i = 0; i < m_NumChainBones; i++)
+		m_pChainIndex[m_pChainPositions[i]] = i;
+
+	// transform of the parent of startBone, from the root down
+	int path[MAX_BONES_IN_ASF_FILE];
+	int numPath = 0;
+	for (int position = skeleton->m_FKParent[start]; position >= 0; position = skeleton->m_FKParent[position])
+		path[numPath++] = position;
+	m_ChainHasBase = (numPath > 0);
+	for (int i = numPath - 1; i >= 0; i--) {
+		double dofValues[6], m[3][4];
+		skeleton->GetFrameDofs(path[i], frame, dofValues);
+		skeleton->TransformBone(path[i], (i < numPath - 1) ? m_ChainBase : NULL, dofValues, m);
+		memcpy(m_ChainBase, m, sizeof(m));
+	}
+	return 0;
+}
+
+vector SkeletonPose::ComputeChainTipPos(const double * frame)
+{
+	const Skeleton * skeleton = m_pSkeleton;
+	double m[2][3][4];
+	const double (*parent)[4] = m_ChainHasBase ? m_ChainBase : NULL;
+	for (int i = 0; i < m_NumChainBones; i++) {
+		double dofValues[6];
+		skeleton->GetFrameDofs(m_pChainPositions[i], frame, dofValues);
+		skeleton->TransformBone(m_pChainPositions[i], parent, dofValues, m[i & 1]);
+		parent = m[i & 1];
+	}
+	if (parent == NULL)
+		return vector(0, 0, 0);
+	return vector(parent[0][3], parent[1][3], parent[2][3]);
+}
+
+vector SkeletonPose::ComputeChainJacobian(const double * frame, int numDofs, const int * dofBones,
+		const int * dofAxes, double * jacobian)
+{
+	const Skeleton * skeleton = m_pSkeleton;
+	double m[2][3][4];
+	const double (*parent)[4] = m_ChainHasBase ? m_ChainBase : NULL;
+	for (int i = 0; i < m_NumChainBones; i++) {
+		double dofValues[6];
+		skeleton->GetFrameDofs(m_pChainPositions[i], frame, dofValues);
+		skeleton->TransformBone(m_pChainPositions[i], parent, dofValues, m[i & 1], m_pChainJoints[i]);
+		parent = m[i & 1];
+	}
+	vector tip(0, 0, 0);
+	if (parent != NULL)
+		tip = vector(parent[0][3], parent[1][3], parent[2][3]);
+
+	// the rotations are in degrees
+	const double radians = M_PI / 180.0;
+	for (int i = 0; i < numDofs; i++) {
+		int bone = dofBones[i];
+		int position = ((bone >= 0) && (bone < MAX_BONES_IN_ASF_FILE)) ? skeleton->m_FKPosition[bone] : -1;
+		int index = (position >= 0) ? m_pChainIndex[position] : -1;
+		int axis = dofAxes[i];
+		if ((index < 0) || (axis < 0) || (axis > 2) || !(skeleton->m_FKDofs[position] & (Skeleton::FK_RX << axis))) {
+			jacobian[i] = jacobian[numDofs + i] = jacobian[2 * numDofs + i] = 0;
+			continue;
+		}
+		const double * pivot = m_pChainJoints[index][0];
+		const double * a = m_pChainJoints[index][1 + axis];
+		double r[3] = { tip.p[0] - pivot[0], tip.p[1] - pivot[1], tip.p[2] - pivot[2] };
+		jacobian[i] = radians * (a[1] * r[2] - a[2] * r[1]);
+		jacobian[numDofs + i] = radians * (a[2] * r[0] - a[0] * r[2]);
+		jacobian[2 * numDofs + i] = radians * (a[0] * r[1] - a[1] * r[0]);
+	}
+	return tip;
+}
@@ -0,0 +1,70 @@
+/*
+ skeletonpose.h
+
+ Pose and forward kinematics state for one user of a shared skeleton: the bone
+ transforms of one pose, computed straight from packed frames (see
+ Skeleton::getPostureLayout) with the flattened hierarchy of the Skeleton. The
+ Skeleton is only read, so every thread can pose its own SkeletonPose of the same
+ skeleton at once (e.g. the IK solver on the segments that are interpolated in
+ parallel). The tip positions are bitwise those of Skeleton::setPosture and
+ Skeleton::computeBoneTipPos.
+
+ */
+
+#ifndef _SKELETONPOSE_H
+#define _SKELETONPOSE_H
+
+#include "skeleton.h"
+#include "vector.h"
+
+class SkeletonPose {
+public:
+	SkeletonPose(const Skeleton * pSkeleton);
+	~SkeletonPose();
+
+	const Skeleton * GetSkeleton() const {
+		return m_pSkeleton;
+	}
+
+	// Pose all bones for a packed frame.
+	void ComputeBoneTipPos(const double * frame);
+	// tip position of a bone (by bone index) after ComputeBoneTipPos
+	vector GetBoneTipPosition(int boneId) const;
+
+	// Partial forward kinematics for end-effector queries (e.g. IK): the tip position of
+	// endBone for the pose in a packed frame, transforming only the bones from startBone
+	// down to endBone (startBone must be endBone or one of its ancestors). SetChain
+	// transforms the bones above startBone for the pose in frame and keeps the result, so
+	// ComputeChainTipPos gives the tip of ComputeBoneTipPos as long as only the DOFs of
+	// startBone and its descendants change. SetChain returns 0, or -1 if startBone is not
+	// above endBone.
+	int SetChain(int startBone, int endBone, const double * frame);
+	vector ComputeChainTipPos(const double * frame);
+
+	// The chain tip of ComputeChainTipPos (returned), and in the same pass its 3 x numDofs
+	// Jacobian (row major, per degree) with respect to the rotations dofBones[i] (bone
+	// index) about dofAxes[i] (0: x, 1: y, 2: z): column i is axis x (tip - pivot) for the
+	// world axis and the pivot of that rotation, 0 for rotations of bones not on the chain
+	// (or that the skeleton does not have).
+	vector ComputeChainJacobian(const double * frame, int numDofs, const int * dofBones,
+			const int * dofAxes, double * jacobian);
+
+protected:
+	const Skeleton * m_pSkeleton;
+	// bone tip frame to world of every bone, in the order of Skeleton::m_FKOrder
+	double (*m_pTransforms)[3][4];
+
+	// chain of SetChain: positions (in m_FKOrder) from the start to the end bone, and the
+	// transform of the parent of the start bone (if it has one); m_pChainIndex is the
+	// index in the chain of every position, -1 for positions not on the chain
+	int m_NumChainBones;
+	int * m_pChainPositions;
+	int * m_pChainIndex;
+	// pivot and rotation axes of the chain bones (see Skeleton::TransformBone)
+	double (*m_pChainJoints)[4][3];
+	int m_ChainHasBase;
+	double m_ChainBase[3][4];
+};
+
+#endif
+
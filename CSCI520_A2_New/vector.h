@@ -50,7 +50,7 @@ public:
 		p[1] = y;
 		p[2] = z;
 	}
-	vector(double a[3]) {
+	vector(const double a[3]) {
 		p[0] = a[0];
 		p[1] = a[1];
 		p[2] = a[2];